@@ -0,0 +1,253 @@
+/**
+ * @file bench_config.cc
+ * @brief 配置读取的多线程扩展性和大配置文件的加载速度测试
+ * @version 0.1
+ * @date 2024-07-18
+ * @details 读取：对比读写锁保护的读取(原来的getValue)和线程快照缓存的读取，
+ *          后台有一个线程每毫秒修改一次配置，模拟运行时热更新。
+ *          加载：生成一个有10万条IP白名单的配置文件，对比逐个元素序列化再YAML::Load
+ *          (原来的LexicalCast)和直接从YAML::Node转换。
+ *          查找：每次按名字Config::Lookup和缓存了指针的ConfigHandle
+ */
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+
+/**
+ * @brief 原来的实现：每次读取加读锁并拷贝
+ */
+template <class T>
+class LockedVar {
+   public:
+    LockedVar(const T& v) : m_val(v) {}
+
+    T getValue() {
+        coro::RWMutex::ReadLock lock(m_mutex);
+        return m_val;
+    }
+
+    void setValue(const T& v) {
+        coro::RWMutex::WriteLock lock(m_mutex);
+        m_val = v;
+    }
+
+   private:
+    coro::RWMutex m_mutex;
+    T m_val;
+};
+
+/**
+ * @brief 原来的容器转换：每个元素输出成字符串再YAML::Load
+ */
+template <class T>
+class OldVectorCast {
+   public:
+    std::vector<T> operator()(const std::string &v) {
+        YAML::Node node = YAML::Load(v);
+        typename std::vector<T> vec;
+        std::stringstream ss;
+        for (size_t i = 0; i < node.size(); ++i) {
+            ss.str("");
+            ss << node[i];
+            vec.push_back(coro::LexicalCast<std::string, T>()(ss.str()));
+        }
+        return vec;
+    }
+};
+
+template <class T>
+class OldMapCast {
+   public:
+    std::map<std::string, T> operator()(const std::string &v) {
+        YAML::Node node = YAML::Load(v);
+        typename std::map<std::string, T> vec;
+        std::stringstream ss;
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            ss.str("");
+            ss << it->second;
+            vec.insert(std::make_pair(
+                it->first.Scalar(),
+                coro::LexicalCast<std::string, T>()(ss.str())));
+        }
+        return vec;
+    }
+};
+
+static coro::ConfigVar<std::vector<std::string>>::ptr g_allow =
+    coro::Config::Lookup("bench.allow", std::vector<std::string>(),
+                         "ip allow list");
+static coro::ConfigVar<std::map<std::string, int>>::ptr g_limits =
+    coro::Config::Lookup("bench.limits", std::map<std::string, int>(),
+                         "per user limits");
+
+static double ms_since(std::chrono::steady_clock::time_point begin) {
+    std::chrono::duration<double, std::milli> used =
+        std::chrono::steady_clock::now() - begin;
+    return used.count();
+}
+
+/**
+ * @brief 加载entries条白名单和entries/10条限额的配置文件
+ */
+static void bench_load(int entries) {
+    const char* path = "/tmp/coro_bench_config.yml";
+    {
+        std::ofstream ofs(path);
+        ofs << "bench:\n  allow:\n";
+        for (int i = 0; i < entries; ++i) {
+            ofs << "    - 10." << (i >> 16 & 255) << "." << (i >> 8 & 255)
+                << "." << (i & 255) << "\n";
+        }
+        ofs << "  limits:\n";
+        for (int i = 0; i < entries / 10; ++i) {
+            ofs << "    user_" << i << ": " << i << "\n";
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    YAML::Node root = YAML::LoadFile(path);
+    std::cout << "parse file: " << ms_since(begin) << " ms" << std::endl;
+
+    // 原来的加载路径：节点输出成字符串，再逐个元素重新解析
+    begin = std::chrono::steady_clock::now();
+    std::stringstream ss;
+    ss << root["bench"]["allow"];
+    std::vector<std::string> allow = OldVectorCast<std::string>()(ss.str());
+    ss.str("");
+    ss << root["bench"]["limits"];
+    std::map<std::string, int> limits = OldMapCast<int>()(ss.str());
+    std::cout << "old cast: " << ms_since(begin) << " ms (" << allow.size()
+              << " + " << limits.size() << ")" << std::endl;
+
+    begin = std::chrono::steady_clock::now();
+    ss.str("");
+    ss << root["bench"]["allow"];
+    g_allow->fromString(ss.str());
+    ss.str("");
+    ss << root["bench"]["limits"];
+    g_limits->fromString(ss.str());
+    std::cout << "new cast from string: " << ms_since(begin) << " ms ("
+              << g_allow->getSnapshot().size() << " + "
+              << g_limits->getSnapshot().size() << ")" << std::endl;
+
+    g_allow->setValue({});
+    g_limits->setValue({});
+    begin = std::chrono::steady_clock::now();
+    g_allow->fromNode(root["bench"]["allow"]);
+    g_limits->fromNode(root["bench"]["limits"]);
+    std::cout << "new cast from node: " << ms_since(begin) << " ms ("
+              << g_allow->getSnapshot().size() << " + "
+              << g_limits->getSnapshot().size() << ")" << std::endl;
+}
+
+static coro::ConfigVar<int>::ptr g_int =
+    coro::Config::Lookup("bench.int", 4096, "bench int");
+static coro::ConfigVar<std::string>::ptr g_str =
+    coro::Config::Lookup("bench.str", std::string("/var/log/bench.log"),
+                         "bench string");
+
+/**
+ * @brief threads个线程各读reads次，返回每秒读取的百万次数
+ */
+template <class F, class W>
+static double run(size_t threads, int reads, F read, W write) {
+    std::atomic<bool> stop{false};
+    std::thread writer([&]() {
+        for (int i = 0; !stop; ++i) {
+            write(i);
+            usleep(1000);
+        }
+    });
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> ths;
+    std::atomic<uint64_t> sum{0};
+    for (size_t i = 0; i < threads; ++i) {
+        ths.emplace_back([&]() {
+            uint64_t s = 0;
+            for (int j = 0; j < reads; ++j) {
+                s += read();
+            }
+            sum += s;
+        });
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    stop = true;
+    writer.join();
+    return threads * reads / used.count() / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = 32;
+    int reads = 2000000;
+    int entries = 100000;
+    if (argc > 1) {
+        max_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        reads = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        entries = atoi(argv[3]);
+    }
+
+    bench_load(entries);
+
+    LockedVar<int> locked_int(4096);
+    LockedVar<std::string> locked_str("/var/log/bench.log");
+
+    // 按名字查找：分片读锁和类型化句柄
+    {
+        coro::ConfigHandle<int> handle("bench.int", 0);
+        std::cout << "threads\tLookup\t\tConfigHandle (M lookups/s)"
+                  << std::endl;
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            double lookup = run(
+                threads, reads / 4,
+                []() { return coro::Config::Lookup("bench.int", 0)->getSnapshot(); },
+                [](int i) {});
+            double cached = run(
+                threads, reads, [&]() { return handle->getSnapshot(); },
+                [](int i) {});
+            std::cout << threads << "\t" << lookup << "\t\t" << cached
+                      << std::endl;
+        }
+    }
+
+    std::cout << "threads\tlock_int\tsnap_int\tlock_str\tgetValue_str"
+                 "\tsnap_str (M reads/s)"
+              << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        double lock_int = run(
+            threads, reads, [&]() { return locked_int.getValue(); },
+            [&](int i) { locked_int.setValue(i); });
+        double snap_int = run(
+            threads, reads, [&]() { return g_int->getSnapshot(); },
+            [&](int i) { g_int->setValue(i); });
+        double lock_str = run(
+            threads, reads, [&]() { return locked_str.getValue().size(); },
+            [&](int i) { locked_str.setValue(std::to_string(i)); });
+        double value_str = run(
+            threads, reads, [&]() { return g_str->getValue().size(); },
+            [&](int i) { g_str->setValue(std::to_string(i)); });
+        double snap_str = run(
+            threads, reads, [&]() { return g_str->getSnapshot().size(); },
+            [&](int i) { g_str->setValue(std::to_string(i)); });
+        std::cout << threads << "\t" << lock_int << "\t\t" << snap_int
+                  << "\t\t" << lock_str << "\t\t" << value_str << "\t\t"
+                  << snap_str << std::endl;
+    }
+    return 0;
+}
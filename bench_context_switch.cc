@@ -0,0 +1,88 @@
+/**
+ * @file bench_context_switch.cc
+ * @brief 上下文切换后端性能测试，输出每种后端每秒的切换次数
+ * @version 0.1
+ * @date 2024-06-20
+ */
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "context.h"
+
+static const size_t kStackSize = 128 * 1024;
+static uint64_t g_rounds = 10 * 1000 * 1000;
+
+static ucontext_t g_uc_main, g_uc_child;
+
+static void ucontext_func() {
+    while (true) {
+        swapcontext(&g_uc_child, &g_uc_main);
+    }
+}
+
+// 一次resume + 一次yield算两次切换
+static double bench_ucontext() {
+    void *stack = malloc(kStackSize);
+    getcontext(&g_uc_child);
+    g_uc_child.uc_link = nullptr;
+    g_uc_child.uc_stack.ss_sp = stack;
+    g_uc_child.uc_stack.ss_size = kStackSize;
+    makecontext(&g_uc_child, ucontext_func, 0);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < g_rounds; ++i) {
+        swapcontext(&g_uc_main, &g_uc_child);
+    }
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    free(stack);
+    return g_rounds * 2 / used.count();
+}
+
+#ifdef CORO_CONTEXT_HAS_ASM
+static void *g_asm_main = nullptr;
+static void *g_asm_child = nullptr;
+
+static void asm_func() {
+    while (true) {
+        coro_context_swap(&g_asm_child, g_asm_main);
+    }
+}
+
+static double bench_asm() {
+    void *stack = malloc(kStackSize);
+    g_asm_child = coro_context_make(stack, kStackSize, asm_func);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < g_rounds; ++i) {
+        coro_context_swap(&g_asm_main, g_asm_child);
+    }
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    free(stack);
+    return g_rounds * 2 / used.count();
+}
+#endif
+
+static void report(const std::string &name, double rate) {
+    std::cout << name << ": " << static_cast<uint64_t>(rate)
+              << " switches/sec, " << 1e9 / rate << " ns/switch" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        g_rounds = strtoull(argv[1], nullptr, 10);
+    }
+    std::cout << "rounds: " << g_rounds
+              << ", fiber backend: " << coro::Context::BackendName()
+              << std::endl;
+    report("ucontext", bench_ucontext());
+#ifdef CORO_CONTEXT_HAS_ASM
+    report("asm", bench_asm());
+#endif
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file bench_false_sharing.cc
+ * @brief 伪共享测试，用perf_event_open统计每种写法的缓存未命中次数
+ * @version 0.1
+ * @date 2024-07-23
+ * @details 每个线程只写自己的计数器或锁，对比共享一个原子变量、相邻不对齐、
+ *          缓存行对齐和PerCpuCounter，最后跑一轮调度器扇出任务。
+ *          perf_event_open不可用(容器限制或perf_event_paranoid过高)时只输出耗时
+ */
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "counter.h"
+#include "mutex.h"
+#include "scheduler.h"
+
+/**
+ * @brief 统计本进程及之后创建的线程的一个硬件事件
+ */
+class PerfCounter {
+   public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~PerfCounter() {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    bool valid() const { return m_fd >= 0; }
+
+    void start() {
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    /**
+     * @brief 停止计数，返回期间的事件数，不可用时返回0
+     */
+    uint64_t stop() {
+        uint64_t value = 0;
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &value, sizeof(value)) != sizeof(value)) {
+                value = 0;
+            }
+        }
+        return value;
+    }
+
+   private:
+    int m_fd;
+};
+
+static PerfCounter* s_l1d_miss = nullptr;
+static PerfCounter* s_llc_miss = nullptr;
+
+/**
+ * @brief threads个线程各执行一次body(线程序号)，输出耗时和每次操作的未命中数
+ */
+static void measure(const std::string& name, size_t threads, uint64_t ops,
+                    const std::function<void(size_t)>& body) {
+    // 线程在计数开始之后创建，inherit才能统计到它们
+    s_l1d_miss->start();
+    s_llc_miss->start();
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> ths;
+    for (size_t i = 0; i < threads; ++i) {
+        ths.emplace_back(body, i);
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    std::chrono::duration<double, std::milli> used =
+        std::chrono::steady_clock::now() - begin;
+    uint64_t l1d = s_l1d_miss->stop();
+    uint64_t llc = s_llc_miss->stop();
+
+    char buf[256];
+    if (s_l1d_miss->valid()) {
+        snprintf(buf, sizeof(buf), "%-28s %9.1f ms  L1D miss/op %7.3f  LLC miss/op %7.3f",
+                 name.c_str(), used.count(), (double)l1d / ops,
+                 (double)llc / ops);
+    } else {
+        snprintf(buf, sizeof(buf), "%-28s %9.1f ms", name.c_str(),
+                 used.count());
+    }
+    std::cout << buf << std::endl;
+}
+
+struct alignas(coro::kCacheLineSize) PaddedAtomic {
+    std::atomic<uint64_t> value{0};
+};
+
+template <class MutexType>
+static void bench_locks(const std::string& name, size_t threads, int iters) {
+    std::unique_ptr<MutexType[]> locks(new MutexType[threads]);
+    std::unique_ptr<uint64_t[]> values(new uint64_t[threads]());
+    measure(name, threads, threads * iters, [&](size_t id) {
+        for (int i = 0; i < iters; ++i) {
+            typename MutexType::Lock lock(locks[id]);
+            ++values[id];
+        }
+    });
+}
+
+int main(int argc, char* argv[]) {
+    size_t threads = std::thread::hardware_concurrency();
+    int iters = 5000000;
+    if (argc > 1) {
+        threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        iters = atoi(argv[2]);
+    }
+    PerfCounter l1d(PERF_TYPE_HW_CACHE,
+                    PERF_COUNT_HW_CACHE_L1D |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    PerfCounter llc(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    s_l1d_miss = &l1d;
+    s_llc_miss = &llc;
+    std::cout << "threads " << threads << ", iters " << iters;
+    if (!l1d.valid()) {
+        std::cout << ", perf_event_open unavailable: " << strerror(errno);
+    }
+    std::cout << std::endl;
+    uint64_t ops = threads * iters;
+
+    // 计数器
+    std::atomic<uint64_t> shared{0};
+    measure("shared atomic", threads, ops, [&](size_t) {
+        for (int i = 0; i < iters; ++i) {
+            shared.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::unique_ptr<std::atomic<uint64_t>[]> adjacent(
+        new std::atomic<uint64_t>[threads]);
+    for (size_t i = 0; i < threads; ++i) {
+        adjacent[i] = 0;
+    }
+    measure("adjacent atomics", threads, ops, [&](size_t id) {
+        for (int i = 0; i < iters; ++i) {
+            adjacent[id].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::unique_ptr<PaddedAtomic[]> padded(new PaddedAtomic[threads]);
+    measure("padded atomics", threads, ops, [&](size_t id) {
+        for (int i = 0; i < iters; ++i) {
+            padded[id].value.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    coro::PerCpuCounter<uint64_t> per_cpu;
+    measure("PerCpuCounter", threads, ops, [&](size_t) {
+        for (int i = 0; i < iters; ++i) {
+            per_cpu.add();
+        }
+    });
+
+    // 每个线程只用自己的锁，相邻的锁是否落在同一缓存行
+    bench_locks<coro::Spinlock>("Spinlock[]", threads, iters);
+    bench_locks<coro::PaddedSpinlock>("PaddedSpinlock[]", threads, iters);
+    bench_locks<coro::AdaptiveLock>("AdaptiveLock[]", threads, iters);
+    bench_locks<coro::PaddedAdaptiveLock>("PaddedAdaptiveLock[]", threads,
+                                          iters);
+    bench_locks<coro::Mutex>("Mutex[]", threads, iters);
+    bench_locks<coro::PaddedMutex>("PaddedMutex[]", threads, iters);
+
+    // 调度器扇出：计数器和锁在调度线程之间的共享
+    int roots = iters / 500;
+    std::atomic<uint64_t> done{0};
+    measure("scheduler fan-out", 1, roots * 65ull, [&](size_t) {
+        coro::Scheduler sc(threads, false, "bench");
+        sc.start();
+        for (int i = 0; i < roots; ++i) {
+            sc.scheduleLock([&sc, &done]() {
+                for (int j = 0; j < 64; ++j) {
+                    sc.scheduleLock([&done]() { ++done; });
+                }
+                ++done;
+            });
+        }
+        sc.stop();
+    });
+    return done == roots * 65ull ? 0 : 1;
+}
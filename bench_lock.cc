@@ -0,0 +1,100 @@
+/**
+ * @file bench_lock.cc
+ * @brief 锁竞争测试，对比Mutex，Spinlock，CASLock和AdaptiveLock
+ * @version 0.1
+ * @date 2024-07-21
+ * @details 线程数从1翻倍到N(默认超过CPU数，模拟超订)，每个线程加锁后做一小段临界区工作。
+ *          输出每秒加锁次数和CPU时间/墙钟时间，后者反映空转烧掉的CPU
+ */
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mutex.h"
+
+static double cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct Result {
+    double mops;
+    double cpu_ratio;
+};
+
+/**
+ * @brief threads个线程各加锁iters次，临界区内做work次计算
+ */
+template <class MutexType>
+static Result run(size_t threads, int iters, int work) {
+    MutexType mutex;
+    volatile uint64_t shared = 0;
+    double cpu_begin = cpu_seconds();
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> ths;
+    for (size_t i = 0; i < threads; ++i) {
+        ths.emplace_back([&]() {
+            for (int j = 0; j < iters; ++j) {
+                typename MutexType::Lock lock(mutex);
+                for (int k = 0; k < work; ++k) {
+                    shared = shared + k;
+                }
+            }
+        });
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    Result rt;
+    rt.mops = threads * iters / used.count() / 1e6;
+    rt.cpu_ratio = (cpu_seconds() - cpu_begin) / used.count();
+    return rt;
+}
+
+static std::string format(const Result& r) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%7.2f/%4.1f", r.mops, r.cpu_ratio);
+    return buf;
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = std::thread::hardware_concurrency() * 4;
+    int iters = 200000;
+    int work = 20;
+    if (argc > 1) {
+        max_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        iters = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        work = atoi(argv[3]);
+    }
+
+    std::cout << "cpus " << std::thread::hardware_concurrency()
+              << ", work " << work << ", M locks/s / cpu time per wall second"
+              << std::endl;
+    std::cout << "threads\tMutex\t\tSpinlock\tCASLock\t\tAdaptiveLock"
+              << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        // 超订时自旋锁会慢几个数量级，按线程数减少迭代次数
+        int n = iters / threads;
+        Result mutex = run<coro::Mutex>(threads, n, work);
+        Result spin = run<coro::Spinlock>(threads, n, work);
+        Result cas = run<coro::CASLock>(threads, n, work);
+        Result adaptive = run<coro::AdaptiveLock>(threads, n, work);
+        std::cout << threads << "\t" << format(mutex) << "\t" << format(spin)
+                  << "\t" << format(cas) << "\t" << format(adaptive)
+                  << std::endl;
+    }
+    return 0;
+}
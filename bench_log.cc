@@ -0,0 +1,110 @@
+/**
+ * @file bench_log.cc
+ * @brief 异步日志、二进制日志和逐行同步写文件的吞吐对比
+ * @version 0.1
+ * @date 2024-07-05
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "binlog.h"
+#include "log.h"
+
+template <class F>
+static double run_threads(size_t threads, F f) {
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> ths;
+    for (size_t i = 0; i < threads; ++i) {
+        ths.emplace_back(f);
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    return used.count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t threads = 4;
+    int lines = 200000;
+    if (argc > 1) {
+        threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        lines = atoi(argv[2]);
+    }
+
+    // 基准：每行格式化后在锁内write一次
+    {
+        int fd = open("/tmp/coro_bench_sync.log",
+                      O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        std::mutex mutex;
+        double used = run_threads(threads, [&]() {
+            char buf[256];
+            for (int i = 0; i < lines; ++i) {
+                int n = snprintf(buf, sizeof(buf),
+                                 "%ld\tINFO\tbench_log.cc:%d\tline %d\n",
+                                 (long)time(0), __LINE__, i);
+                std::lock_guard<std::mutex> lock(mutex);
+                ssize_t rt = write(fd, buf, n);
+                (void)rt;
+            }
+        });
+        close(fd);
+        std::cout << "sync:  " << threads * lines / used / 1e6
+                  << " M lines/s" << std::endl;
+    }
+
+    {
+        unlink("/tmp/coro_bench_async.log");
+        coro::Logger::ptr logger(new coro::Logger("bench"));
+        logger->addAppender(coro::LogAppender::ptr(
+            new coro::FileLogAppender("/tmp/coro_bench_async.log")));
+        coro::LogFlusherMgr::GetInstance()->setOverflowPolicy(
+            coro::LogFlusher::BLOCK);
+        double used = run_threads(threads, [&]() {
+            for (int i = 0; i < lines; ++i) {
+                CORO_LOG_INFO(logger) << "line " << i;
+            }
+        });
+        coro::LogFlusherMgr::GetInstance()->flush();
+        std::chrono::duration<double> total = std::chrono::duration<double>(used);
+        std::cout << "async: " << threads * lines / total.count() / 1e6
+                  << " M lines/s (enqueue), dropped "
+                  << coro::LogFlusherMgr::GetInstance()->getDropped()
+                  << std::endl;
+    }
+
+    // 二进制日志：调用线程只写id和参数
+    {
+        const char* prefix = "/tmp/coro_bench_binlog";
+        for (int i = 0; i < 64; ++i) {
+            unlink((std::string(prefix) + "." + std::to_string(i)).c_str());
+        }
+        coro::Logger::ptr logger(new coro::Logger("bench_bin"));
+        coro::BinLogAppender::ptr appender(new coro::BinLogAppender(prefix));
+        logger->addAppender(appender);
+        double used = run_threads(threads, [&]() {
+            for (int i = 0; i < lines; ++i) {
+                CORO_BINLOG_INFO(logger, "line %d", i);
+            }
+        });
+        coro::LogFlusherMgr::GetInstance()->flush();
+        std::cout << "binlog: " << threads * lines / used / 1e6
+                  << " M lines/s (enqueue), dropped "
+                  << appender->getDropped() +
+                         coro::LogFlusherMgr::GetInstance()->getDropped()
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file bench_scheduler.cc
+ * @brief 调度器扩展性测试，线程数从1到N，输出每秒执行的任务数
+ * @details 子任务分两种：不捕获变量的lambda，以及捕获32字节、超出std::function内联存储的lambda。
+ *          最后一列用schedule批量提交不捕获变量的子任务
+ * @version 0.1
+ * @date 2024-06-24
+ */
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+static std::atomic<uint64_t> s_done{0};
+
+// 批量扇出，每批64个
+static void root_batch_task(coro::Scheduler *sc, int fanout) {
+    std::vector<coro::TaskFunction> batch;
+    batch.reserve(64);
+    for (int i = 0; i < fanout; i += 64) {
+        for (int j = i; j < fanout && j < i + 64; ++j) {
+            batch.emplace_back([]() { ++s_done; });
+        }
+        sc->schedule(batch.begin(), batch.end());
+        batch.clear();
+    }
+    ++s_done;
+}
+
+// 每个根任务在调度线程内再扇出fanout个子任务，子任务走本地队列和窃取
+static void root_task(coro::Scheduler *sc, int fanout, bool capture) {
+    for (int i = 0; i < fanout; ++i) {
+        if (capture) {
+            std::atomic<uint64_t> *done = &s_done;
+            uint64_t a = i, b = fanout, c = 1;
+            sc->scheduleLock([done, a, b, c]() { *done += (a < b) * c; });
+        } else {
+            sc->scheduleLock([]() { ++s_done; });
+        }
+    }
+    ++s_done;
+}
+
+static double bench(size_t threads, int roots, int fanout, bool capture,
+                    bool batch = false) {
+    s_done = 0;
+    coro::Scheduler sc(threads, false, "bench");
+    sc.start();
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < roots; ++i) {
+        if (batch) {
+            sc.scheduleLock(std::bind(root_batch_task, &sc, fanout));
+        } else {
+            sc.scheduleLock(std::bind(root_task, &sc, fanout, capture));
+        }
+    }
+    sc.stop();
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    return s_done / used.count();
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_threads = std::thread::hardware_concurrency();
+    int roots = 1000;
+    int fanout = 1000;
+    if (argc > 1) {
+        max_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        roots = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        fanout = atoi(argv[3]);
+    }
+    std::cout << "roots: " << roots << ", fanout: " << fanout << std::endl;
+    for (size_t n = 1; n <= max_threads; ++n) {
+        double rate = bench(n, roots, fanout, false);
+        double capture = bench(n, roots, fanout, true);
+        double batch = bench(n, roots, fanout, false, true);
+        std::cout << "threads: " << n << ", "
+                  << static_cast<uint64_t>(rate) << " tasks/sec, capture "
+                  << static_cast<uint64_t>(capture) << " tasks/sec, batch "
+                  << static_cast<uint64_t>(batch) << " tasks/sec" << std::endl;
+    }
+    return 0;
+}
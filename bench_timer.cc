@@ -0,0 +1,119 @@
+/**
+ * @file bench_timer.cc
+ * @brief 时间轮定时器和最小堆(有序集合)定时器的添加/取消性能对比
+ * @version 0.1
+ * @date 2024-06-28
+ */
+#include <stdlib.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "timer.h"
+#include "util.h"
+
+/**
+ * @brief 基准实现：按到期时间排序的定时器集合，添加和取消都是O(log n)
+ */
+class HeapTimerManager {
+   public:
+    struct HeapTimer {
+        uint64_t next;
+        std::function<void()> cb;
+    };
+    typedef std::shared_ptr<HeapTimer> ptr;
+
+    struct Comparator {
+        bool operator()(const ptr &lhs, const ptr &rhs) const {
+            if (lhs->next != rhs->next) {
+                return lhs->next < rhs->next;
+            }
+            return lhs.get() < rhs.get();
+        }
+    };
+
+    ptr addTimer(uint64_t ms, std::function<void()> cb) {
+        ptr timer(new HeapTimer{coro::GetElapsedMS() + ms, cb});
+        coro::Mutex::Lock lock(m_mutex);
+        m_timers.insert(timer);
+        return timer;
+    }
+
+    bool cancel(const ptr &timer) {
+        coro::Mutex::Lock lock(m_mutex);
+        return m_timers.erase(timer) > 0;
+    }
+
+   private:
+    coro::Mutex m_mutex;
+    std::set<ptr, Comparator> m_timers;
+};
+
+class WheelTimerManager : public coro::TimerManager {
+   protected:
+    void onTimerInsertedAtFront() override {}
+};
+
+template <class F>
+static double measure(F f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::nano> used =
+        std::chrono::steady_clock::now() - begin;
+    return used.count();
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = 1000 * 1000;
+    if (argc > 1) {
+        count = strtoull(argv[1], nullptr, 10);
+    }
+
+    // 模拟请求读超时：1~30秒的随机超时，绝大多数在到期前被取消
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> timeouts(count);
+    for (auto &i : timeouts) {
+        i = 1000 + rng() % 29000;
+    }
+    auto cb = []() {};
+
+    {
+        HeapTimerManager heap;
+        std::vector<HeapTimerManager::ptr> timers(count);
+        double add = measure([&]() {
+            for (size_t i = 0; i < count; ++i) {
+                timers[i] = heap.addTimer(timeouts[i], cb);
+            }
+        });
+        double cancel = measure([&]() {
+            for (size_t i = 0; i < count; ++i) {
+                heap.cancel(timers[i]);
+            }
+        });
+        std::cout << "heap:  add " << add / count << " ns/op, cancel "
+                  << cancel / count << " ns/op" << std::endl;
+    }
+
+    {
+        WheelTimerManager wheel;
+        std::vector<coro::Timer::ptr> timers(count);
+        double add = measure([&]() {
+            for (size_t i = 0; i < count; ++i) {
+                timers[i] = wheel.addTimer(timeouts[i], cb);
+            }
+        });
+        double cancel = measure([&]() {
+            for (size_t i = 0; i < count; ++i) {
+                timers[i]->cancel();
+            }
+        });
+        std::cout << "wheel: add " << add / count << " ns/op, cancel "
+                  << cancel / count << " ns/op" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,516 @@
+/**
+ * @file binlog.cc
+ * @brief 二进制日志实现
+ * @author shawn
+ * @date 2024-07-12
+ */
+#include "binlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iostream>
+
+namespace coro {
+
+const char BinLogAppender::kMagic[8] = {'C', 'O', 'R', 'B', 'L', 'O', 'G', '1'};
+
+/// 段文件格式版本
+static const uint32_t kSegmentVersion = 1;
+
+uint32_t BinLogRegistry::add(const BinLogSite& site, const std::string& types) {
+    std::unique_ptr<BinLogFormat> format(new BinLogFormat);
+    format->file = site.file;
+    format->line = site.line;
+    format->fmt = site.fmt;
+    format->types = types;
+    RWMutexType::WriteLock lock(m_mutex);
+    m_formats.push_back(std::move(format));
+    return m_formats.size();
+}
+
+uint32_t BinLogRegistry::addText(const char* file, int line) {
+    auto key = std::make_pair(file, line);
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_texts.find(key);
+        if (it != m_texts.end()) {
+            return it->second;
+        }
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    auto it = m_texts.find(key);
+    if (it != m_texts.end()) {
+        return it->second;
+    }
+    std::unique_ptr<BinLogFormat> format(new BinLogFormat);
+    format->file = file;
+    format->line = line;
+    format->fmt = "%s";
+    format->types = std::string(1, BinLog::STRING);
+    m_formats.push_back(std::move(format));
+    m_texts[key] = m_formats.size();
+    return m_formats.size();
+}
+
+const BinLogFormat* BinLogRegistry::get(uint32_t id) {
+    RWMutexType::ReadLock lock(m_mutex);
+    if (id == 0 || id > m_formats.size()) {
+        return nullptr;
+    }
+    return m_formats[id - 1].get();
+}
+
+uint64_t BinLog::GetTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+char* BinLog::GetLargeBuffer(size_t size) {
+    static thread_local std::vector<char> t_buffer;
+    if (t_buffer.size() < size) {
+        t_buffer.resize(size);
+    }
+    return t_buffer.data();
+}
+
+template <class T>
+static void AppendFormat(std::string& out, const std::string& spec, T v) {
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(buf)) {
+        out.append(buf, n);
+        return;
+    }
+    size_t old = out.size();
+    out.resize(old + n + 1);
+    snprintf(&out[old], n + 1, spec.c_str(), v);
+    out.resize(old + n);
+}
+
+bool BinLog::Format(const std::string& fmt, const std::string& types,
+                    const char* args, size_t len, std::string& out) {
+    const char* end = args + len;
+    size_t argi = 0;
+    bool ok = true;
+    for (size_t i = 0; i < fmt.size(); ++i) {
+        if (fmt[i] != '%') {
+            out.append(1, fmt[i]);
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            out.append(1, '%');
+            ++i;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion，*宽度不支持
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0", fmt[j])) {
+            ++j;
+        }
+        while (j < fmt.size() && isdigit(fmt[j])) {
+            ++j;
+        }
+        if (j < fmt.size() && fmt[j] == '.') {
+            ++j;
+            while (j < fmt.size() && isdigit(fmt[j])) {
+                ++j;
+            }
+        }
+        // 长度修饰符按记录的参数类型重新生成
+        std::string spec = fmt.substr(i, j - i);
+        while (j < fmt.size() && strchr("hlLqjzt", fmt[j])) {
+            ++j;
+        }
+        if (j >= fmt.size()) {
+            out.append(fmt, i, std::string::npos);
+            break;
+        }
+        char conv = fmt[j];
+        i = j;
+
+        if (argi >= types.size()) {
+            out.append("<<missing>>");
+            ok = false;
+            continue;
+        }
+        char type = types[argi++];
+        if (type == STRING) {
+            uint32_t n;
+            if (end - args < 4) {
+                return false;
+            }
+            memcpy(&n, args, 4);
+            if ((size_t)(end - args - 4) < n) {
+                return false;
+            }
+            if (spec.size() == 1) {
+                out.append(args + 4, n);
+            } else {
+                AppendFormat(out, spec + "s", std::string(args + 4, n).c_str());
+            }
+            args += 4 + n;
+            continue;
+        }
+
+        if (end - args < 8) {
+            return false;
+        }
+        uint64_t v;
+        memcpy(&v, args, 8);
+        args += 8;
+        if (type == DOUBLE) {
+            double d;
+            memcpy(&d, &v, 8);
+            AppendFormat(out, spec + (strchr("fFeEgGaA", conv) ? conv : 'g'),
+                         d);
+        } else if (type == POINTER && conv == 'p') {
+            AppendFormat(out, spec + 'p', (void*)(uintptr_t)v);
+        } else if (conv == 'c') {
+            AppendFormat(out, spec + 'c', (int)v);
+        } else if (strchr("diouxX", conv)) {
+            AppendFormat(out, spec + "ll" + conv, (long long)v);
+        } else if (type == INT) {
+            AppendFormat(out, spec + "lld", (long long)v);
+        } else {
+            AppendFormat(out, spec + "llu", (unsigned long long)v);
+        }
+    }
+    return ok;
+}
+
+BinLogAppender::BinLogAppender(const std::string& prefix, size_t segment_size)
+    : m_prefix(prefix) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    segment_size = std::max<size_t>(segment_size, 1024 * 1024);
+    m_segmentSize = (segment_size + page - 1) / page * page;
+}
+
+BinLogAppender::~BinLogAppender() {
+    LogFlusherMgr::GetInstance()->flush();
+    closeSegment();
+}
+
+void BinLogAppender::log(Logger* logger, LogLevel::Level level,
+                         const LogEvent& event) {
+    if (level < m_level) {
+        return;
+    }
+    static thread_local std::string t_record;
+    uint32_t len = std::min<size_t>(event.getContentSize(),
+                                    BinLog::kMaxStringSize);
+    BinLog::Record record;
+    record.size = sizeof(record) + 4 + len;
+    record.id =
+        BinLogRegistryMgr::GetInstance()->addText(event.getFile(), event.getLine());
+    record.time = event.getTime() * 1000000000ull;
+    record.fiberId = event.getFiberId();
+    record.threadId = event.getThreadId();
+    record.level = level;
+    t_record.resize(record.size);
+    char* p = &t_record[0];
+    memcpy(p, &record, sizeof(record));
+    memcpy(p + sizeof(record), &len, 4);
+    memcpy(p + sizeof(record) + 4, event.getContent(), len);
+    LogFlusherMgr::GetInstance()->append(this, p, record.size,
+                                         level >= LogLevel::ERROR);
+}
+
+void BinLogAppender::logBinary(Logger* logger, LogLevel::Level level,
+                               const char* data, size_t len) {
+    if (level < m_level) {
+        return;
+    }
+    LogFlusherMgr::GetInstance()->append(this, data, len,
+                                         level >= LogLevel::ERROR);
+}
+
+void BinLogAppender::write(const iovec* iov, int iovcnt) {
+    for (int i = 0; i < iovcnt; ++i) {
+        const char* data = (const char*)iov[i].iov_base;
+        if (iov[i].iov_len < sizeof(BinLog::Record)) {
+            ++m_dropped;
+            continue;
+        }
+        BinLog::Record record;
+        memcpy(&record, data, sizeof(record));
+        if (!append(data, iov[i].iov_len, record.id)) {
+            ++m_dropped;
+        }
+    }
+}
+
+std::vector<std::string> BinLogAppender::getSegments() {
+    Mutex::Lock lock(m_segMutex);
+    return m_segments;
+}
+
+bool BinLogAppender::openSegment() {
+    int fd = -1;
+    std::string path;
+    while (true) {
+        path = m_prefix + "." + std::to_string(m_seq++);
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            break;
+        }
+        if (errno != EEXIST) {
+            std::cerr << "open binlog segment " << path
+                      << " error: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    if (ftruncate(fd, m_segmentSize) != 0) {
+        std::cerr << "ftruncate binlog segment " << path
+                  << " error: " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    void* base = mmap(nullptr, m_segmentSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "mmap binlog segment " << path
+                  << " error: " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    m_fd = fd;
+    m_base = (char*)base;
+    SegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kSegmentVersion;
+    header.headerSize = sizeof(header);
+    header.createTime = BinLog::GetTimeNs();
+    header.pid = getpid();
+    memcpy(m_base, &header, sizeof(header));
+    m_used = sizeof(header);
+    m_defined.clear();
+
+    Mutex::Lock lock(m_segMutex);
+    m_segments.push_back(path);
+    return true;
+}
+
+void BinLogAppender::closeSegment() {
+    if (!m_base) {
+        return;
+    }
+    munmap(m_base, m_segmentSize);
+    m_base = nullptr;
+    // 截掉未使用的部分，解码时读到文件尾就结束
+    if (ftruncate(m_fd, m_used) != 0) {
+        std::cerr << "ftruncate binlog segment error: " << strerror(errno)
+                  << std::endl;
+    }
+    close(m_fd);
+    m_fd = -1;
+    m_used = 0;
+}
+
+bool BinLogAppender::append(const char* data, size_t len, uint32_t id) {
+    for (int i = 0; i < 2; ++i) {
+        if (!m_base && !openSegment()) {
+            return false;
+        }
+        size_t need = len;
+        const BinLogFormat* format = nullptr;
+        if (id >= m_defined.size() || !m_defined[id]) {
+            format = BinLogRegistryMgr::GetInstance()->get(id);
+            if (!format) {
+                return false;
+            }
+            need += sizeof(Define) + format->file.size() + format->fmt.size() +
+                    format->types.size();
+        }
+        if (m_used + need > m_segmentSize) {
+            if (m_used == sizeof(SegmentHeader)) {
+                // 空段也放不下
+                return false;
+            }
+            closeSegment();
+            continue;
+        }
+
+        if (format) {
+            Define def;
+            def.size = need - len;
+            def.zero = 0;
+            def.id = id;
+            def.line = format->line;
+            def.fileLen = format->file.size();
+            def.fmtLen = format->fmt.size();
+            def.typesLen = format->types.size();
+            def.reserved = 0;
+            char* p = m_base + m_used;
+            memcpy(p, &def, sizeof(def));
+            p += sizeof(def);
+            memcpy(p, format->file.c_str(), def.fileLen);
+            p += def.fileLen;
+            memcpy(p, format->fmt.c_str(), def.fmtLen);
+            p += def.fmtLen;
+            memcpy(p, format->types.c_str(), def.typesLen);
+            m_used += def.size;
+            if (id >= m_defined.size()) {
+                m_defined.resize(id + 1);
+            }
+            m_defined[id] = true;
+        }
+        memcpy(m_base + m_used, data, len);
+        m_used += len;
+        return true;
+    }
+    return false;
+}
+
+BinLogReader::~BinLogReader() { close(); }
+
+void BinLogReader::close() {
+    if (m_base) {
+        munmap((void*)m_base, m_size);
+        m_base = nullptr;
+    }
+    m_size = 0;
+    m_pos = 0;
+    m_corrupted = false;
+    m_formats.clear();
+}
+
+bool BinLogReader::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "open " << path << " error: " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (size_t)st.st_size < sizeof(BinLogAppender::SegmentHeader)) {
+        std::cerr << path << ": not a binlog segment" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "mmap " << path << " error: " << strerror(errno)
+                  << std::endl;
+        return false;
+    }
+    m_base = (const char*)base;
+    m_size = st.st_size;
+
+    BinLogAppender::SegmentHeader header;
+    memcpy(&header, m_base, sizeof(header));
+    if (memcmp(header.magic, BinLogAppender::kMagic, sizeof(header.magic)) ||
+        header.version != kSegmentVersion || header.headerSize > m_size) {
+        std::cerr << path << ": bad binlog segment header" << std::endl;
+        close();
+        return false;
+    }
+    m_pos = header.headerSize;
+    return true;
+}
+
+bool BinLogReader::next(Entry& entry) {
+    while (m_base && m_pos + 8 <= m_size) {
+        uint32_t size;
+        uint32_t id;
+        memcpy(&size, m_base + m_pos, 4);
+        memcpy(&id, m_base + m_pos + 4, 4);
+        if (size == 0) {
+            // 进程异常退出时段尾没有截断
+            return false;
+        }
+        if (size > m_size - m_pos) {
+            m_corrupted = true;
+            return false;
+        }
+        const char* p = m_base + m_pos;
+        m_pos += size;
+
+        if (id == 0) {
+            BinLogAppender::Define def;
+            if (size < sizeof(def)) {
+                m_corrupted = true;
+                return false;
+            }
+            memcpy(&def, p, sizeof(def));
+            if ((uint64_t)sizeof(def) + def.fileLen + def.fmtLen + def.typesLen !=
+                size) {
+                m_corrupted = true;
+                return false;
+            }
+            BinLogFormat& format = m_formats[def.id];
+            p += sizeof(def);
+            format.file.assign(p, def.fileLen);
+            p += def.fileLen;
+            format.fmt.assign(p, def.fmtLen);
+            p += def.fmtLen;
+            format.types.assign(p, def.typesLen);
+            format.line = def.line;
+            continue;
+        }
+
+        BinLog::Record record;
+        auto it = m_formats.find(id);
+        if (size < sizeof(record) || it == m_formats.end()) {
+            m_corrupted = true;
+            return false;
+        }
+        memcpy(&record, p, sizeof(record));
+        entry.format = &it->second;
+        entry.time = record.time;
+        entry.fiberId = record.fiberId;
+        entry.threadId = record.threadId;
+        entry.level = (LogLevel::Level)record.level;
+        entry.message.clear();
+        if (!BinLog::Format(it->second.fmt, it->second.types, p + sizeof(record),
+                            size - sizeof(record), entry.message)) {
+            m_corrupted = true;
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+void BinLogReader::ToString(const Entry& entry, std::string& out) {
+    time_t sec = entry.time / 1000000000ull;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    n += snprintf(buf + n, sizeof(buf) - n, ".%06u",
+                  (unsigned)(entry.time % 1000000000ull / 1000));
+    out.append(buf, n);
+    out.append(1, '\t');
+    out.append(std::to_string(entry.threadId));
+    out.append(1, '\t');
+    out.append(std::to_string(entry.fiberId));
+    out.append("\t[");
+    out.append(LogLevel::ToString(entry.level));
+    out.append("]\t");
+    out.append(entry.format->file);
+    out.append(1, ':');
+    out.append(std::to_string(entry.format->line));
+    out.append(1, '\t');
+    out.append(entry.message);
+    out.append(1, '\n');
+}
+
+}  // namespace coro
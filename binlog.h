@@ -0,0 +1,460 @@
+/**
+ * @file binlog.h
+ * @brief 二进制日志
+ * @author shawn
+ * @date 2024-07-12
+ * @details 每个调用点的格式串、文件名、行号和参数类型在第一次执行时注册成一个id，
+ *          之后记录日志只写入 记录头 + id + 参数的原始字节，调用线程上不做任何文本格式化。
+ *          记录和文本日志走同一条LogFlusher队列，BinLogAppender把它们写到mmap的段文件里，
+ *          每个段在第一次用到某个id时先写入它的定义，所以单个段文件可以独立解码，
+ *          离线工具log_decoder把段文件还原成文本。
+ *          写到普通Appender的二进制日志会在调用线程解码成文本输出，行为和文本日志一致
+ */
+#ifndef __CORO_BINLOG_H__
+#define __CORO_BINLOG_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "log.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "singleton.h"
+
+/**
+ * @brief 记录一条二进制日志，fmt必须是字符串常量，参数支持整数、浮点、指针和字符串
+ */
+#define CORO_BINLOG_LEVEL(logger, level, fmt, ...)                            \
+    do {                                                                      \
+        if (logger->getLevel() <= level) {                                    \
+            coro::BinLog::Log(                                                \
+                logger.get(), level,                                          \
+                []() { return coro::BinLogSite{__FILE__, __LINE__, fmt}; },   \
+                ##__VA_ARGS__);                                               \
+        }                                                                     \
+    } while (0)
+
+#define CORO_BINLOG_DEBUG(logger, fmt, ...) \
+    CORO_BINLOG_LEVEL(logger, coro::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+
+#define CORO_BINLOG_INFO(logger, fmt, ...) \
+    CORO_BINLOG_LEVEL(logger, coro::LogLevel::INFO, fmt, ##__VA_ARGS__)
+
+#define CORO_BINLOG_WARN(logger, fmt, ...) \
+    CORO_BINLOG_LEVEL(logger, coro::LogLevel::WARN, fmt, ##__VA_ARGS__)
+
+#define CORO_BINLOG_ERROR(logger, fmt, ...) \
+    CORO_BINLOG_LEVEL(logger, coro::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+
+#define CORO_BINLOG_FATAL(logger, fmt, ...) \
+    CORO_BINLOG_LEVEL(logger, coro::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+namespace coro {
+
+/**
+ * @brief 调用点的静态信息
+ */
+struct BinLogSite {
+    const char* file;
+    int line;
+    const char* fmt;
+};
+
+/**
+ * @brief 注册过的日志格式
+ */
+struct BinLogFormat {
+    /// 文件名
+    std::string file;
+    /// 行号
+    int line = 0;
+    /// printf风格的格式串
+    std::string fmt;
+    /// 参数类型，每个参数一个字符，见BinLog::ArgType
+    std::string types;
+};
+
+/**
+ * @brief 日志格式注册表，id从1开始连续分配，注册之后不会删除
+ */
+class BinLogRegistry : Noncopyable {
+   public:
+    typedef RWMutex RWMutexType;
+
+    /**
+     * @brief 注册一个调用点
+     * @return 格式id
+     */
+    uint32_t add(const BinLogSite& site, const std::string& types);
+
+    /**
+     * @brief 注册文本日志的调用点，同一个位置只注册一次
+     * @details 文本日志写到BinLogAppender时按"%s"格式记录
+     */
+    uint32_t addText(const char* file, int line);
+
+    /**
+     * @brief 按id查找格式，返回的指针一直有效
+     */
+    const BinLogFormat* get(uint32_t id);
+
+   private:
+    /// 锁
+    RWMutexType m_mutex;
+    /// 下标是id - 1
+    std::vector<std::unique_ptr<BinLogFormat>> m_formats;
+    /// 文本日志调用点 (file, line) -> id，file是__FILE__常量
+    std::map<std::pair<const char*, int>, uint32_t> m_texts;
+};
+
+typedef Singleton<BinLogRegistry> BinLogRegistryMgr;
+
+/**
+ * @brief 二进制日志的编码和解码
+ */
+class BinLog {
+   public:
+    /**
+     * @brief 参数类型
+     */
+    enum ArgType : char {
+        /// 有符号整数，8字节
+        INT = 'i',
+        /// 无符号整数，8字节
+        UINT = 'u',
+        /// 浮点数，8字节double
+        DOUBLE = 'f',
+        /// 指针，8字节
+        POINTER = 'p',
+        /// 字符串，4字节长度 + 内容
+        STRING = 's',
+    };
+
+    /**
+     * @brief 记录头，后面紧跟参数
+     * @details id为0的记录是段文件里的格式定义，见BinLogAppender
+     */
+    struct Record {
+        /// 整条记录的字节数，包括记录头
+        uint32_t size;
+        /// 格式id
+        uint32_t id;
+        /// 时间戳(纳秒)
+        uint64_t time;
+        /// 协程id
+        uint64_t fiberId;
+        /// 线程id
+        uint32_t threadId;
+        /// 日志级别
+        uint32_t level;
+    };
+
+    /// 单个字符串参数的最大长度，超出部分被截断
+    static const uint32_t kMaxStringSize = 64 * 1024;
+
+    /**
+     * @brief 编码一条日志并交给logger
+     * @details 每个调用点的Site是不同的lambda类型，函数内的静态变量就是这个调用点的id
+     */
+    template <class Site, class... Args>
+    static void Log(Logger* logger, LogLevel::Level level, Site site,
+                    const Args&... args) {
+        static const uint32_t s_id =
+            BinLogRegistryMgr::GetInstance()->add(site(), Signature<Args...>());
+        size_t size = sizeof(Record) + (0 + ... + ArgSize(args));
+        char stack[256];
+        char* buf = size <= sizeof(stack) ? stack : GetLargeBuffer(size);
+        Record record;
+        record.size = size;
+        record.id = s_id;
+        record.time = GetTimeNs();
+        record.fiberId = GetFiberId();
+        record.threadId = GetThreadId();
+        record.level = level;
+        memcpy(buf, &record, sizeof(record));
+        char* p = buf + sizeof(record);
+        ((p = Encode(p, args)), ...);
+        logger->logBinary(level, buf, size);
+    }
+
+    /**
+     * @brief 按格式串和参数类型把参数格式化成文本
+     * @details 每个转换说明按实际记录的参数类型输出，类型不匹配时不会读错内存
+     * @return 参数完整时返回true
+     */
+    static bool Format(const std::string& fmt, const std::string& types,
+                       const char* args, size_t len, std::string& out);
+
+    /**
+     * @brief 当前时间(纳秒)
+     */
+    static uint64_t GetTimeNs();
+
+   private:
+    template <class T>
+    static constexpr char TypeOf() {
+        typedef typename std::decay<T>::type U;
+        if constexpr (std::is_same<U, std::string>::value ||
+                      std::is_same<U, std::string_view>::value ||
+                      std::is_same<U, const char*>::value ||
+                      std::is_same<U, char*>::value) {
+            return STRING;
+        } else if constexpr (std::is_floating_point<U>::value) {
+            return DOUBLE;
+        } else if constexpr (std::is_pointer<U>::value) {
+            return POINTER;
+        } else if constexpr (std::is_enum<U>::value) {
+            return std::is_signed<typename std::underlying_type<U>::type>::value
+                       ? INT
+                       : UINT;
+        } else {
+            static_assert(std::is_integral<U>::value,
+                          "unsupported binlog argument type");
+            return std::is_signed<U>::value ? INT : UINT;
+        }
+    }
+
+    template <class... Args>
+    static std::string Signature() {
+        return std::string{TypeOf<Args>()...};
+    }
+
+    static uint32_t StringSize(const char* v) {
+        return v ? std::min<size_t>(strlen(v), kMaxStringSize) : 0;
+    }
+    static uint32_t StringSize(std::string_view v) {
+        return std::min<size_t>(v.size(), kMaxStringSize);
+    }
+
+    template <class T>
+    static size_t ArgSize(const T& v) {
+        typedef typename std::decay<T>::type U;
+        if constexpr (TypeOf<T>() != STRING) {
+            return 8;
+        } else if constexpr (std::is_same<U, std::string>::value ||
+                             std::is_same<U, std::string_view>::value) {
+            return 4 + StringSize(std::string_view(v));
+        } else {
+            return 4 + StringSize((const char*)v);
+        }
+    }
+
+    template <class T>
+    static char* Encode(char* p, const T& v) {
+        typedef typename std::decay<T>::type U;
+        if constexpr (TypeOf<T>() == STRING) {
+            const char* str;
+            uint32_t len;
+            if constexpr (std::is_same<U, std::string>::value ||
+                          std::is_same<U, std::string_view>::value) {
+                str = v.data();
+                len = StringSize(std::string_view(v));
+            } else {
+                str = v;
+                len = StringSize(str);
+            }
+            memcpy(p, &len, 4);
+            if (len) {
+                memcpy(p + 4, str, len);
+            }
+            return p + 4 + len;
+        } else {
+            if constexpr (TypeOf<T>() == DOUBLE) {
+                double d = v;
+                memcpy(p, &d, 8);
+            } else if constexpr (TypeOf<T>() == POINTER) {
+                uint64_t u = (uintptr_t)v;
+                memcpy(p, &u, 8);
+            } else if constexpr (TypeOf<T>() == INT) {
+                int64_t i = (int64_t)v;
+                memcpy(p, &i, 8);
+            } else {
+                uint64_t u = (uint64_t)v;
+                memcpy(p, &u, 8);
+            }
+            return p + 8;
+        }
+    }
+
+    /**
+     * @brief 超过栈上缓冲区大小的记录使用线程私有的缓冲区
+     */
+    static char* GetLargeBuffer(size_t size);
+};
+
+/**
+ * @brief 把二进制日志写入mmap段文件的Appender
+ * @details 段文件命名为 prefix.序号，序号从0开始找第一个不存在的文件。
+ *          文件布局：SegmentHeader，之后是连续的记录，格式定义是id为0的记录，
+ *          size为0表示段结束(进程异常退出时段尾是未写入的零)。
+ *          段写满后截断到实际长度并打开下一个段，只在LogFlusher线程写，不需要加锁
+ */
+class BinLogAppender : public LogAppender {
+   public:
+    typedef std::shared_ptr<BinLogAppender> ptr;
+
+    /**
+     * @brief 段文件头
+     */
+    struct SegmentHeader {
+        /// "CORBLOG1"
+        char magic[8];
+        /// 文件格式版本
+        uint32_t version;
+        /// 段文件头长度
+        uint32_t headerSize;
+        /// 创建时间(纳秒)
+        uint64_t createTime;
+        /// 写入进程id
+        uint32_t pid;
+        /// 保留
+        uint32_t reserved;
+    };
+
+    /**
+     * @brief 格式定义，Record的id为0，后面依次是文件名、格式串和参数类型
+     */
+    struct Define {
+        /// 整条定义的字节数
+        uint32_t size;
+        /// 固定为0
+        uint32_t zero;
+        /// 定义的格式id
+        uint32_t id;
+        /// 行号
+        int32_t line;
+        uint32_t fileLen;
+        uint32_t fmtLen;
+        uint32_t typesLen;
+        uint32_t reserved;
+    };
+
+    static const char kMagic[8];
+
+    /**
+     * @brief 构造函数
+     * @param[in] prefix 段文件路径前缀
+     * @param[in] segment_size 段文件大小，按页对齐，至少1M
+     */
+    BinLogAppender(const std::string& prefix,
+                   size_t segment_size = 64 * 1024 * 1024);
+
+    ~BinLogAppender();
+
+    /**
+     * @brief 文本日志按"%s"格式编码成二进制记录
+     */
+    void log(Logger* logger, LogLevel::Level level,
+             const LogEvent& event) override;
+
+    void logBinary(Logger* logger, LogLevel::Level level, const char* data,
+                   size_t len) override;
+
+    void write(const iovec* iov, int iovcnt) override;
+
+    /**
+     * @brief 已经写过的段文件路径，包括正在写的段
+     */
+    std::vector<std::string> getSegments();
+
+    /**
+     * @brief 因为超过段大小被丢弃的记录数
+     */
+    uint64_t getDropped() const { return m_dropped; }
+
+   private:
+    bool openSegment();
+    void closeSegment();
+
+    /**
+     * @brief 把一条记录追加到当前段，段内第一次出现的id先写定义，放不下时换新段
+     */
+    bool append(const char* data, size_t len, uint32_t id);
+
+   private:
+    /// 路径前缀
+    std::string m_prefix;
+    /// 段大小
+    size_t m_segmentSize;
+    /// 下一个段的序号
+    uint32_t m_seq = 0;
+    /// 当前段
+    int m_fd = -1;
+    char* m_base = nullptr;
+    size_t m_used = 0;
+    /// 当前段已经写过定义的id
+    std::vector<bool> m_defined;
+    /// 丢弃的记录数
+    std::atomic<uint64_t> m_dropped{0};
+    /// 保护m_segments
+    Mutex m_segMutex;
+    /// 写过的段文件
+    std::vector<std::string> m_segments;
+};
+
+/**
+ * @brief 段文件读取，log_decoder和测试使用
+ */
+class BinLogReader : Noncopyable {
+   public:
+    /**
+     * @brief 解码后的一条日志
+     */
+    struct Entry {
+        const BinLogFormat* format = nullptr;
+        uint64_t time = 0;
+        uint64_t fiberId = 0;
+        uint32_t threadId = 0;
+        LogLevel::Level level = LogLevel::UNKNOW;
+        std::string message;
+    };
+
+    ~BinLogReader();
+
+    /**
+     * @brief 打开段文件
+     * @return 文件头正确时返回true
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief 读取下一条日志，格式定义在内部处理
+     * @return 段结束或者数据损坏时返回false
+     */
+    bool next(Entry& entry);
+
+    /**
+     * @brief 数据是否损坏
+     */
+    bool isCorrupted() const { return m_corrupted; }
+
+    /**
+     * @brief 按默认的文本格式输出一条日志
+     */
+    static void ToString(const Entry& entry, std::string& out);
+
+   private:
+    void close();
+
+   private:
+    /// 映射的文件
+    const char* m_base = nullptr;
+    size_t m_size = 0;
+    size_t m_pos = 0;
+    bool m_corrupted = false;
+    /// 段内的格式定义，id属于写入进程
+    std::unordered_map<uint32_t, BinLogFormat> m_formats;
+};
+
+}  // namespace coro
+
+#endif
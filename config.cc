@@ -0,0 +1,450 @@
+/**
+ * @file config.cc
+ * @brief 配置模块实现
+ * @author shawn
+ * @date 2024-07-22
+ */
+#include "config.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "iomanager.h"
+#include "log.h"
+
+namespace coro {
+
+static Logger::ptr g_logger = CORO_LOG_NAME("system");
+
+ConfigVarBase::ptr Config::LookupBase(const std::string &name) {
+    Shard &shard = GetShard(name);
+    RWMutexType::ReadLock lock(shard.mutex);
+    auto it = shard.datas.find(name);
+    return it == shard.datas.end() ? nullptr : it->second;
+}
+
+void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb) {
+    Shard *shards = GetShards();
+    for (size_t i = 0; i < kShardCount; ++i) {
+        // 先复制再回调，回调里可以再查找或创建配置参数
+        std::vector<ConfigVarBase::ptr> vars;
+        {
+            RWMutexType::ReadLock lock(shards[i].mutex);
+            for (auto &j : shards[i].datas) {
+                vars.push_back(j.second);
+            }
+        }
+        for (auto &j : vars) {
+            cb(j);
+        }
+    }
+}
+
+/**
+ * @brief 展开后的一个配置节点
+ */
+struct ConfigEntry {
+    /// 小写的完整key，比如 "logs.file.path"
+    std::string key;
+    /// 节点
+    YAML::Node node;
+    /// 节点内容的哈希，用于判断是否变化
+    uint64_t hash;
+};
+
+static void HashCombine(uint64_t &seed, uint64_t v) {
+    seed ^= v + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+/**
+ * @brief 展开node，输出每一级key对应的节点，同时自底向上计算每个节点的哈希
+ * @param[out] output 为nullptr时只计算哈希
+ * @return node的哈希
+ */
+static uint64_t ListAllMember(const std::string &prefix, const YAML::Node &node,
+                              std::vector<ConfigEntry> *output) {
+    if (output &&
+        prefix.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._012345678") !=
+            std::string::npos) {
+        CORO_LOG_ERROR(g_logger) << "Config invalid name: " << prefix << " : "
+                                 << node;
+        output = nullptr;
+    }
+
+    size_t index = 0;
+    if (output) {
+        index = output->size();
+        output->push_back(ConfigEntry{prefix, node, 0});
+    }
+
+    uint64_t hash = node.Type();
+    if (node.IsScalar()) {
+        HashCombine(hash, std::hash<std::string>()(node.Scalar()));
+    } else if (node.IsSequence()) {
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            HashCombine(hash, ListAllMember(prefix, *it, nullptr));
+        }
+    } else if (node.IsMap()) {
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            std::string key = it->first.Scalar();
+            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+            HashCombine(hash, std::hash<std::string>()(key));
+            HashCombine(hash,
+                        ListAllMember(prefix.empty() ? key : prefix + "." + key,
+                                      it->second, output));
+        }
+    }
+
+    if (output) {
+        (*output)[index].hash = hash;
+    }
+    return hash;
+}
+
+void Config::LoadFromYaml(const YAML::Node &root) {
+    std::vector<ConfigEntry> all_nodes;
+    ListAllMember("", root, &all_nodes);
+
+    for (auto &i : all_nodes) {
+        if (i.key.empty()) {
+            continue;
+        }
+        ConfigVarBase::ptr var = LookupBase(i.key);
+        if (var) {
+            var->fromNode(i.node);
+        }
+    }
+}
+
+/**
+ * @brief 配置文件上次加载的状态
+ */
+struct ConfFileState {
+    /// 修改时间(纳秒)
+    uint64_t mtime = 0;
+    /// 文件大小
+    uint64_t size = 0;
+    /// key -> (节点哈希, 加载时是否已经有对应的配置参数)
+    std::unordered_map<std::string, std::pair<uint64_t, bool>> keys;
+};
+
+/**
+ * @brief 待应用的配置变更
+ */
+struct ConfigUpdate {
+    ConfigVarBase::ptr var;
+    YAML::Node node;
+};
+
+/// 保护s_files，同一时间只有一次加载
+static Mutex s_fileMutex;
+/// 文件路径 -> 加载状态
+static std::map<std::string, ConfFileState> s_files;
+
+/**
+ * @brief 增量加载一个配置文件，需要更新的参数追加到updates
+ * @details 文件没有变化时直接返回。只更新节点哈希变化了的配置参数，
+ *          上次加载时还没注册的参数这次也会更新。
+ *          参数的监听器可能挂起协程，所以不在持有s_fileMutex时调用fromNode
+ */
+static void LoadConfFile(const std::string &path, bool force,
+                         std::vector<ConfigUpdate> &updates) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return;
+    }
+    uint64_t mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+
+    Mutex::Lock lock(s_fileMutex);
+    ConfFileState &old = s_files[path];
+    if (!force && old.mtime == mtime && old.size == (uint64_t)st.st_size) {
+        return;
+    }
+
+    YAML::Node root;
+    try {
+        root = YAML::LoadFile(path);
+    } catch (std::exception &e) {
+        CORO_LOG_ERROR(g_logger) << "LoadConfFile file=" << path
+                                 << " failed: " << e.what();
+        return;
+    }
+
+    std::vector<ConfigEntry> all_nodes;
+    ListAllMember("", root, &all_nodes);
+    ConfFileState state;
+    state.mtime = mtime;
+    state.size = st.st_size;
+    size_t changed = 0;
+    for (auto &i : all_nodes) {
+        if (i.key.empty()) {
+            continue;
+        }
+        ConfigVarBase::ptr var = Config::LookupBase(i.key);
+        state.keys[i.key] = std::make_pair(i.hash, var != nullptr);
+        if (!var) {
+            continue;
+        }
+        auto it = old.keys.find(i.key);
+        if (!force && it != old.keys.end() && it->second.first == i.hash &&
+            it->second.second) {
+            continue;
+        }
+        updates.push_back(ConfigUpdate{var, i.node});
+        ++changed;
+    }
+    old.mtime = state.mtime;
+    old.size = state.size;
+    old.keys.swap(state.keys);
+    CORO_LOG_INFO(g_logger) << "LoadConfFile file=" << path
+                            << " ok, updated " << changed << " vars";
+}
+
+/**
+ * @brief 递归列出path下所有以subfix结尾的文件
+ */
+static void ListAllFile(std::vector<std::string> &files, const std::string &path,
+                        const std::string &subfix) {
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+    struct dirent *dp = nullptr;
+    while ((dp = readdir(dir)) != nullptr) {
+        if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) {
+            continue;
+        }
+        std::string file = path + "/" + dp->d_name;
+        if (dp->d_type == DT_DIR) {
+            ListAllFile(files, file, subfix);
+        } else if (dp->d_type == DT_REG || dp->d_type == DT_LNK ||
+                   dp->d_type == DT_UNKNOWN) {
+            std::string name = dp->d_name;
+            if (name.size() >= subfix.size() &&
+                name.compare(name.size() - subfix.size(), subfix.size(),
+                             subfix) == 0) {
+                files.push_back(file);
+            }
+        }
+    }
+    closedir(dir);
+}
+
+static void CollectConfDir(const std::string &path, bool force,
+                           std::vector<ConfigUpdate> &updates) {
+    std::vector<std::string> files;
+    ListAllFile(files, path, ".yml");
+    for (auto &i : files) {
+        LoadConfFile(i, force, updates);
+    }
+}
+
+static void ApplyUpdates(std::vector<ConfigUpdate> &updates) {
+    for (auto &i : updates) {
+        i.var->fromNode(i.node);
+    }
+}
+
+void Config::LoadFromConfDir(const std::string &path, bool force) {
+    std::vector<ConfigUpdate> updates;
+    CollectConfDir(path, force, updates);
+    ApplyUpdates(updates);
+}
+
+/**
+ * @brief 配置文件夹监听
+ * @details inotify不递归，每个子文件夹单独监听，新建的子文件夹在事件里补上。
+ *          inotify fd注册为IOManager的读事件，回调在协程里执行，处理完再重新注册
+ */
+class ConfDirWatcher {
+   public:
+    bool start(const std::string &path, IOManager *iom);
+    void stop();
+
+   private:
+    void addWatch(const std::string &dir);
+    void onEvent();
+
+    /**
+     * @brief 读出所有inotify事件，需要更新的参数追加到updates，需要持有m_mutex
+     */
+    void collectEvents(std::vector<ConfigUpdate> &updates);
+
+   private:
+    /// 保护下面的成员，停止监听和事件回调互斥
+    Mutex m_mutex;
+    int m_fd = -1;
+    IOManager *m_iom = nullptr;
+    std::string m_path;
+    /// 监听描述符 -> 文件夹
+    std::unordered_map<int, std::string> m_dirs;
+};
+
+static ConfDirWatcher s_watcher;
+
+bool ConfDirWatcher::start(const std::string &path, IOManager *iom) {
+    Mutex::Lock lock(m_mutex);
+    if (m_fd >= 0) {
+        CORO_LOG_ERROR(g_logger) << "WatchConfDir already watching " << m_path;
+        return false;
+    }
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        CORO_LOG_ERROR(g_logger) << "inotify_init1 error: " << strerror(errno);
+        return false;
+    }
+    m_fd = fd;
+    m_iom = iom;
+    m_path = path;
+    addWatch(path);
+    if (m_dirs.empty() ||
+        m_iom->addEvent(m_fd, IOManager::READ, [this]() { onEvent(); }) != 0) {
+        close(m_fd);
+        m_fd = -1;
+        m_dirs.clear();
+        return false;
+    }
+    return true;
+}
+
+void ConfDirWatcher::stop() {
+    Mutex::Lock lock(m_mutex);
+    if (m_fd < 0) {
+        return;
+    }
+    m_iom->delEvent(m_fd, IOManager::READ);
+    close(m_fd);
+    m_fd = -1;
+    m_dirs.clear();
+}
+
+void ConfDirWatcher::addWatch(const std::string &dir) {
+    int wd = inotify_add_watch(m_fd, dir.c_str(),
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                   IN_CREATE | IN_DELETE | IN_ONLYDIR);
+    if (wd < 0) {
+        CORO_LOG_ERROR(g_logger) << "inotify_add_watch " << dir
+                                 << " error: " << strerror(errno);
+        return;
+    }
+    m_dirs[wd] = dir;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    struct dirent *dp = nullptr;
+    while ((dp = readdir(d)) != nullptr) {
+        if (dp->d_type == DT_DIR && strcmp(dp->d_name, ".") &&
+            strcmp(dp->d_name, "..")) {
+            addWatch(dir + "/" + dp->d_name);
+        }
+    }
+    closedir(d);
+}
+
+void ConfDirWatcher::onEvent() {
+    std::vector<ConfigUpdate> updates;
+    int fd = -1;
+    {
+        Mutex::Lock lock(m_mutex);
+        if (m_fd < 0) {
+            return;
+        }
+        fd = m_fd;
+        collectEvents(updates);
+    }
+    // 监听器在这个协程里执行，可能挂起，不能持有线程锁
+    ApplyUpdates(updates);
+
+    Mutex::Lock lock(m_mutex);
+    // 应用期间停止了监听，或者又重新开始了监听并注册了新的事件
+    if (m_fd >= 0 && m_fd == fd) {
+        m_iom->addEvent(m_fd, IOManager::READ, [this]() { onEvent(); });
+    }
+}
+
+void ConfDirWatcher::collectEvents(std::vector<ConfigUpdate> &updates) {
+    // 一次读完所有事件，同一个文件的多次变化只加载一次
+    std::set<std::string> changed;
+    std::vector<std::string> new_dirs;
+    bool overflow = false;
+    alignas(struct inotify_event) char buf[4096];
+    while (true) {
+        ssize_t n = read(m_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (char *p = buf; p < buf + n;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                m_dirs.erase(ev->wd);
+                continue;
+            }
+            auto it = m_dirs.find(ev->wd);
+            if (it == m_dirs.end() || !ev->len) {
+                continue;
+            }
+            std::string file = it->second + "/" + ev->name;
+            if (ev->mask & IN_ISDIR) {
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    new_dirs.push_back(file);
+                }
+                continue;
+            }
+            size_t len = strlen(ev->name);
+            if (len < 4 || strcmp(ev->name + len - 4, ".yml")) {
+                continue;
+            }
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                // 删掉的文件不再跟踪，已经加载的值保留
+                Mutex::Lock lock2(s_fileMutex);
+                s_files.erase(file);
+                changed.erase(file);
+            } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                changed.insert(file);
+            }
+        }
+    }
+
+    if (overflow) {
+        // 事件丢失，全量检查一遍，没变化的文件和参数仍然会被跳过
+        CollectConfDir(m_path, false, updates);
+    } else {
+        for (auto &i : new_dirs) {
+            addWatch(i);
+            CollectConfDir(i, false, updates);
+        }
+        for (auto &i : changed) {
+            LoadConfFile(i, false, updates);
+        }
+    }
+}
+
+bool Config::WatchConfDir(const std::string &path, IOManager *iom) {
+    if (!iom) {
+        iom = IOManager::GetThis();
+    }
+    if (!iom) {
+        CORO_LOG_ERROR(g_logger) << "WatchConfDir needs an IOManager";
+        return false;
+    }
+    return s_watcher.start(path, iom);
+}
+
+void Config::UnwatchConfDir() { s_watcher.stop(); }
+
+}  // namespace coro
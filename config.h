@@ -10,22 +10,30 @@
 #include <yaml-cpp/yaml.h>
 
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <list>
 #include <map>
 #include <memory>
 #include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include "mutex.h"
+#include "noncopyable.h"
+#include "snapshot.h"
 #include "util.h"
 
 namespace coro {
 
+class IOManager;
+
 /**
  * @brief 配置变量的基类
  */
@@ -67,6 +75,11 @@ class ConfigVarBase {
      */
     virtual bool fromString(const std::string &val) = 0;
 
+    /**
+     * @brief 从YAML节点初始化值，加载配置文件时使用，不经过字符串
+     */
+    virtual bool fromNode(const YAML::Node &node) = 0;
+
     /**
      * @brief 返回配置参数值的类型名称
      */
@@ -95,24 +108,85 @@ class LexicalCast {
 };
 
 /**
- * @brief 类型转换模板类片特化(YAML String 转换成 std::vector<T>)
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 T)
+ * @details 容器类型有各自的特化，逐个元素直接从YAML::Node转换，
+ *          不再把每个元素序列化成字符串再用YAML::Load重新解析。
+ *          标量直接取Scalar()，其他节点(自定义类型)退回到YAML String的转换
  */
 template <class T>
-class LexicalCast<std::string, std::vector<T>> {
+class LexicalCast<YAML::Node, T> {
    public:
-    std::vector<T> operator()(const std::string &v) {
-        YAML::Node node = YAML::Load(v);
-        typename std::vector<T> vec;
+    T operator()(const YAML::Node &node) {
+        if (node.IsScalar()) {
+            return LexicalCast<std::string, T>()(node.Scalar());
+        }
         std::stringstream ss;
-        for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.push_back(LexicalCast<std::string, T>()(ss.str()));
+        ss << node;
+        return LexicalCast<std::string, T>()(ss.str());
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(T 转换成 YAML::Node)
+ * @details 数值和字符串直接生成标量节点，其他类型解析ToStr的结果
+ */
+template <class T>
+class LexicalCast<T, YAML::Node> {
+   public:
+    YAML::Node operator()(const T &v) {
+        if constexpr (std::is_arithmetic<T>::value ||
+                      std::is_same<T, std::string>::value) {
+            return YAML::Node(LexicalCast<T, std::string>()(v));
+        } else {
+            return YAML::Load(LexicalCast<T, std::string>()(v));
+        }
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 std::vector<T>)
+ */
+template <class T>
+class LexicalCast<YAML::Node, std::vector<T>> {
+   public:
+    std::vector<T> operator()(const YAML::Node &node) {
+        typename std::vector<T> vec;
+        vec.reserve(node.size());
+        LexicalCast<YAML::Node, T> cast;
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            vec.push_back(cast(*it));
         }
         return vec;
     }
 };
 
+/**
+ * @brief 类型转换模板类片特化(std::vector<T> 转换成 YAML::Node)
+ */
+template <class T>
+class LexicalCast<std::vector<T>, YAML::Node> {
+   public:
+    YAML::Node operator()(const std::vector<T> &v) {
+        YAML::Node node(YAML::NodeType::Sequence);
+        LexicalCast<T, YAML::Node> cast;
+        for (auto &i : v) {
+            node.push_back(cast(i));
+        }
+        return node;
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML String 转换成 std::vector<T>)
+ */
+template <class T>
+class LexicalCast<std::string, std::vector<T>> {
+   public:
+    std::vector<T> operator()(const std::string &v) {
+        return LexicalCast<YAML::Node, std::vector<T>>()(YAML::Load(v));
+    }
+};
+
 /**
  * @brief 类型转换模板类片特化(std::vector<T> 转换成 YAML String)
  */
@@ -120,13 +194,41 @@ template <class T>
 class LexicalCast<std::vector<T>, std::string> {
    public:
     std::string operator()(const std::vector<T> &v) {
+        std::stringstream ss;
+        ss << LexicalCast<std::vector<T>, YAML::Node>()(v);
+        return ss.str();
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 std::list<T>)
+ */
+template <class T>
+class LexicalCast<YAML::Node, std::list<T>> {
+   public:
+    std::list<T> operator()(const YAML::Node &node) {
+        typename std::list<T> vec;
+        LexicalCast<YAML::Node, T> cast;
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            vec.push_back(cast(*it));
+        }
+        return vec;
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(std::list<T> 转换成 YAML::Node)
+ */
+template <class T>
+class LexicalCast<std::list<T>, YAML::Node> {
+   public:
+    YAML::Node operator()(const std::list<T> &v) {
         YAML::Node node(YAML::NodeType::Sequence);
+        LexicalCast<T, YAML::Node> cast;
         for (auto &i : v) {
-            node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
+            node.push_back(cast(i));
         }
-        std::stringstream ss;
-        ss << node;
-        return ss.str();
+        return node;
     }
 };
 
@@ -137,15 +239,7 @@ template <class T>
 class LexicalCast<std::string, std::list<T>> {
    public:
     std::list<T> operator()(const std::string &v) {
-        YAML::Node node = YAML::Load(v);
-        typename std::list<T> vec;
-        std::stringstream ss;
-        for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.push_back(LexicalCast<std::string, T>()(ss.str()));
-        }
-        return vec;
+        return LexicalCast<YAML::Node, std::list<T>>()(YAML::Load(v));
     }
 };
 
@@ -156,13 +250,41 @@ template <class T>
 class LexicalCast<std::list<T>, std::string> {
    public:
     std::string operator()(const std::list<T> &v) {
+        std::stringstream ss;
+        ss << LexicalCast<std::list<T>, YAML::Node>()(v);
+        return ss.str();
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 std::set<T>)
+ */
+template <class T>
+class LexicalCast<YAML::Node, std::set<T>> {
+   public:
+    std::set<T> operator()(const YAML::Node &node) {
+        typename std::set<T> vec;
+        LexicalCast<YAML::Node, T> cast;
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            vec.insert(cast(*it));
+        }
+        return vec;
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(std::set<T> 转换成 YAML::Node)
+ */
+template <class T>
+class LexicalCast<std::set<T>, YAML::Node> {
+   public:
+    YAML::Node operator()(const std::set<T> &v) {
         YAML::Node node(YAML::NodeType::Sequence);
+        LexicalCast<T, YAML::Node> cast;
         for (auto &i : v) {
-            node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
+            node.push_back(cast(i));
         }
-        std::stringstream ss;
-        ss << node;
-        return ss.str();
+        return node;
     }
 };
 
@@ -173,15 +295,7 @@ template <class T>
 class LexicalCast<std::string, std::set<T>> {
    public:
     std::set<T> operator()(const std::string &v) {
-        YAML::Node node = YAML::Load(v);
-        typename std::set<T> vec;
-        std::stringstream ss;
-        for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.insert(LexicalCast<std::string, T>()(ss.str()));
-        }
-        return vec;
+        return LexicalCast<YAML::Node, std::set<T>>()(YAML::Load(v));
     }
 };
 
@@ -192,13 +306,42 @@ template <class T>
 class LexicalCast<std::set<T>, std::string> {
    public:
     std::string operator()(const std::set<T> &v) {
+        std::stringstream ss;
+        ss << LexicalCast<std::set<T>, YAML::Node>()(v);
+        return ss.str();
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 std::unordered_set<T>)
+ */
+template <class T>
+class LexicalCast<YAML::Node, std::unordered_set<T>> {
+   public:
+    std::unordered_set<T> operator()(const YAML::Node &node) {
+        typename std::unordered_set<T> vec;
+        vec.reserve(node.size());
+        LexicalCast<YAML::Node, T> cast;
+        for (auto it = node.begin(); it != node.end(); ++it) {
+            vec.insert(cast(*it));
+        }
+        return vec;
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(std::unordered_set<T> 转换成 YAML::Node)
+ */
+template <class T>
+class LexicalCast<std::unordered_set<T>, YAML::Node> {
+   public:
+    YAML::Node operator()(const std::unordered_set<T> &v) {
         YAML::Node node(YAML::NodeType::Sequence);
+        LexicalCast<T, YAML::Node> cast;
         for (auto &i : v) {
-            node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
+            node.push_back(cast(i));
         }
-        std::stringstream ss;
-        ss << node;
-        return ss.str();
+        return node;
     }
 };
 
@@ -209,15 +352,7 @@ template <class T>
 class LexicalCast<std::string, std::unordered_set<T>> {
    public:
     std::unordered_set<T> operator()(const std::string &v) {
-        YAML::Node node = YAML::Load(v);
-        typename std::unordered_set<T> vec;
-        std::stringstream ss;
-        for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.insert(LexicalCast<std::string, T>()(ss.str()));
-        }
-        return vec;
+        return LexicalCast<YAML::Node, std::unordered_set<T>>()(YAML::Load(v));
     }
 };
 
@@ -228,88 +363,121 @@ template <class T>
 class LexicalCast<std::unordered_set<T>, std::string> {
    public:
     std::string operator()(const std::unordered_set<T> &v) {
-        YAML::Node node(YAML::NodeType::Sequence);
-        for (auto &i : v) {
-            node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
-        }
         std::stringstream ss;
-        ss << node;
+        ss << LexicalCast<std::unordered_set<T>, YAML::Node>()(v);
         return ss.str();
     }
 };
 
 /**
- * @brief 类型转换模板类片特化(YAML String 转换成 std::map<std::string, T>)
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 std::map<std::string, T>)
  */
 template <class T>
-class LexicalCast<std::string, std::map<std::string, T>> {
+class LexicalCast<YAML::Node, std::map<std::string, T>> {
    public:
-    std::map<std::string, T> operator()(const std::string &v) {
-        YAML::Node node = YAML::Load(v);
+    std::map<std::string, T> operator()(const YAML::Node &node) {
         typename std::map<std::string, T> vec;
-        std::stringstream ss;
+        LexicalCast<YAML::Node, T> cast;
         for (auto it = node.begin(); it != node.end(); ++it) {
-            ss.str("");
-            ss << it->second;
-            vec.insert(std::make_pair(it->first.Scalar(),
-                                      LexicalCast<std::string, T>()(ss.str())));
+            vec.emplace(it->first.Scalar(), cast(it->second));
         }
         return vec;
     }
 };
 
 /**
- * @brief 类型转换模板类片特化(std::map<std::string, T> 转换成 YAML String)
+ * @brief 类型转换模板类片特化(std::map<std::string, T> 转换成 YAML::Node)
  */
 template <class T>
-class LexicalCast<std::map<std::string, T>, std::string> {
+class LexicalCast<std::map<std::string, T>, YAML::Node> {
    public:
-    std::string operator()(const std::map<std::string, T> &v) {
+    YAML::Node operator()(const std::map<std::string, T> &v) {
         YAML::Node node(YAML::NodeType::Map);
+        LexicalCast<T, YAML::Node> cast;
         for (auto &i : v) {
-            node[i.first] = YAML::Load(LexicalCast<T, std::string>()(i.second));
+            node[i.first] = cast(i.second);
         }
+        return node;
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML String 转换成 std::map<std::string, T>)
+ */
+template <class T>
+class LexicalCast<std::string, std::map<std::string, T>> {
+   public:
+    std::map<std::string, T> operator()(const std::string &v) {
+        return LexicalCast<YAML::Node, std::map<std::string, T>>()(YAML::Load(v));
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(std::map<std::string, T> 转换成 YAML String)
+ */
+template <class T>
+class LexicalCast<std::map<std::string, T>, std::string> {
+   public:
+    std::string operator()(const std::map<std::string, T> &v) {
         std::stringstream ss;
-        ss << node;
+        ss << LexicalCast<std::map<std::string, T>, YAML::Node>()(v);
         return ss.str();
     }
 };
 
 /**
- * @brief 类型转换模板类片特化(YAML String 转换成
- * std::unordered_map<std::string, T>)
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 std::unordered_map<std::string, T>)
  */
 template <class T>
-class LexicalCast<std::string, std::unordered_map<std::string, T>> {
+class LexicalCast<YAML::Node, std::unordered_map<std::string, T>> {
    public:
-    std::unordered_map<std::string, T> operator()(const std::string &v) {
-        YAML::Node node = YAML::Load(v);
+    std::unordered_map<std::string, T> operator()(const YAML::Node &node) {
         typename std::unordered_map<std::string, T> vec;
-        std::stringstream ss;
+        vec.reserve(node.size());
+        LexicalCast<YAML::Node, T> cast;
         for (auto it = node.begin(); it != node.end(); ++it) {
-            ss.str("");
-            ss << it->second;
-            vec.insert(std::make_pair(it->first.Scalar(),
-                                      LexicalCast<std::string, T>()(ss.str())));
+            vec.emplace(it->first.Scalar(), cast(it->second));
         }
         return vec;
     }
 };
 
 /**
- * @brief 类型转换模板类片特化(std::unordered_map<std::string, T> 转换成 YAML
- * String)
+ * @brief 类型转换模板类片特化(std::unordered_map<std::string, T> 转换成 YAML::Node)
  */
 template <class T>
-class LexicalCast<std::unordered_map<std::string, T>, std::string> {
+class LexicalCast<std::unordered_map<std::string, T>, YAML::Node> {
    public:
-    std::string operator()(const std::unordered_map<std::string, T> &v) {
+    YAML::Node operator()(const std::unordered_map<std::string, T> &v) {
         YAML::Node node(YAML::NodeType::Map);
+        LexicalCast<T, YAML::Node> cast;
         for (auto &i : v) {
-            node[i.first] = YAML::Load(LexicalCast<T, std::string>()(i.second));
+            node[i.first] = cast(i.second);
         }
+        return node;
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(YAML String 转换成 std::unordered_map<std::string, T>)
+ */
+template <class T>
+class LexicalCast<std::string, std::unordered_map<std::string, T>> {
+   public:
+    std::unordered_map<std::string, T> operator()(const std::string &v) {
+        return LexicalCast<YAML::Node, std::unordered_map<std::string, T>>()(YAML::Load(v));
+    }
+};
+
+/**
+ * @brief 类型转换模板类片特化(std::unordered_map<std::string, T> 转换成 YAML String)
+ */
+template <class T>
+class LexicalCast<std::unordered_map<std::string, T>, std::string> {
+   public:
+    std::string operator()(const std::unordered_map<std::string, T> &v) {
         std::stringstream ss;
-        ss << node;
+        ss << LexicalCast<std::unordered_map<std::string, T>, YAML::Node>()(v);
         return ss.str();
     }
 };
@@ -320,6 +488,9 @@ class LexicalCast<std::unordered_map<std::string, T>, std::string> {
  *          FromStr 从std::string转换成T类型的仿函数
  *          ToStr 从T转换成std::string的仿函数
  *          std::string 为YAML格式的字符串
+ *          参数值保存为不可变的快照，setValue发布新快照并增加版本号。
+ *          每个线程缓存自己读到的快照，版本号没变时读取只有一次原子load，
+ *          不加锁也不修改共享的引用计数，多线程读取不会在同一个缓存行上竞争
  */
 template <class T, class FromStr = LexicalCast<std::string, T>,
           class ToStr = LexicalCast<T, std::string>>
@@ -338,7 +509,9 @@ class ConfigVar : public ConfigVarBase {
      */
     ConfigVar(const std::string &name, const T &default_value,
               const std::string &description = "")
-        : ConfigVarBase(name, description), m_val(default_value) {}
+        : ConfigVarBase(name, description),
+          m_slot(AllocSnapshotSlot()),
+          m_val(std::make_shared<const T>(default_value)) {}
 
     /**
      * @brief 将参数值转换成YAML String
@@ -347,8 +520,7 @@ class ConfigVar : public ConfigVarBase {
     std::string toString() override {
         try {
             // return boost::lexical_cast<std::string>(m_val);
-            RWMutexType::ReadLock lock(m_mutex);
-            return ToStr()(m_val);
+            return ToStr()(*getSnapshotPtr());
         } catch (std::exception &e) {
         }
         return "";
@@ -361,35 +533,93 @@ class ConfigVar : public ConfigVarBase {
     bool fromString(const std::string &val) override {
         try {
             setValue(FromStr()(val));
+            return true;
         } catch (std::exception &e) {
         }
         return false;
     }
 
+    /**
+     * @brief 从YAML节点转成参数的值
+     * @details 使用默认转换器时直接按节点转换，自定义FromStr时先把节点转成字符串
+     */
+    bool fromNode(const YAML::Node &node) override {
+        if constexpr (std::is_same<FromStr, LexicalCast<std::string, T>>::value) {
+            try {
+                setValue(LexicalCast<YAML::Node, T>()(node));
+                return true;
+            } catch (std::exception &e) {
+            }
+            return false;
+        } else {
+            if (node.IsScalar()) {
+                return fromString(node.Scalar());
+            }
+            std::stringstream ss;
+            ss << node;
+            return fromString(ss.str());
+        }
+    }
+
     /**
      * @brief 获取当前参数的值
      */
-    const T getValue() {
+    const T getValue() { return getSnapshot(); }
+
+    /**
+     * @brief 无锁读取当前参数值的只读快照
+     * @details 返回的引用由当前线程的缓存持有，在本线程下一次读取这个参数之前一直有效。
+     *          协程可能被调度到其他线程，跨越yield持有时使用getSnapshotPtr
+     */
+    const T &getSnapshot() {
+        SnapshotCache &cache = GetSnapshotCache(m_slot);
+        if (cache.version != m_version.load(std::memory_order_acquire)) {
+            RWMutexType::ReadLock lock(m_mutex);
+            cache.value = m_val;
+            cache.version = m_version.load(std::memory_order_relaxed);
+        }
+        return *static_cast<const T *>(cache.value.get());
+    }
+
+    /**
+     * @brief 获取当前快照的共享指针，可以长期持有
+     */
+    std::shared_ptr<const T> getSnapshotPtr() {
         RWMutexType::ReadLock lock(m_mutex);
         return m_val;
     }
 
+    /**
+     * @brief 返回当前快照的版本号，每次setValue修改了值都会增加
+     */
+    uint64_t getVersion() const {
+        return m_version.load(std::memory_order_acquire);
+    }
+
     /**
      * @brief 设置当前参数的值
-     * @details 如果参数的值有发生变化,则通知对应的注册回调函数
+     * @details 如果参数的值有发生变化,则通知对应的注册回调函数,再发布新的快照。
+     *          回调在锁外执行，回调里可以挂起协程
      */
     void setValue(const T &v) {
+        std::shared_ptr<const T> old;
+        std::map<uint64_t, on_change_cb> cbs;
         {
             RWMutexType::ReadLock lock(m_mutex);
-            if (v == m_val) {
+            if (v == *m_val) {
                 return;
             }
-            for (auto &i : m_cbs) {
-                i.second(m_val, v);
-            }
+            old = m_val;
+            cbs = m_cbs;
+        }
+        for (auto &i : cbs) {
+            i.second(*old, v);
         }
+        // val先于lock构造，换出来的旧快照在解锁之后才释放
+        std::shared_ptr<const T> val = std::make_shared<const T>(v);
         RWMutexType::WriteLock lock(m_mutex);
-        m_val = v;
+        m_val.swap(val);
+        m_version.fetch_add(1, std::memory_order_release);
     }
 
     /**
@@ -439,7 +669,12 @@ class ConfigVar : public ConfigVarBase {
 
    private:
     RWMutexType m_mutex;
-    T m_val;
+    /// 线程快照缓存的槽位
+    const uint32_t m_slot;
+    /// 快照版本号，从1开始
+    std::atomic<uint64_t> m_version{1};
+    /// 当前快照
+    std::shared_ptr<const T> m_val;
     // 变更回调函数组, uint64_t key,要求唯一，一般可以用hash
     std::map<uint64_t, on_change_cb> m_cbs;
 };
@@ -468,14 +703,13 @@ class Config {
     static typename ConfigVar<T>::ptr Lookup(
         const std::string &name, const T &default_value,
         const std::string &description = "") {
-        RWMutexType::WriteLock lock(GetMutex());
-        auto it = GetDatas().find(name);
-        if (it != GetDatas().end()) {
-            auto tmp = std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
-            if (tmp) {
-                return tmp;
-            } else {
-                return nullptr;
+        Shard &shard = GetShard(name);
+        {
+            // 已经存在的参数只加分片的读锁
+            RWMutexType::ReadLock lock(shard.mutex);
+            auto it = shard.datas.find(name);
+            if (it != shard.datas.end()) {
+                return Cast<T>(it->second);
             }
         }
 
@@ -484,9 +718,14 @@ class Config {
             throw std::invalid_argument(name);
         }
 
+        RWMutexType::WriteLock lock(shard.mutex);
+        auto it = shard.datas.find(name);
+        if (it != shard.datas.end()) {
+            return Cast<T>(it->second);
+        }
         typename ConfigVar<T>::ptr v(
             new ConfigVar<T>(name, default_value, description));
-        GetDatas()[name] = v;
+        shard.datas[name] = v;
         return v;
     }
 
@@ -497,12 +736,13 @@ class Config {
      */
     template <class T>
     static typename ConfigVar<T>::ptr Lookup(const std::string &name) {
-        RWMutexType::ReadLock lock(GetMutex());
-        auto it = GetDatas().find(name);
-        if (it == GetDatas().end()) {
+        Shard &shard = GetShard(name);
+        RWMutexType::ReadLock lock(shard.mutex);
+        auto it = shard.datas.find(name);
+        if (it == shard.datas.end()) {
             return nullptr;
         }
-        return std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
+        return Cast<T>(it->second);
     }
 
     /**
@@ -511,10 +751,28 @@ class Config {
     static void LoadFromYaml(const YAML::Node &root);
 
     /**
-     * @brief 加载path文件夹里面的配置文件
+     * @brief 加载path文件夹(包括子文件夹)里面的.yml配置文件
+     * @details 记录每个文件的修改时间、大小和每个key对应节点的哈希，
+     *          只重新解析变化了的文件，只更新节点有变化的配置参数
+     * @param[in] force 为true时重新解析所有文件并更新所有配置参数
      */
     static void LoadFromConfDir(const std::string &path, bool force = false);
 
+    /**
+     * @brief 用inotify监听配置文件夹，文件写完或者被移入时增量重新加载
+     * @details 重新加载在iom的协程里执行，不会阻塞调用线程。
+     *          监听期间iom上一直有一个读事件，停止iom之前要先调用UnwatchConfDir
+     * @param[in] path 配置文件夹
+     * @param[in] iom 执行重新加载的IOManager，为nullptr时使用当前线程的IOManager
+     * @return 成功返回true
+     */
+    static bool WatchConfDir(const std::string &path, IOManager *iom = nullptr);
+
+    /**
+     * @brief 停止监听配置文件夹
+     */
+    static void UnwatchConfDir();
+
     /**
      * @brief 查找配置参数,返回配置参数的基类
      * @param[in] name 配置参数名称
@@ -528,21 +786,118 @@ class Config {
     static void Visit(std::function<void(ConfigVarBase::ptr)> cb);
 
    private:
+    /// 注册表分片数
+    static const size_t kShardCount = 32;
+
+    /**
+     * @brief 注册表分片，按参数名的哈希分布，独占缓存行避免分片之间的伪共享
+     */
+    struct alignas(kCacheLineSize) Shard {
+        RWMutexType mutex;
+        ConfigVarMap datas;
+    };
+
+    /**
+     * @brief 返回所有的分片
+     */
+    static Shard *GetShards() {
+        static Shard s_shards[kShardCount];
+        return s_shards;
+    }
+
+    /**
+     * @brief 返回参数名所在的分片
+     */
+    static Shard &GetShard(const std::string &name) {
+        return GetShards()[std::hash<std::string>()(name) % kShardCount];
+    }
+
+    /**
+     * @brief 转换成ConfigVar<T>，类型不匹配时返回nullptr
+     * @details 用typeid比较代替dynamic_pointer_cast，只比较一次类型信息
+     */
+    template <class T>
+    static typename ConfigVar<T>::ptr Cast(const ConfigVarBase::ptr &var) {
+        if (typeid(*var) != typeid(ConfigVar<T>)) {
+            return nullptr;
+        }
+        return std::static_pointer_cast<ConfigVar<T>>(var);
+    }
+};
+
+/**
+ * @brief 配置参数的类型化句柄
+ * @details 第一次访问时通过Config::Lookup查找或创建配置参数并缓存，
+ *          之后每次访问只有一次原子指针读取，适合在热路径上按名字延迟查找配置的模块。
+ *          配置参数注册后不会删除，句柄同时持有一份引用
+ * @code
+ *     static coro::ConfigHandle<int> s_timeout("tcp.connect.timeout", 5000);
+ *     int timeout = s_timeout->getSnapshot();
+ * @endcode
+ */
+template <class T>
+class ConfigHandle : Noncopyable {
+   public:
+    /**
+     * @brief 构造函数，参数同Config::Lookup，不会立即查找
+     */
+    ConfigHandle(const std::string &name, const T &default_value,
+                 const std::string &description = "")
+        : m_name(name), m_default(default_value), m_description(description) {}
+
     /**
-     * @brief 返回所有的配置项
+     * @brief 返回配置参数，名字已经注册为其他类型时返回nullptr
+     * @details 类型不匹配的结果也会缓存，之后的调用不再加锁重复查找
      */
-    static ConfigVarMap &GetDatas() {
-        static ConfigVarMap s_datas;
-        return s_datas;
+    ConfigVar<T> *get() {
+        ConfigVar<T> *var = m_var.load(std::memory_order_acquire);
+        if (var) {
+            return var;
+        }
+        if (m_mismatch.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return resolve();
     }
 
     /**
-     * @brief 配置项的RWMutex
+     * @brief 访问配置参数
+     * @exception 名字已经注册为其他类型时抛出std::invalid_argument
      */
-    static RWMutexType &GetMutex() {
-        static RWMutexType s_mutex;
-        return s_mutex;
+    ConfigVar<T> *operator->() {
+        ConfigVar<T> *var = get();
+        if (!var) {
+            throw std::invalid_argument(m_name);
+        }
+        return var;
+    }
+
+   private:
+    ConfigVar<T> *resolve() {
+        Mutex::Lock lock(m_mutex);
+        if (!m_holder && !m_mismatch.load(std::memory_order_relaxed)) {
+            m_holder = Config::Lookup<T>(m_name, m_default, m_description);
+            if (m_holder) {
+                m_var.store(m_holder.get(), std::memory_order_release);
+            } else {
+                m_mismatch.store(true, std::memory_order_release);
+            }
+        }
+        return m_holder.get();
     }
+
+   private:
+    /// 缓存的配置参数
+    std::atomic<ConfigVar<T> *> m_var{nullptr};
+    /// 名字已经注册为其他类型
+    std::atomic<bool> m_mismatch{false};
+    /// 保护第一次查找
+    Mutex m_mutex;
+    /// 持有配置参数
+    typename ConfigVar<T>::ptr m_holder;
+    std::string m_name;
+    T m_default;
+    std::string m_description;
 };
 
 }  // namespace coro
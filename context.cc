@@ -0,0 +1,179 @@
+/**
+ * @file context.cc
+ * @brief 协程上下文切换后端实现
+ * @author shawn
+ * @date 2024-06-20
+ */
+#include "context.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__)
+/**
+ * x86-64 System V: 保存rbp/rbx/r12-r15，以及mxcsr和x87控制字
+ * 栈布局(低地址->高地址): [mxcsr|fpucw] r12 r13 r14 r15 rbx rbp ret
+ */
+asm(R"(
+    .text
+    .globl coro_context_swap
+    .type coro_context_swap, @function
+    .align 16
+coro_context_swap:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size coro_context_swap, .-coro_context_swap
+
+    .globl coro_context_trampoline
+    .type coro_context_trampoline, @function
+    .align 16
+coro_context_trampoline:
+    xorl %ebp, %ebp
+    callq *%r12
+    callq abort@PLT
+    .size coro_context_trampoline, .-coro_context_trampoline
+)");
+#elif defined(__aarch64__)
+/**
+ * AAPCS64: 保存x19-x30和d8-d15
+ * 栈布局(低地址->高地址): d8-d15 x19-x28 x29 x30
+ */
+asm(R"(
+    .text
+    .globl coro_context_swap
+    .type coro_context_swap, %function
+    .align 4
+coro_context_swap:
+    sub sp, sp, #0xa0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x2, sp
+    str x2, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xa0
+    ret
+    .size coro_context_swap, .-coro_context_swap
+
+    .globl coro_context_trampoline
+    .type coro_context_trampoline, %function
+    .align 4
+coro_context_trampoline:
+    mov x29, #0
+    blr x19
+    bl abort
+    .size coro_context_trampoline, .-coro_context_trampoline
+)");
+#endif
+
+#ifdef CORO_CONTEXT_HAS_ASM
+extern "C" void coro_context_trampoline();
+
+extern "C" void* coro_context_make(void* stack, size_t size, void (*fn)()) {
+    // 栈从高地址向低地址增长，栈顶按16字节对齐
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size) & ~uintptr_t(15);
+#if defined(__x86_64__)
+    // 8个槽位: 浮点控制字, r12, r13, r14, r15, rbx, rbp, 返回地址
+    // ret之后rsp = top - 16，保证trampoline里call之前栈是16字节对齐的
+    uint64_t* sp = reinterpret_cast<uint64_t*>(top - 16 - 8 * 8);
+    // mxcsr默认值0x1F80，x87控制字默认值0x037F
+    sp[0] = 0x1F80 | (uint64_t(0x037F) << 32);
+    sp[1] = reinterpret_cast<uint64_t>(fn);
+    sp[2] = sp[3] = sp[4] = sp[5] = sp[6] = 0;
+    sp[7] = reinterpret_cast<uint64_t>(&coro_context_trampoline);
+#else
+    // 20个槽位: d8-d15, x19-x28, x29, x30
+    uint64_t* sp = reinterpret_cast<uint64_t*>(top - 20 * 8);
+    for (int i = 0; i < 20; ++i) {
+        sp[i] = 0;
+    }
+    sp[8] = reinterpret_cast<uint64_t>(fn);
+    sp[19] = reinterpret_cast<uint64_t>(&coro_context_trampoline);
+#endif
+    return sp;
+}
+#endif
+
+namespace coro {
+
+#ifdef CORO_CONTEXT_ASM
+const char* Context::BackendName() {
+#if defined(__x86_64__)
+    return "asm-x86_64";
+#else
+    return "asm-aarch64";
+#endif
+}
+#else
+void Context::init() {
+    if (getcontext(&m_ctx)) {
+        abort();
+    }
+}
+
+void Context::make(void* stack, size_t size, void (*fn)()) {
+    if (getcontext(&m_ctx)) {
+        abort();
+    }
+    m_ctx.uc_link = nullptr;
+    m_ctx.uc_stack.ss_sp = stack;
+    m_ctx.uc_stack.ss_size = size;
+    makecontext(&m_ctx, fn, 0);
+}
+
+void Context::swapTo(Context& to) {
+    if (swapcontext(&m_ctx, &to.m_ctx)) {
+        abort();
+    }
+}
+
+void* Context::sp() const {
+#if defined(__x86_64__)
+    return reinterpret_cast<void*>(m_ctx.uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void*>(m_ctx.uc_mcontext.sp);
+#else
+    return nullptr;
+#endif
+}
+
+const char* Context::BackendName() { return "ucontext"; }
+#endif
+
+}  // namespace coro
@@ -0,0 +1,103 @@
+/**
+ * @file context.h
+ * @brief 协程上下文切换后端
+ * @author shawn
+ * @date 2024-06-20
+ * @details 默认在x86-64/aarch64上使用手写汇编切换，只保存callee-saved寄存器，
+ *          不经过rt_sigprocmask系统调用；定义CORO_CONTEXT_UCONTEXT宏或在其他架构上
+ *          回退到ucontext_t实现
+ */
+#ifndef __CORO_CONTEXT_H__
+#define __CORO_CONTEXT_H__
+
+#include <stddef.h>
+#include <ucontext.h>
+
+#if (defined(__x86_64__) || defined(__aarch64__))
+#define CORO_CONTEXT_HAS_ASM 1
+#endif
+
+#if defined(CORO_CONTEXT_HAS_ASM) && !defined(CORO_CONTEXT_UCONTEXT)
+#define CORO_CONTEXT_ASM 1
+#endif
+
+#ifdef CORO_CONTEXT_HAS_ASM
+extern "C" {
+/**
+ * @brief 保存当前callee-saved寄存器到当前栈上，将栈顶写入*from_sp，然后切换到to_sp
+ * @param[out] from_sp 保存当前上下文的栈顶
+ * @param[in] to_sp 目标上下文的栈顶
+ */
+void coro_context_swap(void** from_sp, void* to_sp);
+
+/**
+ * @brief 在一段栈空间上构造初始上下文，首次切换进去时执行fn
+ * @param[in] stack 栈的起始地址(低地址)
+ * @param[in] size 栈大小
+ * @param[in] fn 入口函数，不允许返回
+ * @return 可以传给coro_context_swap的栈顶
+ */
+void* coro_context_make(void* stack, size_t size, void (*fn)());
+}
+#endif
+
+namespace coro {
+
+/**
+ * @brief 协程上下文
+ */
+class Context {
+   public:
+    /**
+     * @brief 初始化为当前线程正在执行的上下文，用于线程主协程
+     */
+    void init();
+
+    /**
+     * @brief 在指定的栈上创建新的上下文
+     * @param[in] stack 栈地址
+     * @param[in] size 栈大小
+     * @param[in] fn 入口函数
+     */
+    void make(void* stack, size_t size, void (*fn)());
+
+    /**
+     * @brief 保存当前上下文到本对象，并切换到to
+     */
+    void swapTo(Context& to);
+
+    /**
+     * @brief 返回上下文被切出时的栈顶，仅在切出状态下有效
+     */
+    void* sp() const;
+
+    /**
+     * @brief 返回当前使用的后端名称
+     */
+    static const char* BackendName();
+
+   private:
+#ifdef CORO_CONTEXT_ASM
+    // 切出时保存的栈顶，寄存器保存在栈上
+    void* m_sp = nullptr;
+#else
+    // ucontext上下文
+    ucontext_t m_ctx;
+#endif
+};
+
+#ifdef CORO_CONTEXT_ASM
+inline void Context::init() { m_sp = nullptr; }
+
+inline void Context::make(void* stack, size_t size, void (*fn)()) {
+    m_sp = coro_context_make(stack, size, fn);
+}
+
+inline void Context::swapTo(Context& to) { coro_context_swap(&m_sp, to.m_sp); }
+
+inline void* Context::sp() const { return m_sp; }
+#endif
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * @file counter.cc
+ * @brief 按线程分片的计数器实现
+ * @author shawn
+ * @date 2024-07-24
+ */
+#include "counter.h"
+
+#include <algorithm>
+
+namespace coro {
+
+// 线程的槽缓存已经析构，之后的写直接累加到汇总值
+static thread_local bool t_exiting = false;
+
+/**
+ * @brief 计数器编号分配，析构的计数器编号放回空闲列表
+ */
+class CounterIdAllocator {
+   public:
+    uint32_t alloc() {
+        Mutex::Lock lock(m_mutex);
+        if (!m_free.empty()) {
+            uint32_t id = m_free.back();
+            m_free.pop_back();
+            return id;
+        }
+        return m_next++;
+    }
+
+    void free(uint32_t id) {
+        Mutex::Lock lock(m_mutex);
+        m_free.push_back(id);
+    }
+
+   private:
+    Mutex m_mutex;
+    uint32_t m_next = 0;
+    std::vector<uint32_t> m_free;
+};
+
+// 静态计数器可能在其他编译单元的静态初始化中构造，也可能在退出时析构，所以不释放
+static CounterIdAllocator& GetIdAllocator() {
+    static CounterIdAllocator* s_allocator = new CounterIdAllocator();
+    return *s_allocator;
+}
+
+ShardedCounter::ShardedCounter()
+    : m_id(GetIdAllocator().alloc()), m_core(std::make_shared<Core>()) {}
+
+ShardedCounter::~ShardedCounter() { GetIdAllocator().free(m_id); }
+
+int64_t ShardedCounter::value() const {
+    Mutex::Lock lock(m_core->mutex);
+    int64_t sum = m_core->retired.load(std::memory_order_relaxed);
+    for (auto& i : m_core->slots) {
+        sum += i->value.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+ShardedCounter::Slot* ShardedCounter::localSlotSlow() {
+    if (t_exiting) {
+        return nullptr;
+    }
+    static thread_local LocalSlots t_slots;
+    t_local = &t_slots;
+    if (m_id >= t_slots.entries.size()) {
+        t_slots.entries.resize(m_id + 1);
+    }
+    LocalEntry& entry = t_slots.entries[m_id];
+    if (entry.core) {
+        // 同一编号的旧计数器已经析构
+        Retire(entry);
+    }
+    Slot* slot = new Slot();
+    {
+        Mutex::Lock lock(m_core->mutex);
+        m_core->slots.push_back(slot);
+    }
+    entry.core = m_core;
+    entry.slot = slot;
+    return slot;
+}
+
+void ShardedCounter::Retire(LocalEntry& entry) {
+    {
+        Mutex::Lock lock(entry.core->mutex);
+        std::vector<Slot*>& slots = entry.core->slots;
+        slots.erase(std::find(slots.begin(), slots.end(), entry.slot));
+        entry.core->retired.fetch_add(
+            entry.slot->value.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+    delete entry.slot;
+    entry.slot = nullptr;
+    entry.core.reset();
+}
+
+ShardedCounter::LocalSlots::~LocalSlots() {
+    t_exiting = true;
+    t_local = nullptr;
+    for (auto& i : entries) {
+        if (i.core) {
+            Retire(i);
+        }
+    }
+}
+
+}  // namespace coro
@@ -0,0 +1,206 @@
+/**
+ * @file counter.h
+ * @brief 避免伪共享的统计计数器
+ * @author shawn
+ * @date 2024-07-23
+ */
+#ifndef __CORO_COUNTER_H__
+#define __CORO_COUNTER_H__
+
+#include <sched.h>
+#include <sys/sysinfo.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace coro {
+
+/**
+ * @brief 按CPU分片的计数器
+ * @details 每个CPU一个独占缓存行的槽，add只改当前CPU的槽，
+ *          同一CPU上的线程几乎不会同时写，原子操作不会在核间来回传递缓存行。
+ *          value把所有槽加起来，读到的是近似值，适合写多读少的统计
+ */
+template <class T>
+class PerCpuCounter : Noncopyable {
+   public:
+    PerCpuCounter()
+        : m_count(get_nprocs_conf() > 0 ? get_nprocs_conf() : 1),
+          m_slots(new Slot[m_count]) {}
+
+    /**
+     * @brief 增加v
+     */
+    void add(T v = 1) {
+        m_slots[slot()].value.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 减少v
+     */
+    void sub(T v = 1) {
+        m_slots[slot()].value.fetch_sub(v, std::memory_order_relaxed);
+    }
+
+    PerCpuCounter& operator++() {
+        add(1);
+        return *this;
+    }
+
+    void operator++(int) { add(1); }
+
+    /**
+     * @brief 所有槽的和
+     */
+    T value() const {
+        T sum = 0;
+        for (int i = 0; i < m_count; ++i) {
+            sum += m_slots[i].value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    /**
+     * @brief 清零，和add并发时可能丢失部分计数
+     */
+    void reset() {
+        for (int i = 0; i < m_count; ++i) {
+            m_slots[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+   private:
+    struct alignas(kCacheLineSize) Slot {
+        std::atomic<T> value{0};
+    };
+
+    int slot() const {
+        int cpu = sched_getcpu();
+        return cpu >= 0 ? cpu % m_count : 0;
+    }
+
+   private:
+    /// 槽的数量，等于配置的CPU数
+    int m_count;
+    std::unique_ptr<Slot[]> m_slots;
+};
+
+/**
+ * @brief 按线程分片的计数器
+ * @details 每个线程第一次写时分配一个独占缓存行的槽，之后add只是对自己的槽做
+ *          普通的读和写，没有原子读改写。value在读时才把所有槽加起来。
+ *          线程退出时把槽里的值并入汇总值并释放槽。计数器析构后，
+ *          还引用它的线程在退出或下次写同一编号的新计数器时回收槽
+ */
+class ShardedCounter : Noncopyable {
+   public:
+    ShardedCounter();
+
+    ~ShardedCounter();
+
+    /**
+     * @brief 增加v
+     */
+    void add(int64_t v = 1) {
+        Slot* slot = localSlot();
+        if (slot) {
+            // 只有本线程写这个槽
+            slot->value.store(slot->value.load(std::memory_order_relaxed) + v,
+                              std::memory_order_relaxed);
+        } else {
+            m_core->retired.fetch_add(v, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 减少v
+     */
+    void sub(int64_t v = 1) { add(-v); }
+
+    ShardedCounter& operator++() {
+        add(1);
+        return *this;
+    }
+
+    ShardedCounter& operator--() {
+        add(-1);
+        return *this;
+    }
+
+    void operator++(int) { add(1); }
+
+    void operator--(int) { add(-1); }
+
+    /**
+     * @brief 已退出线程的汇总值加上所有线程槽的当前值
+     */
+    int64_t value() const;
+
+   private:
+    struct alignas(kCacheLineSize) Slot {
+        std::atomic<int64_t> value{0};
+    };
+
+    /**
+     * @brief 计数器的共享状态，线程的槽缓存也持有引用，计数器析构后仍可回收槽
+     */
+    struct Core {
+        /// 保护slots
+        Mutex mutex;
+        /// 存活线程的槽
+        std::vector<Slot*> slots;
+        /// 已退出线程的值，以及线程退出过程中直接累加的值
+        std::atomic<int64_t> retired{0};
+    };
+
+    /**
+     * @brief 线程缓存的槽，下标是计数器编号
+     */
+    struct LocalEntry {
+        std::shared_ptr<Core> core;
+        Slot* slot = nullptr;
+    };
+
+    struct LocalSlots {
+        std::vector<LocalEntry> entries;
+        ~LocalSlots();
+    };
+
+    Slot* localSlot() {
+        LocalSlots* local = t_local;
+        if (local && m_id < local->entries.size()) {
+            LocalEntry& entry = local->entries[m_id];
+            if (entry.core.get() == m_core.get()) {
+                return entry.slot;
+            }
+        }
+        return localSlotSlow();
+    }
+
+    /**
+     * @brief 为当前线程分配槽，线程正在退出时返回nullptr
+     */
+    Slot* localSlotSlow();
+
+    /**
+     * @brief 把槽的值并入所属计数器并释放槽
+     */
+    static void Retire(LocalEntry& entry);
+
+   private:
+    /// 计数器编号，析构后回收给新的计数器
+    uint32_t m_id;
+    std::shared_ptr<Core> m_core;
+    /// 当前线程的槽缓存，线程退出后为nullptr
+    inline static thread_local LocalSlots* t_local = nullptr;
+};
+
+}  // namespace coro
+
+#endif
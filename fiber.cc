@@ -1,19 +1,51 @@
 #include "fiber.h"
 
-#include <ucontext.h>
+#include <assert.h>
+#include <string.h>
 
 #include <atomic>
 #include <cstddef>
 #include <iostream>
+#include <vector>
+
+#include "counter.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "stack_allocator.h"
+#include "trace.h"
 
 // UV: Unique Visitors（独立的访问者数）
 // RPS: Requests Per Second（每秒请求数）
 namespace coro {
 
-// 全局静态变量，用于生成协程id
+// 全局静态变量，用于分配协程id块
 static std::atomic<uint64_t> s_fiber_id{0};
-// 全局静态变量，用于统计当前的协程数
-static std::atomic<uint64_t> s_fiber_count{0};
+// 每个线程一次领取的协程id数，创建协程时只在线程内递增
+static const uint64_t kFiberIdBlock = 1024;
+// 线程局部变量，当前线程id块中下一个可用的id和块的结束位置
+static thread_local uint64_t t_next_fiber_id = 0;
+static thread_local uint64_t t_fiber_id_end = 0;
+
+// 协程数和共享栈保存区字节数，按线程分片，避免所有线程争用同一个缓存行。
+// 退出过程中析构的协程还会访问它们，所以不释放
+static ShardedCounter &FiberCount() {
+    static ShardedCounter *s_count = new ShardedCounter();
+    return *s_count;
+}
+
+static ShardedCounter &SavedStackBytes() {
+    static ShardedCounter *s_bytes = new ShardedCounter();
+    return *s_bytes;
+}
+
+static uint64_t NextFiberId() {
+    if (t_next_fiber_id == t_fiber_id_end) {
+        t_next_fiber_id =
+            s_fiber_id.fetch_add(kFiberIdBlock, std::memory_order_relaxed);
+        t_fiber_id_end = t_next_fiber_id + kFiberIdBlock;
+    }
+    return t_next_fiber_id++;
+}
 
 // 线程局部变量，当前线程正在运行的协程
 static thread_local Fiber *t_fiber = nullptr;
@@ -24,17 +56,61 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 // Config::Lookup<uint32_t>(
 //     "fiber.stack_size", 128 * 1024, "fiber stack size");
 size_t default_size = 128 * 1024;
+// 每个线程的共享栈大小和数量
+size_t shared_stack_size = 1024 * 1024;
+size_t shared_stack_count = 4;
+
+// 栈分配策略，默认使用带保护页的mmap池化分配器，定义CORO_FIBER_MALLOC_STACK退回malloc
+#ifdef CORO_FIBER_MALLOC_STACK
+using StackAllocator = MallocStackAllocator;
+#else
+using StackAllocator = PooledStackAllocator;
+#endif
 
 /**
- * @brief malloc栈内存分配器
+ * @brief 线程的共享栈，同一时刻只有occupant的栈内容在上面
+ * @details 只有所属线程换入协程时设置occupant，协程可能在其他线程上析构，
+ *          析构时清除占用和所属线程换出occupant都在lock里进行
  */
-class MallocStackAllocator {
+struct SharedStack {
+    void *stack = nullptr;
+    size_t size = 0;
+    std::atomic<Fiber *> occupant{nullptr};
+    Spinlock lock;
+};
+
+/**
+ * @brief 线程的共享栈池，新协程轮流分配到各个共享栈上，减少换入换出
+ * @details 线程和它创建的每个共享栈协程各持有一份引用，
+ *          线程退出或者协程在其他线程上析构时共享栈都仍然有效
+ */
+class SharedStackPool {
    public:
-    static void *Alloc(size_t size) { return malloc(size); }
-    static void Dealloc(void *vp, size_t size) { return free(vp); }
+    SharedStackPool()
+        : m_count(shared_stack_count ? shared_stack_count : 1),
+          m_stacks(new SharedStack[m_count]) {
+        for (size_t i = 0; i < m_count; ++i) {
+            m_stacks[i].size = shared_stack_size;
+            m_stacks[i].stack = StackAllocator::Alloc(m_stacks[i].size);
+        }
+    }
+
+    ~SharedStackPool() {
+        for (size_t i = 0; i < m_count; ++i) {
+            StackAllocator::Dealloc(m_stacks[i].stack, m_stacks[i].size);
+        }
+    }
+
+    SharedStack *next() { return &m_stacks[m_next++ % m_count]; }
+
+   private:
+    size_t m_count;
+    std::unique_ptr<SharedStack[]> m_stacks;
+    size_t m_next = 0;
 };
 
-using StackAllocator = MallocStackAllocator;
+// 当前线程的共享栈池，第一次创建共享栈协程时分配
+static thread_local std::shared_ptr<SharedStackPool> t_shared_stacks;
 
 uint64_t Fiber::GetFiberId() {
     if (t_fiber) {
@@ -51,17 +127,19 @@ uint64_t Fiber::GetFiberId() {
  */
 Fiber::Fiber() {
     SetThis(this);
-    m_state = RUNNING;
+    m_state.store(RUNNING, std::memory_order_relaxed);
 
-    // ucp: use context pointer，即用户上下文指针
-    if (getcontext(&m_ctx)) {
-    }
-    s_fiber_count++;
-    m_id = s_fiber_id++;
+    m_ctx.init();
+    FiberCount().add(1);
+    m_id = NextFiberId();
 }
 
 void Fiber::SetThis(Fiber *f) { t_fiber = f; }
 
+uint64_t Fiber::TotalFibers() { return FiberCount().value(); }
+
+uint64_t Fiber::TotalSavedStackBytes() { return SavedStackBytes().value(); }
+
 /**
  * 获取当前协程，同时充当初始化当前线程主协程的作用，这个函数在使用协程之前要调用一下
  */
@@ -80,27 +158,50 @@ Fiber::ptr Fiber::GetThis() {
  * @param[] cb 协程入口函数
  * @param[] stacksize 栈大小，默认为128k
  */
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller)
-    : m_id(s_fiber_id++), m_cb(cb) {
-    s_fiber_count++;
+Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler,
+             bool use_shared_stack)
+    : m_id(NextFiberId()), m_cb(cb), m_run_in_scheduler(run_in_scheduler) {
+    FiberCount().add(1);
+    if (use_shared_stack) {
+        // 共享栈此时可能正被其他协程使用，初始上下文推迟到第一次resume时创建
+        if (!t_shared_stacks) {
+            t_shared_stacks = std::make_shared<SharedStackPool>();
+        }
+        m_pool = t_shared_stacks;
+        m_shared = m_pool->next();
+        // 共享栈属于当前线程，之后不指定线程的调度默认都回到这个线程
+        if (Scheduler::GetThis()) {
+            m_scheduler = Scheduler::GetThis();
+            m_thread = Scheduler::GetThreadId();
+        }
+        m_stack = m_shared->stack;
+        m_stacksize = m_shared->size;
+        m_need_make = true;
+        return;
+    }
     m_stacksize = stacksize ? stacksize : default_size;
     m_stack = StackAllocator::Alloc(m_stacksize);
 
-    if (getcontext(&m_ctx)) {
-    }
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
-
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc);
 }
 
 /**
  * 线程的主协程析构时需要特殊处理，因为主协程没有分配栈和cb
  */
 Fiber::~Fiber() {
-    --s_fiber_count;
-    if (m_stack) {
+    FiberCount().sub(1);
+    if (m_shared) {
+        // 共享栈属于线程，只需要让出占用并释放保存区。可能在其他线程上析构，
+        // 加锁保证所属线程不会同时换出自己，共享栈池由m_pool保持有效
+        {
+            Spinlock::Lock lock(m_shared->lock);
+            if (m_shared->occupant.load(std::memory_order_relaxed) == this) {
+                m_shared->occupant.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        SavedStackBytes().sub(m_save_capacity);
+        free(m_save_buffer);
+    } else if (m_stack) {
         // 有栈，说明是子协程，需要确保子协程一定是结束状态
         StackAllocator::Dealloc(m_stack, m_stacksize);
     } else {
@@ -117,46 +218,103 @@ Fiber::~Fiber() {
  * 这里为了简化状态管理，强制只有TERM状态的协程才可以重置，但其实刚创建好但没执行过的协程也应该允许重置的
  */
 void Fiber::reset(std::function<void()> cb) {
-    m_cb = cb;
-    if (getcontext(&m_ctx)) {
+    m_cb = std::move(cb);
+    if (m_shared) {
+        m_save_size = 0;
+        m_need_make = true;
+    } else {
+        m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc);
+    }
+    m_state.store(READY, std::memory_order_release);
+}
+
+void Fiber::acquireSharedStack() {
+    // 在其他线程上换入会覆盖那个线程的协程正在使用的栈，不能只靠assert
+    if (m_pool != t_shared_stacks) {
+        std::cerr << "shared stack fiber " << m_id
+                  << " resumed on a thread that does not own its stack"
+                  << std::endl;
+        abort();
+    }
+    SharedStack *s = m_shared;
+    // 只有本线程会把occupant设为自己，相等时不需要加锁
+    if (s->occupant.load(std::memory_order_relaxed) != this) {
+        Spinlock::Lock lock(s->lock);
+        Fiber *old = s->occupant.load(std::memory_order_relaxed);
+        if (old) {
+            old->saveStack();
+        }
+        s->occupant.store(this, std::memory_order_relaxed);
+        if (!m_need_make && m_save_size) {
+            char *top = static_cast<char *>(m_stack) + m_stacksize;
+            memcpy(top - m_save_size, m_save_buffer, m_save_size);
+        }
     }
+    if (m_need_make) {
+        m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc);
+        m_need_make = false;
+    }
+}
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+void Fiber::saveStack() {
+    // 已经结束或者还没运行过的协程栈上没有需要保留的内容
+    if (m_state.load(std::memory_order_relaxed) == TERM || m_need_make) {
+        m_save_size = 0;
+        return;
+    }
+    char *top = static_cast<char *>(m_stack) + m_stacksize;
+    size_t used = top - static_cast<char *>(m_ctx.sp());
+    // 保存区按实际使用量分配，过大时收缩，避免长期占用峰值内存
+    if (m_save_capacity < used || m_save_capacity > used * 2) {
+        free(m_save_buffer);
+        SavedStackBytes().sub(m_save_capacity);
+        m_save_buffer = static_cast<char *>(malloc(used));
+        m_save_capacity = used;
+        SavedStackBytes().add(m_save_capacity);
+    }
+    memcpy(m_save_buffer, top - used, used);
+    m_save_size = used;
+}
 
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
-    m_state = READY;
+/**
+ * 参与调度的协程和调度协程交换，不参与调度的协程和线程主协程交换，
+ * 没有调度器的线程上调度协程就是主协程
+ */
+Fiber *Fiber::GetReturnFiber(bool run_in_scheduler) {
+    if (run_in_scheduler) {
+        Fiber *f = Scheduler::GetSchedulerFiber();
+        if (f) {
+            return f;
+        }
+    }
+    return t_thread_fiber.get();
 }
 
 // 子协程的resume操作一定是在主协程里执行的
 void Fiber::resume() {
-    std::cout << "id: " << this->GetFiberId() << " resume()" << std::endl;
+    CORO_TRACE(m_id, RESUME);
+    if (m_shared) {
+        acquireSharedStack();
+    }
     SetThis(this);
-    m_state = RUNNING;
+    m_state.store(RUNNING, std::memory_order_relaxed);
     if (m_run_in_scheduler) {
-        if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
-        }
+        GetReturnFiber(true)->m_ctx.swapTo(m_ctx);
     } else {
-        if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
-        }
+        t_thread_fiber->m_ctx.swapTo(m_ctx);
+    }
+    // 回到这里时协程的上下文已经保存完毕，这时才能让其他线程看到READY状态并resume它
+    if (m_state.load(std::memory_order_relaxed) == RUNNING) {
+        m_state.store(READY, std::memory_order_release);
     }
 }
 
 // 主协程的resume操作一定是在子协程里执行的
 void Fiber::yield() {
-    std::cout << "id: " << this->GetFiberId() << " yield()" << std::endl;
-    SetThis(t_thread_fiber.get());
-    if (m_state != TERM) {
-        m_state = READY;
-    }
-    if (m_run_in_scheduler) {
-        if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
-        }
-    } else {
-        if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
-        }
-    }
+    CORO_TRACE(m_id, YIELD);
+    Fiber *ret = GetReturnFiber(m_run_in_scheduler);
+    SetThis(ret);
+    m_ctx.swapTo(ret->m_ctx);
 }
 
 /**
@@ -168,7 +326,8 @@ void Fiber::MainFunc() {
 
     cur->m_cb();
     cur->m_cb = nullptr;
-    cur->m_state = TERM;
+    cur->m_state.store(TERM, std::memory_order_release);
+    CORO_TRACE(cur->m_id, TERM);
 
     auto raw_ptr = cur.get();  // 手动让t_fiber的引用计数减1
     cur.reset();
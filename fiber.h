@@ -8,13 +8,19 @@
 #define __CORO_FIBER_H__
 
 #include <stdlib.h>
-#include <ucontext.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
+#include "context.h"
+
 namespace coro {
 
+class Scheduler;
+struct SharedStack;
+class SharedStackPool;
+
 /**
  * @brief 协程类
  */
@@ -42,9 +48,13 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
      * @param[in] cb 协程入口函数
      * @param[in] stacksize 栈大小
      * @param[in] run_in_scheduler 本协程是否参与调度器调度，默认为true
+     * @param[in] use_shared_stack 是否运行在线程的共享栈上，默认为false
+     * @details 共享栈模式下stacksize被忽略，协程运行在当前线程的几个大栈之一上，
+     * 被其他协程换出时只把已使用的部分拷贝到按需分配的保存区。
+     * 共享栈协程只能在创建它的线程上resume，可以在任意线程上析构
      */
     Fiber(std::function<void()> cb, size_t stacksize = 0,
-          bool run_in_scheduler = true);
+          bool run_in_scheduler = true, bool use_shared_stack = false);
 
     /**
      * @brief 析构函数
@@ -67,7 +77,8 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
     /**
      * @brief 当前协程让出执行权
      * @details
-     * 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING
+     * 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING。
+     * 状态在上下文保存完成、resume返回时才变为READY，其他线程看到READY时可以安全地resume
      */
     void yield();
 
@@ -79,7 +90,32 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
     /**
      * @brief 获取协程状态
      */
-    State getState() const { return m_state; }
+    State getState() const { return m_state.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 是否运行在共享栈上
+     */
+    bool isSharedStack() const { return m_shared != nullptr; }
+
+    /**
+     * @brief 协程只能运行在哪个调度线程上，共享栈协程固定在创建它的调度线程，其他为-1
+     */
+    int getThread() const { return m_thread; }
+
+    /**
+     * @brief 共享栈协程所属的调度器，非共享栈或者不是在调度线程上创建时为nullptr
+     */
+    Scheduler* getScheduler() const { return m_scheduler; }
+
+    /**
+     * @brief 是否参与调度器调度，线程主协程返回false
+     */
+    bool isRunInScheduler() const { return m_run_in_scheduler; }
+
+    /**
+     * @brief 获取共享栈协程当前保存在保存区里的栈字节数
+     */
+    size_t getSavedStackSize() const { return m_save_size; }
 
    public:
     /**
@@ -102,6 +138,11 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
      */
     static uint64_t TotalFibers();
 
+    /**
+     * @brief 获取所有共享栈协程保存区占用的总字节数
+     */
+    static uint64_t TotalSavedStackBytes();
+
     /**
      * @brief 协程入口函数
      */
@@ -112,21 +153,52 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
      */
     static uint64_t GetFiberId();
 
+   private:
+    /**
+     * @brief 共享栈协程切入前占用共享栈，必要时换出原来的协程并恢复自己的栈
+     */
+    void acquireSharedStack();
+
+    /**
+     * @brief 把共享栈上已使用的部分拷贝到保存区
+     */
+    void saveStack();
+
+    /**
+     * @brief 返回resume/yield时与之交换的协程
+     */
+    static Fiber* GetReturnFiber(bool run_in_scheduler);
+
    private:
     // 协程id
     uint64_t m_id = 0;
     // 协程栈大小
     uint32_t m_stacksize = 0;
-    // 协程状态
-    State m_state = READY;
+    // 协程状态，调度线程会读取其他线程上协程的状态，READY和TERM用release发布
+    std::atomic<State> m_state{READY};
     // 协程上下文
-    ucontext_t m_ctx;
+    Context m_ctx;
     // 协程栈地址
     void* m_stack = nullptr;
     // 协程入口函数
     std::function<void()> m_cb;
     // 本协程是否参与调度器调度
-    bool m_run_in_scheduler;
+    bool m_run_in_scheduler = false;
+    // 所在的共享栈，私有栈协程为nullptr
+    SharedStack* m_shared = nullptr;
+    // 共享栈所属的池，协程析构之前保持共享栈有效
+    std::shared_ptr<SharedStackPool> m_pool;
+    // 共享栈协程所属的调度器和调度线程
+    Scheduler* m_scheduler = nullptr;
+    int m_thread = -1;
+    // 共享栈上的初始上下文需要在占用共享栈之后才能创建
+    bool m_need_make = false;
+    // 共享栈保存区
+    char* m_save_buffer = nullptr;
+    // 保存区中有效的栈字节数
+    size_t m_save_size = 0;
+    // 保存区容量
+    size_t m_save_capacity = 0;
 };
 
 }  // namespace coro
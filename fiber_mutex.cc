@@ -0,0 +1,205 @@
+/**
+ * @file fiber_mutex.cc
+ * @brief 协程同步原语实现
+ * @author shawn
+ * @date 2024-07-20
+ */
+#include "fiber_mutex.h"
+
+#include "scheduler.h"
+
+namespace coro {
+
+void FiberWaitQueue::Waiter::wake() {
+    if (fiber) {
+        // 等待者可能还没有yield完成，调度器会等它切换出去之后再resume
+        scheduler->scheduleLock(std::move(fiber));
+    } else {
+        sem->notify();
+    }
+}
+
+bool FiberWaitQueue::CanPark() {
+    // 线程主协程和调度协程不参与调度，yield之后没人能把它们重新加入调度
+    return Scheduler::GetThis() && Fiber::GetThis()->isRunInScheduler();
+}
+
+void FiberWaitQueue::wait(Spinlock& guard, FiberMutex* release) {
+    if (CanPark()) {
+        Fiber::ptr cur = Fiber::GetThis();
+        Waiter waiter;
+        waiter.scheduler = Scheduler::GetThis();
+        waiter.fiber = cur;
+        m_waiters.push_back(std::move(waiter));
+        guard.unlock();
+        if (release) {
+            release->unlock();
+        }
+        Fiber* raw = cur.get();
+        cur.reset();
+        raw->yield();
+        return;
+    }
+
+    Semaphore sem;
+    Waiter waiter;
+    waiter.sem = &sem;
+    m_waiters.push_back(std::move(waiter));
+    guard.unlock();
+    if (release) {
+        release->unlock();
+    }
+    sem.wait();
+}
+
+FiberWaitQueue::Waiter FiberWaitQueue::pop() {
+    Waiter waiter = std::move(m_waiters.front());
+    m_waiters.pop_front();
+    return waiter;
+}
+
+void FiberWaitQueue::popAll(std::deque<Waiter>& waiters) {
+    waiters.swap(m_waiters);
+}
+
+void FiberMutex::lock() {
+    m_guard.lock();
+    if (!m_locked) {
+        m_locked = true;
+        m_guard.unlock();
+        return;
+    }
+    // 被唤醒时锁已经交给了自己
+    m_waiters.wait(m_guard);
+}
+
+bool FiberMutex::tryLock() {
+    Spinlock::Lock lock(m_guard);
+    if (m_locked) {
+        return false;
+    }
+    m_locked = true;
+    return true;
+}
+
+void FiberMutex::unlock() {
+    m_guard.lock();
+    if (m_waiters.empty()) {
+        m_locked = false;
+        m_guard.unlock();
+        return;
+    }
+    FiberWaitQueue::Waiter waiter = m_waiters.pop();
+    m_guard.unlock();
+    waiter.wake();
+}
+
+void FiberRWMutex::rdlock() {
+    m_guard.lock();
+    if (!m_writer && m_writeWaiters.empty()) {
+        ++m_readers;
+        m_guard.unlock();
+        return;
+    }
+    // 唤醒方已经替自己增加了读者计数
+    m_readWaiters.wait(m_guard);
+}
+
+void FiberRWMutex::wrlock() {
+    m_guard.lock();
+    if (!m_writer && m_readers == 0) {
+        m_writer = true;
+        m_guard.unlock();
+        return;
+    }
+    m_writeWaiters.wait(m_guard);
+}
+
+void FiberRWMutex::unlock() {
+    std::deque<FiberWaitQueue::Waiter> waiters;
+    m_guard.lock();
+    bool was_writer = m_writer;
+    if (m_writer) {
+        m_writer = false;
+    } else {
+        --m_readers;
+    }
+    if (m_readers == 0) {
+        if (was_writer && !m_readWaiters.empty()) {
+            // 写者解锁时放行所有在等的读者
+            m_readWaiters.popAll(waiters);
+            m_readers = waiters.size();
+        } else if (!m_writeWaiters.empty()) {
+            m_writer = true;
+            waiters.push_back(m_writeWaiters.pop());
+        } else if (!m_readWaiters.empty()) {
+            m_readWaiters.popAll(waiters);
+            m_readers = waiters.size();
+        }
+    }
+    m_guard.unlock();
+    for (auto& i : waiters) {
+        i.wake();
+    }
+}
+
+void FiberConditionVariable::wait(FiberMutex& mutex) {
+    m_guard.lock();
+    // 先入队再释放mutex，持有mutex后发出的通知不会丢失
+    m_waiters.wait(m_guard, &mutex);
+    mutex.lock();
+}
+
+void FiberConditionVariable::notify_one() {
+    m_guard.lock();
+    if (m_waiters.empty()) {
+        m_guard.unlock();
+        return;
+    }
+    FiberWaitQueue::Waiter waiter = m_waiters.pop();
+    m_guard.unlock();
+    waiter.wake();
+}
+
+void FiberConditionVariable::notify_all() {
+    std::deque<FiberWaitQueue::Waiter> waiters;
+    m_guard.lock();
+    m_waiters.popAll(waiters);
+    m_guard.unlock();
+    for (auto& i : waiters) {
+        i.wake();
+    }
+}
+
+void FiberSemaphore::wait() {
+    m_guard.lock();
+    if (m_count > 0) {
+        --m_count;
+        m_guard.unlock();
+        return;
+    }
+    m_waiters.wait(m_guard);
+}
+
+bool FiberSemaphore::tryWait() {
+    Spinlock::Lock lock(m_guard);
+    if (m_count == 0) {
+        return false;
+    }
+    --m_count;
+    return true;
+}
+
+void FiberSemaphore::notify() {
+    m_guard.lock();
+    if (m_waiters.empty()) {
+        ++m_count;
+        m_guard.unlock();
+        return;
+    }
+    FiberWaitQueue::Waiter waiter = m_waiters.pop();
+    m_guard.unlock();
+    waiter.wake();
+}
+
+}  // namespace coro
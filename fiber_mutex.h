@@ -0,0 +1,235 @@
+/**
+ * @file fiber_mutex.h
+ * @brief 协程互斥锁，读写锁，条件变量，信号量
+ * @author shawn
+ * @date 2024-07-20
+ * @details mutex.h里的锁阻塞的是整个线程，在调度器里会卡住这个线程上的所有协程。
+ *          这里的锁在拿不到时把当前协程加入等待队列并yield回调度器，
+ *          释放方把等待的协程重新加入调度。不在调度器协程里调用时退化成阻塞线程
+ */
+#ifndef __CORO_FIBER_MUTEX_H__
+#define __CORO_FIBER_MUTEX_H__
+
+#include <stdint.h>
+
+#include <deque>
+
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace coro {
+
+class Scheduler;
+class FiberMutex;
+
+/**
+ * @brief 协程等待队列，只能在持有外部Spinlock时操作
+ */
+class FiberWaitQueue {
+   public:
+    /**
+     * @brief 等待者，按值保存，不引用等待者的栈（共享栈协程挂起时栈会被换出）
+     */
+    struct Waiter {
+        /// 协程所在的调度器，线程等待者为nullptr
+        Scheduler* scheduler = nullptr;
+        /// 等待的协程
+        Fiber::ptr fiber;
+        /// 线程等待者的信号量
+        Semaphore* sem = nullptr;
+
+        /**
+         * @brief 唤醒等待者，调用时不应持有guard
+         */
+        void wake();
+    };
+
+    /**
+     * @brief 当前是否运行在可以挂起的调度器协程里
+     */
+    static bool CanPark();
+
+    /**
+     * @brief 把当前协程(或线程)加入队尾，释放guard后挂起，直到被wake
+     * @param[in] guard 调用时已持有，返回时已释放
+     * @param[in] release 不为空时在入队之后、挂起之前释放这个锁
+     */
+    void wait(Spinlock& guard, FiberMutex* release = nullptr);
+
+    /**
+     * @brief 队列是否为空
+     */
+    bool empty() const { return m_waiters.empty(); }
+
+    /**
+     * @brief 等待者数量
+     */
+    size_t size() const { return m_waiters.size(); }
+
+    /**
+     * @brief 取出队首的等待者
+     */
+    Waiter pop();
+
+    /**
+     * @brief 取出所有等待者
+     */
+    void popAll(std::deque<Waiter>& waiters);
+
+   private:
+    std::deque<Waiter> m_waiters;
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 解锁时锁直接交给队首的等待者，等待者被唤醒时已经持有锁，先到先得
+ */
+class FiberMutex : Noncopyable {
+   public:
+    /// 局部锁
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    /**
+     * @brief 加锁，锁被占用时挂起当前协程
+     */
+    void lock();
+
+    /**
+     * @brief 尝试加锁
+     * @return 是否加锁成功
+     */
+    bool tryLock();
+
+    /**
+     * @brief 解锁
+     */
+    void unlock();
+
+   private:
+    /// 保护状态和等待队列
+    Spinlock m_guard;
+    /// 是否已上锁
+    bool m_locked = false;
+    /// 等待队列
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程读写锁
+ * @details 有写者在等待时新来的读者排队，避免写者饿死；
+ *          写者解锁时优先放行所有在等的读者，避免读者饿死
+ */
+class FiberRWMutex : Noncopyable {
+   public:
+    /// 局部读锁
+    typedef ReadScopedLockImpl<FiberRWMutex> ReadLock;
+
+    /// 局部写锁
+    typedef WriteScopedLockImpl<FiberRWMutex> WriteLock;
+
+    /**
+     * @brief 上读锁
+     */
+    void rdlock();
+
+    /**
+     * @brief 上写锁
+     */
+    void wrlock();
+
+    /**
+     * @brief 解锁
+     */
+    void unlock();
+
+   private:
+    /// 保护状态和等待队列
+    Spinlock m_guard;
+    /// 持有读锁的数量
+    uint32_t m_readers = 0;
+    /// 是否有写者持有锁
+    bool m_writer = false;
+    /// 等待的读者
+    FiberWaitQueue m_readWaiters;
+    /// 等待的写者
+    FiberWaitQueue m_writeWaiters;
+};
+
+/**
+ * @brief 协程条件变量，配合FiberMutex使用
+ */
+class FiberConditionVariable : Noncopyable {
+   public:
+    /**
+     * @brief 释放mutex并挂起，被唤醒后重新加锁再返回
+     * @param[in] mutex 调用时已持有
+     */
+    void wait(FiberMutex& mutex);
+
+    /**
+     * @brief 等待直到pred返回true
+     */
+    template <class Predicate>
+    void wait(FiberMutex& mutex, Predicate pred) {
+        while (!pred()) {
+            wait(mutex);
+        }
+    }
+
+    /**
+     * @brief 唤醒一个等待者
+     */
+    void notify_one();
+
+    /**
+     * @brief 唤醒所有等待者
+     */
+    void notify_all();
+
+   private:
+    /// 保护等待队列
+    Spinlock m_guard;
+    /// 等待队列
+    FiberWaitQueue m_waiters;
+};
+
+/**
+ * @brief 协程信号量
+ */
+class FiberSemaphore : Noncopyable {
+   public:
+    /**
+     * @brief 构造函数
+     * @param[in] count 信号量值的大小
+     */
+    FiberSemaphore(uint32_t count = 0) : m_count(count) {}
+
+    /**
+     * @brief 获取信号量，没有时挂起当前协程
+     */
+    void wait();
+
+    /**
+     * @brief 尝试获取信号量
+     * @return 是否获取成功
+     */
+    bool tryWait();
+
+    /**
+     * @brief 释放信号量，有等待者时直接交给队首的等待者
+     */
+    void notify();
+
+   private:
+    /// 保护计数和等待队列
+    Spinlock m_guard;
+    /// 信号量的值
+    uint32_t m_count;
+    /// 等待队列
+    FiberWaitQueue m_waiters;
+};
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,469 @@
+/**
+ * @file hook.cc
+ * @brief hook系统调用实现
+ * @author shawn
+ * @date 2024-06-30
+ */
+#include "hook.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <iostream>
+
+#include "fd_manager.h"
+#include "fiber.h"
+#include "iomanager.h"
+
+namespace coro {
+
+/// 当前线程是否开启hook
+static thread_local bool t_hook_enable = false;
+
+/// connect默认的超时时间，~0ull表示不超时
+static uint64_t s_connect_timeout = ~0ull;
+
+#define HOOK_FUN(XX) \
+    XX(sleep)        \
+    XX(usleep)       \
+    XX(nanosleep)    \
+    XX(socket)       \
+    XX(connect)      \
+    XX(accept)       \
+    XX(read)         \
+    XX(readv)        \
+    XX(recv)         \
+    XX(write)        \
+    XX(writev)       \
+    XX(send)         \
+    XX(close)        \
+    XX(fcntl)        \
+    XX(ioctl)        \
+    XX(getsockopt)   \
+    XX(setsockopt)
+
+/**
+ * @brief 取出被hook的原始函数地址
+ */
+void hook_init() {
+    static bool is_inited = false;
+    if (is_inited) {
+        return;
+    }
+#define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
+    HOOK_FUN(XX);
+#undef XX
+    is_inited = true;
+}
+
+struct _HookIniter {
+    _HookIniter() { hook_init(); }
+};
+
+/// 在main函数之前取出原始函数地址
+static _HookIniter s_hook_initer;
+
+bool is_hook_enable() { return t_hook_enable; }
+
+void set_hook_enable(bool flag) { t_hook_enable = flag; }
+
+}  // namespace coro
+
+/**
+ * @brief 超时条件，定时器和IO事件谁先发生由它裁决
+ */
+struct timer_info {
+    int cancelled = 0;
+};
+
+/**
+ * @brief IO操作的通用模板
+ * @details 非socket、用户设置了非阻塞的fd直接调用原始函数；
+ *          否则调用原始函数，返回EAGAIN时注册事件和超时定时器，让出协程，
+ *          事件就绪后重试，超时返回ETIMEDOUT
+ */
+template <typename OriginFun, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
+                     uint32_t event, int timeout_so, Args &&...args) {
+    if (!coro::t_hook_enable) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    coro::IOManager *iom = coro::IOManager::GetThis();
+    coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(fd);
+    if (!iom || !ctx) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    if (ctx->isClose()) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!ctx->isSocket() || ctx->getUserNonblock()) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    uint64_t to = ctx->getTimeout(timeout_so);
+    std::shared_ptr<timer_info> tinfo(new timer_info);
+
+retry:
+    ssize_t n = fun(fd, std::forward<Args>(args)...);
+    while (n == -1 && errno == EINTR) {
+        n = fun(fd, std::forward<Args>(args)...);
+    }
+    if (n == -1 && errno == EAGAIN) {
+        coro::Timer::ptr timer;
+        std::weak_ptr<timer_info> winfo(tinfo);
+
+        // 超时后取消事件，事件取消时会强制唤醒当前协程
+        if (to != ~0ull) {
+            timer = iom->addConditionTimer(
+                to,
+                [winfo, fd, iom, event]() {
+                    auto t = winfo.lock();
+                    if (!t || t->cancelled) {
+                        return;
+                    }
+                    t->cancelled = ETIMEDOUT;
+                    iom->cancelEvent(fd, (coro::IOManager::Event)(event));
+                },
+                winfo);
+        }
+
+        int rt = iom->addEvent(fd, (coro::IOManager::Event)(event));
+        if (rt) {
+            std::cerr << hook_fun_name << " addEvent(" << fd << ", " << event
+                      << ")" << std::endl;
+            if (timer) {
+                timer->cancel();
+            }
+            return -1;
+        }
+
+        coro::Fiber::GetThis()->yield();
+        if (timer) {
+            timer->cancel();
+        }
+        if (tinfo->cancelled) {
+            errno = tinfo->cancelled;
+            return -1;
+        }
+        goto retry;
+    }
+    return n;
+}
+
+/**
+ * @brief 让出当前协程，ms毫秒后由定时器重新调度
+ * @return 没有IOManager无法挂起时返回false
+ */
+static bool fiber_sleep(uint64_t ms) {
+    coro::IOManager *iom = coro::IOManager::GetThis();
+    if (!iom) {
+        return false;
+    }
+    coro::Fiber::ptr fiber = coro::Fiber::GetThis();
+    iom->addTimer(ms, [iom, fiber]() { iom->scheduleLock(fiber); });
+    fiber.reset();
+    coro::Fiber::GetThis()->yield();
+    return true;
+}
+
+extern "C" {
+#define XX(name) name##_fun name##_f = nullptr;
+HOOK_FUN(XX);
+#undef XX
+
+unsigned int sleep(unsigned int seconds) {
+    if (!coro::t_hook_enable || !fiber_sleep(seconds * 1000)) {
+        return sleep_f(seconds);
+    }
+    return 0;
+}
+
+int usleep(useconds_t usec) {
+    if (!coro::t_hook_enable || !fiber_sleep(usec / 1000)) {
+        return usleep_f(usec);
+    }
+    return 0;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    if (!coro::t_hook_enable) {
+        return nanosleep_f(req, rem);
+    }
+    uint64_t timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
+    if (!fiber_sleep(timeout_ms)) {
+        return nanosleep_f(req, rem);
+    }
+    return 0;
+}
+
+int socket(int domain, int type, int protocol) {
+    if (!coro::t_hook_enable) {
+        return socket_f(domain, type, protocol);
+    }
+    int fd = socket_f(domain, type, protocol);
+    if (fd == -1) {
+        return fd;
+    }
+    coro::FdMgr::GetInstance()->get(fd, true);
+    return fd;
+}
+
+int connect_with_timeout(int fd, const struct sockaddr *addr,
+                         socklen_t addrlen, uint64_t timeout_ms) {
+    if (!coro::t_hook_enable) {
+        return connect_f(fd, addr, addrlen);
+    }
+    coro::IOManager *iom = coro::IOManager::GetThis();
+    coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(fd);
+    if (!ctx || ctx->isClose()) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!iom || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return connect_f(fd, addr, addrlen);
+    }
+
+    // 非阻塞connect，EINPROGRESS时等待可写
+    int n = connect_f(fd, addr, addrlen);
+    if (n == 0) {
+        return 0;
+    } else if (n != -1 || errno != EINPROGRESS) {
+        return n;
+    }
+
+    coro::Timer::ptr timer;
+    std::shared_ptr<timer_info> tinfo(new timer_info);
+    std::weak_ptr<timer_info> winfo(tinfo);
+
+    if (timeout_ms != ~0ull) {
+        timer = iom->addConditionTimer(
+            timeout_ms,
+            [winfo, fd, iom]() {
+                auto t = winfo.lock();
+                if (!t || t->cancelled) {
+                    return;
+                }
+                t->cancelled = ETIMEDOUT;
+                iom->cancelEvent(fd, coro::IOManager::WRITE);
+            },
+            winfo);
+    }
+
+    int rt = iom->addEvent(fd, coro::IOManager::WRITE);
+    if (rt == 0) {
+        coro::Fiber::GetThis()->yield();
+        if (timer) {
+            timer->cancel();
+        }
+        if (tinfo->cancelled) {
+            errno = tinfo->cancelled;
+            return -1;
+        }
+    } else {
+        if (timer) {
+            timer->cancel();
+        }
+        std::cerr << "connect addEvent(" << fd << ", WRITE) error"
+                  << std::endl;
+    }
+
+    // 可写之后通过SO_ERROR取出连接结果
+    int error = 0;
+    socklen_t len = sizeof(int);
+    if (-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+        return -1;
+    }
+    if (!error) {
+        return 0;
+    } else {
+        errno = error;
+        return -1;
+    }
+}
+
+int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
+    return connect_with_timeout(sockfd, addr, addrlen, coro::s_connect_timeout);
+}
+
+int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
+    int fd = do_io(s, accept_f, "accept", coro::IOManager::READ, SO_RCVTIMEO,
+                   addr, addrlen);
+    if (fd >= 0 && coro::t_hook_enable) {
+        coro::FdMgr::GetInstance()->get(fd, true);
+    }
+    return fd;
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    return do_io(fd, read_f, "read", coro::IOManager::READ, SO_RCVTIMEO, buf,
+                 count);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    return do_io(fd, readv_f, "readv", coro::IOManager::READ, SO_RCVTIMEO,
+                 iov, iovcnt);
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    return do_io(sockfd, recv_f, "recv", coro::IOManager::READ, SO_RCVTIMEO,
+                 buf, len, flags);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    return do_io(fd, write_f, "write", coro::IOManager::WRITE, SO_SNDTIMEO,
+                 buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    return do_io(fd, writev_f, "writev", coro::IOManager::WRITE, SO_SNDTIMEO,
+                 iov, iovcnt);
+}
+
+ssize_t send(int s, const void *msg, size_t len, int flags) {
+    return do_io(s, send_f, "send", coro::IOManager::WRITE, SO_SNDTIMEO, msg,
+                 len, flags);
+}
+
+int close(int fd) {
+    if (!coro::t_hook_enable) {
+        return close_f(fd);
+    }
+
+    // 关闭前唤醒所有等待这个fd的协程
+    coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(fd);
+    if (ctx) {
+        auto iom = coro::IOManager::GetThis();
+        if (iom) {
+            iom->cancelAll(fd);
+        }
+        coro::FdMgr::GetInstance()->del(fd);
+    }
+    return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ... /* arg */) {
+    va_list va;
+    va_start(va, cmd);
+    switch (cmd) {
+        case F_SETFL: {
+            int arg = va_arg(va, int);
+            va_end(va);
+            coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(fd);
+            if (!ctx || ctx->isClose() || !ctx->isSocket()) {
+                return fcntl_f(fd, cmd, arg);
+            }
+            // 记录用户的非阻塞设置，系统层面是否非阻塞由hook决定
+            ctx->setUserNonblock(arg & O_NONBLOCK);
+            if (ctx->getSysNonblock()) {
+                arg |= O_NONBLOCK;
+            } else {
+                arg &= ~O_NONBLOCK;
+            }
+            return fcntl_f(fd, cmd, arg);
+        } break;
+        case F_GETFL: {
+            va_end(va);
+            int arg = fcntl_f(fd, cmd);
+            coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(fd);
+            if (!ctx || ctx->isClose() || !ctx->isSocket()) {
+                return arg;
+            }
+            // 返回给用户的是用户自己设置的非阻塞状态
+            if (ctx->getUserNonblock()) {
+                return arg | O_NONBLOCK;
+            } else {
+                return arg & ~O_NONBLOCK;
+            }
+        } break;
+        case F_DUPFD:
+        case F_DUPFD_CLOEXEC:
+        case F_SETFD:
+        case F_SETOWN:
+        case F_SETSIG:
+        case F_SETLEASE:
+        case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+        case F_SETPIPE_SZ:
+#endif
+        {
+            int arg = va_arg(va, int);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        } break;
+        case F_GETFD:
+        case F_GETOWN:
+        case F_GETSIG:
+        case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+        case F_GETPIPE_SZ:
+#endif
+        {
+            va_end(va);
+            return fcntl_f(fd, cmd);
+        } break;
+        case F_SETLK:
+        case F_SETLKW:
+        case F_GETLK: {
+            struct flock *arg = va_arg(va, struct flock *);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        } break;
+        case F_GETOWN_EX:
+        case F_SETOWN_EX: {
+            struct f_owner_exlock *arg = va_arg(va, struct f_owner_exlock *);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        } break;
+        default:
+            va_end(va);
+            return fcntl_f(fd, cmd);
+    }
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+    va_list va;
+    va_start(va, request);
+    void *arg = va_arg(va, void *);
+    va_end(va);
+
+    if (FIONBIO == request) {
+        bool user_nonblock = !!*(int *)arg;
+        coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(d);
+        if (!ctx || ctx->isClose() || !ctx->isSocket()) {
+            return ioctl_f(d, request, arg);
+        }
+        ctx->setUserNonblock(user_nonblock);
+    }
+    return ioctl_f(d, request, arg);
+}
+
+int getsockopt(int sockfd, int level, int optname, void *optval,
+               socklen_t *optlen) {
+    return getsockopt_f(sockfd, level, optname, optval, optlen);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void *optval,
+               socklen_t optlen) {
+    if (!coro::t_hook_enable) {
+        return setsockopt_f(sockfd, level, optname, optval, optlen);
+    }
+    // 收发超时由hook的定时器实现，记录到fd上下文中
+    if (level == SOL_SOCKET) {
+        if (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) {
+            coro::FdCtx::ptr ctx = coro::FdMgr::GetInstance()->get(sockfd);
+            if (ctx) {
+                const timeval *v = (const timeval *)optval;
+                ctx->setTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
+            }
+        }
+    }
+    return setsockopt_f(sockfd, level, optname, optval, optlen);
+}
+}
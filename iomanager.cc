@@ -0,0 +1,607 @@
+/**
+ * @file iomanager.cc
+ * @brief 基于epoll的IO协程调度器实现
+ * @author shawn
+ * @date 2024-06-26
+ */
+#include "iomanager.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+namespace coro {
+
+/// 挂在ring上的epoll fd的poll请求的user_data，和请求指针区分开
+static const uint64_t kEpollUserData = 1;
+
+/// io_uring提交队列长度
+static const unsigned kRingEntries = 256;
+
+/**
+ * @brief 一次io_uring请求，位于发起请求的协程栈上
+ */
+struct UringOp {
+    /// 完成时调度协程的调度器
+    Scheduler* scheduler = nullptr;
+    /// 等待完成的协程
+    Fiber::ptr fiber;
+    /// 内核返回的结果
+    int res = 0;
+};
+
+IOManager::FdContext::EventContext& IOManager::FdContext::getEventContext(
+    IOManager::Event event) {
+    switch (event) {
+        case IOManager::READ:
+            return read;
+        case IOManager::WRITE:
+            return write;
+        default:
+            assert(false);
+    }
+    throw std::invalid_argument("getContext invalid event");
+}
+
+void IOManager::FdContext::resetEventContext(EventContext& ctx) {
+    ctx.scheduler = nullptr;
+    ctx.fiber.reset();
+    ctx.cb = nullptr;
+}
+
+void IOManager::FdContext::triggerEvent(IOManager::Event event) {
+    // 待触发的事件必须已被注册过
+    assert(events & event);
+    // 事件是一次性的，触发后删除，想持续关注需要重新注册
+    events = (Event)(events & ~event);
+    EventContext& ctx = getEventContext(event);
+    if (ctx.cb) {
+        ctx.scheduler->scheduleLock(std::move(ctx.cb));
+    } else {
+        ctx.scheduler->scheduleLock(std::move(ctx.fiber));
+    }
+    resetEventContext(ctx);
+}
+
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name,
+                     Backend backend)
+    : Scheduler(threads, use_caller, name) {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd < 0) {
+        throw std::logic_error("epoll_create1 error");
+    }
+
+    m_tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_tickleFd < 0) {
+        throw std::logic_error("eventfd error");
+    }
+
+    // eventfd的data.ptr为空，和fd上下文区分开
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd, &event)) {
+        throw std::logic_error("epoll_ctl eventfd error");
+    }
+
+    contextResize(32);
+
+    if (backend == IO_URING) {
+        m_ring.reset(IoUring::Create(kRingEntries));
+        if (m_ring) {
+            armEpoll();
+        } else {
+            std::cerr << "io_uring unavailable, fall back to epoll" << std::endl;
+        }
+    }
+
+    start();
+}
+
+IOManager::~IOManager() {
+    stop();
+    m_ring.reset();
+    close(m_epfd);
+    close(m_tickleFd);
+
+    for (size_t i = 0; i < m_fdContexts.size(); ++i) {
+        delete m_fdContexts[i];
+    }
+}
+
+void IOManager::contextResize(size_t size) {
+    if (size <= m_fdContexts.size()) {
+        return;
+    }
+    size_t old = m_fdContexts.size();
+    m_fdContexts.resize(size);
+
+    for (size_t i = old; i < m_fdContexts.size(); ++i) {
+        m_fdContexts[i] = new FdContext;
+        m_fdContexts[i]->fd = i;
+    }
+}
+
+int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
+    // 找到fd对应的FdContext，如果不存在，那就分配一个
+    FdContext* fd_ctx = nullptr;
+    RWMutexType::ReadLock lock(m_mutex);
+    if ((int)m_fdContexts.size() > fd) {
+        fd_ctx = m_fdContexts[fd];
+        lock.unlock();
+    } else {
+        lock.unlock();
+        RWMutexType::WriteLock lock2(m_mutex);
+        contextResize(fd * 3 / 2 + 1);
+        fd_ctx = m_fdContexts[fd];
+    }
+
+    // 同一个fd不允许重复添加相同的事件
+    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if (fd_ctx->events & event) {
+        std::cerr << "addEvent assert fd=" << fd << " event=" << event
+                  << " fd_ctx.event=" << fd_ctx->events << std::endl;
+        return -1;
+    }
+
+    // 将新的事件加入epoll_wait，使用epoll_event的私有指针存储FdContext的位置
+    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    epoll_event epevent;
+    epevent.events = EPOLLET | fd_ctx->events | event;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    if (rt) {
+        std::cerr << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                  << ", " << epevent.events << "):" << rt << " (" << errno
+                  << ") (" << strerror(errno) << ")" << std::endl;
+        return -1;
+    }
+
+    // 待执行IO事件数加1
+    ++m_pendingEventCount;
+
+    // 找到这个fd的event事件对应的EventContext，对其中的scheduler, cb,
+    // fiber进行赋值
+    fd_ctx->events = (Event)(fd_ctx->events | event);
+    FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+    assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
+
+    // 不在调度线程上注册的事件交给本调度器执行
+    event_ctx.scheduler = Scheduler::GetThis() ? Scheduler::GetThis() : this;
+    if (cb) {
+        event_ctx.cb.swap(cb);
+    } else {
+        event_ctx.fiber = Fiber::GetThis();
+        assert(event_ctx.fiber->getState() == Fiber::RUNNING);
+    }
+    return 0;
+}
+
+bool IOManager::delEvent(int fd, Event event) {
+    // 找到fd对应的FdContext
+    RWMutexType::ReadLock lock(m_mutex);
+    if ((int)m_fdContexts.size() <= fd) {
+        return false;
+    }
+    FdContext* fd_ctx = m_fdContexts[fd];
+    lock.unlock();
+
+    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if (!(fd_ctx->events & event)) {
+        return false;
+    }
+
+    // 清除指定的事件，表示不关心这个事件了，如果清除之后结果为0，则从epoll_wait中删除该文件描述符
+    Event new_events = (Event)(fd_ctx->events & ~event);
+    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = EPOLLET | new_events;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    if (rt) {
+        std::cerr << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                  << ", " << epevent.events << "):" << rt << " (" << errno
+                  << ") (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    // 待执行事件数减1
+    --m_pendingEventCount;
+    // 重置该fd对应的event事件上下文
+    fd_ctx->events = new_events;
+    FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
+    fd_ctx->resetEventContext(event_ctx);
+    return true;
+}
+
+bool IOManager::cancelEvent(int fd, Event event) {
+    // 找到fd对应的FdContext
+    RWMutexType::ReadLock lock(m_mutex);
+    if ((int)m_fdContexts.size() <= fd) {
+        return false;
+    }
+    FdContext* fd_ctx = m_fdContexts[fd];
+    lock.unlock();
+
+    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if (!(fd_ctx->events & event)) {
+        return false;
+    }
+
+    // 删除事件
+    Event new_events = (Event)(fd_ctx->events & ~event);
+    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = EPOLLET | new_events;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    if (rt) {
+        std::cerr << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                  << ", " << epevent.events << "):" << rt << " (" << errno
+                  << ") (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    // 删除之前触发一次事件
+    fd_ctx->triggerEvent(event);
+    // 活跃事件数减1
+    --m_pendingEventCount;
+    return true;
+}
+
+bool IOManager::cancelAll(int fd) {
+    // 找到fd对应的FdContext
+    RWMutexType::ReadLock lock(m_mutex);
+    if ((int)m_fdContexts.size() <= fd) {
+        return false;
+    }
+    FdContext* fd_ctx = m_fdContexts[fd];
+    lock.unlock();
+
+    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if (!fd_ctx->events) {
+        return false;
+    }
+
+    // 删除全部事件
+    int op = EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = 0;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+    if (rt) {
+        std::cerr << "epoll_ctl(" << m_epfd << ", " << op << ", " << fd
+                  << ", " << epevent.events << "):" << rt << " (" << errno
+                  << ") (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    // 触发全部已注册的事件
+    if (fd_ctx->events & READ) {
+        fd_ctx->triggerEvent(READ);
+        --m_pendingEventCount;
+    }
+    if (fd_ctx->events & WRITE) {
+        fd_ctx->triggerEvent(WRITE);
+        --m_pendingEventCount;
+    }
+
+    assert(fd_ctx->events == 0);
+    return true;
+}
+
+IOManager* IOManager::GetThis() {
+    return dynamic_cast<IOManager*>(Scheduler::GetThis());
+}
+
+/**
+ * 通知调度协程、也就是Scheduler::run()从idle中退出
+ * Scheduler::run()每次从idle协程中退出之后，都会重新把任务队列里的所有任务执行完了再重新进入idle
+ * 如果没有调度线程处于idle状态，那也就没必要发通知了
+ */
+void IOManager::tickle() {
+    if (!hasIdleThreads()) {
+        return;
+    }
+    uint64_t one = 1;
+    int rt = write(m_tickleFd, &one, sizeof(one));
+    (void)rt;
+}
+
+bool IOManager::stopping() {
+    return m_pendingEventCount == 0 && !hasTimer() && Scheduler::stopping();
+}
+
+void IOManager::onTimerInsertedAtFront() { tickle(); }
+
+/**
+ * 调度器无调度任务时会阻塞idle协程上，对IO调度器而言，idle状态应该关注两件事，一是有没有新的调度任务，对应Schduler::schedule()，
+ * 如果有新的调度任务，那应该立即退出idle状态，并执行对应的任务；二是关注当前注册的所有IO事件有没有触发，如果有触发，那么应该执行
+ * IO事件对应的回调函数
+ */
+void IOManager::idle() {
+    // 一次epoll_wait最多检测256个就绪事件，如果就绪事件超过了这个数，那么会在下轮epoll_wati继续处理
+    const uint64_t MAX_EVNETS = 256;
+    std::unique_ptr<epoll_event[]> events(new epoll_event[MAX_EVNETS]);
+
+    while (true) {
+        if (stopping()) {
+            // 边缘触发的eventfd一次只唤醒一个线程，退出前接力唤醒下一个idle线程
+            tickle();
+            break;
+        }
+
+        // 阻塞在epoll_wait上，等待事件发生或者最近一个定时器超时
+        static const uint64_t MAX_TIMEOUT = 5000;
+        uint64_t next_timeout = std::min(getNextTimer(), MAX_TIMEOUT);
+        int rt = 0;
+        if (m_ring) {
+            rt = waitRing(events.get(), MAX_EVNETS, next_timeout);
+        } else {
+            do {
+                rt = epoll_wait(m_epfd, events.get(), MAX_EVNETS,
+                                (int)next_timeout);
+            } while (rt < 0 && errno == EINTR);
+        }
+
+        // 收集所有已超时的定时器，执行回调函数
+        std::vector<std::function<void()>> cbs;
+        listExpiredCb(cbs);
+        for (auto& cb : cbs) {
+            scheduleLock(std::move(cb));
+        }
+        cbs.clear();
+
+        handleEvents(events.get(), rt);
+
+        /**
+         * 一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
+         * 上面triggerEvent实际也只是把对应的fiber重新加入调度，要执行的话还要等idle协程退出
+         */
+        Fiber::GetThis()->yield();
+    }
+}
+
+void IOManager::handleEvents(epoll_event* events, int count) {
+    // 遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
+    for (int i = 0; i < count; ++i) {
+        epoll_event& event = events[i];
+        if (!event.data.ptr) {
+            // eventfd用于通知协程调度，这时读出计数即可，本轮idle结束Scheduler::run会重新执行协程调度
+            uint64_t dummy;
+            while (read(m_tickleFd, &dummy, sizeof(dummy)) > 0)
+                ;
+            continue;
+        }
+
+        FdContext* fd_ctx = (FdContext*)event.data.ptr;
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        /**
+         * EPOLLERR: 出错，比如写读端已经关闭的pipe
+         * EPOLLHUP: 套接字对端关闭
+         * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执行不到的情况
+         */
+        if (event.events & (EPOLLERR | EPOLLHUP)) {
+            event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+        }
+        int real_events = NONE;
+        if (event.events & EPOLLIN) {
+            real_events |= READ;
+        }
+        if (event.events & EPOLLOUT) {
+            real_events |= WRITE;
+        }
+
+        if ((fd_ctx->events & real_events) == NONE) {
+            continue;
+        }
+
+        // 剔除已经发生的事件，将剩下的事件重新加入epoll_wait，
+        // 如果剩下的事件为0，表示这个fd已经不需要关注了，直接从epoll中删除
+        int left_events = (fd_ctx->events & ~real_events);
+        int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        event.events = EPOLLET | left_events;
+
+        int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
+        if (rt2) {
+            std::cerr << "epoll_ctl(" << m_epfd << ", " << op << ", "
+                      << fd_ctx->fd << ", " << event.events << "):" << rt2
+                      << " (" << errno << ") (" << strerror(errno) << ")"
+                      << std::endl;
+            continue;
+        }
+
+        // 处理已经发生的事件，也就是让调度器调度指定的函数或协程
+        if (real_events & READ) {
+            fd_ctx->triggerEvent(READ);
+            --m_pendingEventCount;
+        }
+        if (real_events & WRITE) {
+            fd_ctx->triggerEvent(WRITE);
+            --m_pendingEventCount;
+        }
+    }
+}
+
+void IOManager::armEpoll() {
+    io_uring_sqe* sqe = m_ring->getSqe();
+    if (!sqe) {
+        // 提交队列已满，先把已有的请求交给内核
+        m_ring->enter(m_ring->flush(), 0);
+        sqe = m_ring->getSqe();
+    }
+    if (!sqe) {
+        std::cerr << "io_uring arm epoll fd failed" << std::endl;
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_epfd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = kEpollUserData;
+}
+
+int IOManager::waitRing(epoll_event* events, int max_events,
+                        uint64_t timeout_ms) {
+    // 协程提交的请求在这里批量交给内核，和等待完成合并成一次系统调用
+    unsigned to_submit = 0;
+    {
+        Spinlock::Lock lock(m_sqMutex);
+        to_submit = m_ring->flush();
+    }
+    int rt = m_ring->enter(to_submit, 1, timeout_ms);
+    if (rt < 0 && rt != -ETIME && rt != -EBUSY) {
+        std::cerr << "io_uring_enter error: " << strerror(-rt) << std::endl;
+    }
+
+    static const unsigned MAX_CQES = 64;
+    io_uring_cqe cqes[MAX_CQES];
+    bool epoll_ready = false;
+    while (true) {
+        unsigned n = 0;
+        {
+            Spinlock::Lock lock(m_cqMutex);
+            n = m_ring->peekCqes(cqes, MAX_CQES);
+        }
+        if (n == 0) {
+            break;
+        }
+        for (unsigned i = 0; i < n; ++i) {
+            if (cqes[i].user_data == kEpollUserData) {
+                epoll_ready = true;
+                continue;
+            }
+            // 先取出需要的字段，协程被调度之后UringOp随时可能失效
+            UringOp* op = (UringOp*)cqes[i].user_data;
+            Scheduler* scheduler = op->scheduler;
+            Fiber::ptr fiber = std::move(op->fiber);
+            op->res = cqes[i].res;
+            scheduler->scheduleLock(std::move(fiber));
+            --m_pendingEventCount;
+        }
+    }
+
+    if (!epoll_ready) {
+        return 0;
+    }
+    // epoll fd可读时取出就绪事件，poll请求是一次性的，处理完重新挂上去
+    do {
+        rt = epoll_wait(m_epfd, events, max_events, 0);
+    } while (rt < 0 && errno == EINTR);
+    {
+        // 立即提交，否则在下一次有线程进入waitRing之前没人监听epoll fd，
+        // 阻塞在io_uring_enter上的线程收不到tickle和socket就绪通知
+        Spinlock::Lock lock(m_sqMutex);
+        armEpoll();
+        m_ring->enter(m_ring->flush(), 0);
+    }
+    return rt;
+}
+
+bool IOManager::useRing() const {
+    // 共享栈协程挂起时栈会被其他协程覆盖，内核不能写它栈上的缓冲区和UringOp
+    return m_ring && !Fiber::GetThis()->isSharedStack();
+}
+
+int IOManager::submitSqe(uint8_t opcode, int fd, const void* addr,
+                         uint32_t len, uint64_t off, uint32_t op_flags) {
+    UringOp op;
+    op.scheduler = Scheduler::GetThis() ? Scheduler::GetThis() : this;
+    op.fiber = Fiber::GetThis();
+    {
+        Spinlock::Lock lock(m_sqMutex);
+        io_uring_sqe* sqe = m_ring->getSqe();
+        if (!sqe) {
+            m_ring->enter(m_ring->flush(), 0);
+            sqe = m_ring->getSqe();
+        }
+        if (!sqe) {
+            return -EBUSY;
+        }
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->rw_flags = op_flags;
+        sqe->user_data = (uint64_t)&op;
+        ++m_pendingEventCount;
+        // 有线程阻塞在io_uring_enter上时立即提交，否则留给下一个进入idle的线程批量提交
+        if (hasIdleThreads()) {
+            m_ring->enter(m_ring->flush(), 0);
+        }
+    }
+    Fiber::GetThis()->yield();
+    return op.res;
+}
+
+ssize_t IOManager::submitRead(int fd, void* buf, size_t len, uint64_t offset) {
+    if (!useRing()) {
+        return offset == ~0ull ? ::read(fd, buf, len)
+                               : ::pread(fd, buf, len, offset);
+    }
+    // 偏移为-1时内核使用文件的当前位置
+    int rt = submitSqe(IORING_OP_READ, fd, buf, len, offset);
+    if (rt < 0) {
+        errno = -rt;
+        return -1;
+    }
+    return rt;
+}
+
+ssize_t IOManager::submitWrite(int fd, const void* buf, size_t len,
+                               uint64_t offset) {
+    if (!useRing()) {
+        return offset == ~0ull ? ::write(fd, buf, len)
+                               : ::pwrite(fd, buf, len, offset);
+    }
+    int rt = submitSqe(IORING_OP_WRITE, fd, buf, len, offset);
+    if (rt < 0) {
+        errno = -rt;
+        return -1;
+    }
+    return rt;
+}
+
+int IOManager::submitAccept(int fd, sockaddr* addr, socklen_t* addrlen) {
+    if (!useRing()) {
+        return ::accept(fd, addr, addrlen);
+    }
+    // addrlen通过off(addr2)字段传递
+    int rt = submitSqe(IORING_OP_ACCEPT, fd, addr, 0, (uint64_t)addrlen,
+                       SOCK_CLOEXEC);
+    if (rt < 0) {
+        errno = -rt;
+        return -1;
+    }
+    return rt;
+}
+
+void IOManager::submitTimeout(uint64_t ms) {
+    if (!useRing()) {
+        Fiber::ptr fiber = Fiber::GetThis();
+        addTimer(ms, [this, fiber]() { scheduleLock(fiber); });
+        fiber.reset();
+        Fiber::GetThis()->yield();
+        return;
+    }
+    __kernel_timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = ms % 1000 * 1000 * 1000;
+    // 超时正常结束时返回-ETIME
+    submitSqe(IORING_OP_TIMEOUT, -1, &ts, 1, 0);
+}
+
+}  // namespace coro
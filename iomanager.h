@@ -0,0 +1,264 @@
+/**
+ * @file iomanager.h
+ * @brief 基于epoll的IO协程调度器
+ * @author shawn
+ * @date 2024-06-26
+ */
+#ifndef __CORO_IOMANAGER_H__
+#define __CORO_IOMANAGER_H__
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mutex.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "uring.h"
+
+namespace coro {
+
+/**
+ * @brief IO协程调度器
+ * @details 在Scheduler的基础上支持fd读写事件：事件就绪时把注册时的协程或回调函数重新加入调度。
+ *          空闲线程阻塞在epoll_wait上，有新任务时通过eventfd唤醒，超时时间取最近的定时器。
+ *          使用io_uring后端时空闲线程改为阻塞在io_uring_enter上，epoll fd本身作为一个poll请求挂在ring上，
+ *          协程还可以通过submitRead/submitWrite等直接提交IO，完成后被重新调度
+ */
+class IOManager : public Scheduler, public TimerManager {
+   public:
+    typedef std::shared_ptr<IOManager> ptr;
+    typedef RWMutex RWMutexType;
+
+    /**
+     * @brief IO事件，取值和epoll保持一致
+     */
+    enum Event {
+        /// 无事件
+        NONE = 0x0,
+        /// 读事件(EPOLLIN)
+        READ = 0x1,
+        /// 写事件(EPOLLOUT)
+        WRITE = 0x4,
+    };
+
+    /**
+     * @brief 空闲线程等待IO的后端
+     */
+    enum Backend {
+        /// epoll_wait等待就绪事件
+        EPOLL = 0,
+        /// io_uring_enter等待完成事件，内核不支持时回退到EPOLL
+        IO_URING = 1,
+    };
+
+   private:
+    /**
+     * @brief fd上下文
+     * @details 每个fd最多注册一个读事件和一个写事件
+     */
+    struct FdContext {
+        typedef Mutex MutexType;
+
+        /**
+         * @brief 事件上下文，事件触发时调度fiber或者cb
+         */
+        struct EventContext {
+            /// 执行事件的调度器
+            Scheduler* scheduler = nullptr;
+            /// 事件协程
+            Fiber::ptr fiber;
+            /// 事件回调函数
+            std::function<void()> cb;
+        };
+
+        /**
+         * @brief 获取事件上下文
+         */
+        EventContext& getEventContext(Event event);
+
+        /**
+         * @brief 重置事件上下文
+         */
+        void resetEventContext(EventContext& ctx);
+
+        /**
+         * @brief 触发事件，事件从已注册事件中删除并调度对应的协程或回调
+         */
+        void triggerEvent(Event event);
+
+        /// 读事件上下文
+        EventContext read;
+        /// 写事件上下文
+        EventContext write;
+        /// 事件关联的fd
+        int fd = 0;
+        /// 已注册的事件
+        Event events = NONE;
+        /// 事件的Mutex
+        MutexType mutex;
+    };
+
+   public:
+    /**
+     * @brief 构造函数，创建后调度器即开始运行
+     * @param[in] threads 线程数量
+     * @param[in] use_caller 是否将调用线程包含进去
+     * @param[in] name 调度器的名称
+     * @param[in] backend 等待IO的后端
+     */
+    IOManager(size_t threads = 1, bool use_caller = true,
+              const std::string& name = "IOManager", Backend backend = EPOLL);
+
+    /**
+     * @brief 析构函数，等待所有任务和事件完成
+     */
+    ~IOManager();
+
+    /**
+     * @brief 添加事件
+     * @param[in] fd socket句柄
+     * @param[in] event 事件类型
+     * @param[in] cb 事件回调函数，为空时事件触发后恢复当前协程
+     * @return 添加成功返回0，失败返回-1
+     */
+    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+
+    /**
+     * @brief 删除事件，不会触发事件
+     */
+    bool delEvent(int fd, Event event);
+
+    /**
+     * @brief 取消事件，如果事件存在则强制触发
+     */
+    bool cancelEvent(int fd, Event event);
+
+    /**
+     * @brief 取消fd上的所有事件
+     */
+    bool cancelAll(int fd);
+
+    /**
+     * @brief 返回当前的IOManager
+     */
+    static IOManager* GetThis();
+
+    /**
+     * @brief 实际使用的后端
+     */
+    Backend getBackend() const { return m_ring ? IO_URING : EPOLL; }
+
+    /**
+     * @brief 读数据，完成之前当前协程让出
+     * @details io_uring后端提交IORING_OP_READ，epoll后端调用(hook过的)read/pread。
+     *          必须在本调度器的协程中调用，下同。共享栈协程总是走epoll路径
+     * @param[in] offset 文件偏移，~0ull表示从当前位置读
+     * @return 成功返回读到的字节数，失败返回-1并设置errno
+     */
+    ssize_t submitRead(int fd, void* buf, size_t len, uint64_t offset = ~0ull);
+
+    /**
+     * @brief 写数据，完成之前当前协程让出
+     * @param[in] offset 文件偏移，~0ull表示从当前位置写
+     * @return 成功返回写入的字节数，失败返回-1并设置errno
+     */
+    ssize_t submitWrite(int fd, const void* buf, size_t len,
+                        uint64_t offset = ~0ull);
+
+    /**
+     * @brief 接受连接，完成之前当前协程让出
+     * @return 成功返回新连接的fd，失败返回-1并设置errno
+     */
+    int submitAccept(int fd, sockaddr* addr, socklen_t* addrlen);
+
+    /**
+     * @brief 当前协程让出ms毫秒
+     * @details io_uring后端提交IORING_OP_TIMEOUT，epoll后端使用定时器
+     */
+    void submitTimeout(uint64_t ms);
+
+   protected:
+    /**
+     * @brief 有空闲线程阻塞在epoll_wait上时写eventfd唤醒它
+     */
+    void tickle() override;
+
+    /**
+     * @brief 所有任务、事件和定时器都完成后才能停止
+     */
+    bool stopping() override;
+
+    /**
+     * @brief 阻塞在epoll_wait上等待IO事件、定时器超时或者唤醒
+     */
+    void idle() override;
+
+    /**
+     * @brief 有更早的定时器插入时唤醒idle线程重新计算超时时间
+     */
+    void onTimerInsertedAtFront() override;
+
+    /**
+     * @brief 扩大fd上下文数组，只增不减
+     */
+    void contextResize(size_t size);
+
+   private:
+    /**
+     * @brief 处理epoll_wait返回的就绪事件
+     */
+    void handleEvents(epoll_event* events, int count);
+
+    /**
+     * @brief 提交缓冲区中的请求并等待完成事件，调度完成的协程
+     * @param[out] events epoll fd就绪时取出的就绪事件
+     * @return 就绪事件的数量
+     */
+    int waitRing(epoll_event* events, int max_events, uint64_t timeout_ms);
+
+    /**
+     * @brief 把epoll fd作为一次性poll请求挂到ring上，需要持有m_sqMutex
+     */
+    void armEpoll();
+
+    /**
+     * @brief 当前协程能否提交io_uring请求，共享栈协程走epoll路径
+     */
+    bool useRing() const;
+
+    /**
+     * @brief 提交一个io_uring请求并让出当前协程，完成后返回结果
+     * @return 内核返回的结果，失败时为-errno
+     */
+    int submitSqe(uint8_t opcode, int fd, const void* addr, uint32_t len,
+                  uint64_t off, uint32_t op_flags = 0);
+
+   private:
+    /// epoll 文件句柄
+    int m_epfd = -1;
+    /// 用于唤醒idle线程的eventfd
+    int m_tickleFd = -1;
+    /// 等待执行的事件数量
+    std::atomic<size_t> m_pendingEventCount = {0};
+    /// IOManager的Mutex
+    RWMutexType m_mutex;
+    /// socket事件上下文的容器
+    std::vector<FdContext*> m_fdContexts;
+    /// io_uring，为空时使用epoll后端
+    IoUring::ptr m_ring;
+    /// 提交队列只能有一个生产者
+    Spinlock m_sqMutex;
+    /// 完成队列只能有一个消费者
+    Spinlock m_cqMutex;
+};
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,1226 @@
+/**
+ * @file log.cc
+ * @brief 日志模块实现
+ * @author shawn
+ * @date 2024-05-23
+ */
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include "binlog.h"
+
+namespace coro {
+
+/// 单条日志正文的最大长度，超出部分被截断
+static const size_t kMaxContentSize = 64 * 1024;
+/// 格式化后单条日志的最大长度
+static const size_t kMaxLineSize = kMaxContentSize + 1024;
+
+const char* LogLevel::ToString(LogLevel::Level level) {
+    switch (level) {
+#define XX(name)         \
+    case LogLevel::name: \
+        return #name;    \
+        break;
+
+        XX(DEBUG);
+        XX(INFO);
+        XX(WARN);
+        XX(ERROR);
+        XX(FATAL);
+#undef XX
+        default:
+            return "UNKNOW";
+    }
+    return "UNKNOW";
+}
+
+LogLevel::Level LogLevel::FromString(const std::string& str) {
+#define XX(level, v)            \
+    if (str == #v) {            \
+        return LogLevel::level; \
+    }
+    XX(DEBUG, debug);
+    XX(INFO, info);
+    XX(WARN, warn);
+    XX(ERROR, error);
+    XX(FATAL, fatal);
+
+    XX(DEBUG, DEBUG);
+    XX(INFO, INFO);
+    XX(WARN, WARN);
+    XX(ERROR, ERROR);
+    XX(FATAL, FATAL);
+    return LogLevel::UNKNOW;
+#undef XX
+}
+
+LogBuffer::LogBuffer(size_t capacity)
+    : m_data(new char[capacity]), m_capacity(capacity) {}
+
+void LogBuffer::append(const char* str, size_t len) {
+    len = std::min(len, m_capacity - m_size);
+    memcpy(m_data.get() + m_size, str, len);
+    m_size += len;
+}
+
+void LogBuffer::appendUInt(uint64_t v) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    append(p, buf + sizeof(buf) - p);
+}
+
+void LogBuffer::appendInt(int64_t v) {
+    if (v < 0) {
+        append('-');
+        appendUInt(-(uint64_t)v);
+    } else {
+        appendUInt(v);
+    }
+}
+
+LogStream::LogStream(size_t capacity)
+    : m_data(new char[capacity]), m_capacity(capacity), m_os(&m_buf) {
+    reset();
+}
+
+void LogStream::reset() {
+    m_buf.reset(m_data.get(), m_capacity);
+    m_os.clear();
+}
+
+/// 线程私有的日志正文缓冲区
+static thread_local std::unique_ptr<LogStream> t_stream;
+/// t_stream是否正在被使用
+static thread_local bool t_stream_busy = false;
+/// 线程私有的格式化缓冲区
+static thread_local std::unique_ptr<LogBuffer> t_line;
+
+LogEvent::LogEvent(Logger* logger, LogLevel::Level level, const char* file,
+                   int32_t line, uint32_t elapse, uint32_t thread_id,
+                   uint64_t fiber_id, uint64_t time,
+                   const std::string& thread_name)
+    : m_file(file),
+      m_line(line),
+      m_elapse(elapse),
+      m_threadId(thread_id),
+      m_fiberId(fiber_id),
+      m_time(time),
+      m_threadName(thread_name),
+      m_logger(logger),
+      m_level(level) {
+    if (!t_stream_busy) {
+        if (!t_stream) {
+            t_stream.reset(new LogStream(kMaxContentSize));
+        }
+        m_stream = t_stream.get();
+        t_stream_busy = true;
+    } else {
+        m_stream = new LogStream(kMaxContentSize);
+        m_ownStream = true;
+    }
+    m_stream->reset();
+}
+
+LogEvent::~LogEvent() {
+    if (m_ownStream) {
+        delete m_stream;
+    } else {
+        t_stream_busy = false;
+    }
+}
+
+void LogEvent::format(const char* fmt, ...) {
+    char buf[1024];
+    va_list al;
+    va_start(al, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, al);
+    va_end(al);
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len < sizeof(buf)) {
+        getSS().write(buf, len);
+        return;
+    }
+    // 超长的内容才分配内存
+    std::unique_ptr<char[]> big(new char[len + 1]);
+    va_start(al, fmt);
+    vsnprintf(big.get(), len + 1, fmt, al);
+    va_end(al);
+    getSS().write(big.get(), len);
+}
+
+LogEventWrap::LogEventWrap(const std::shared_ptr<Logger>& logger,
+                           LogLevel::Level level, const char* file,
+                           int32_t line, uint32_t elapse, uint32_t thread_id,
+                           uint64_t fiber_id, uint64_t time,
+                           const std::string& thread_name)
+    : m_event(logger.get(), level, file, line, elapse, thread_id, fiber_id,
+              time, thread_name) {}
+
+LogEventWrap::~LogEventWrap() {
+    m_event.getLogger()->log(m_event.getLevel(), m_event);
+}
+
+class MessageFormatItem : public LogFormatter::FormatItem {
+   public:
+    MessageFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append(event.getContent(), event.getContentSize());
+    }
+};
+
+class LevelFormatItem : public LogFormatter::FormatItem {
+   public:
+    LevelFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        const char* str = LogLevel::ToString(level);
+        out.append(str, strlen(str));
+    }
+};
+
+class ElapseFormatItem : public LogFormatter::FormatItem {
+   public:
+    ElapseFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.appendUInt(event.getElapse());
+    }
+};
+
+class NameFormatItem : public LogFormatter::FormatItem {
+   public:
+    NameFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append(event.getLogger()->getName());
+    }
+};
+
+class ThreadIdFormatItem : public LogFormatter::FormatItem {
+   public:
+    ThreadIdFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.appendUInt(event.getThreadId());
+    }
+};
+
+class FiberIdFormatItem : public LogFormatter::FormatItem {
+   public:
+    FiberIdFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.appendUInt(event.getFiberId());
+    }
+};
+
+class ThreadNameFormatItem : public LogFormatter::FormatItem {
+   public:
+    ThreadNameFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append(event.getThreadName());
+    }
+};
+
+/**
+ * @brief 时间格式化
+ * @details 每个线程为每个时间格式项缓存最近一秒的格式化结果，同一秒内的日志直接拷贝，
+ *          strftime每秒最多执行一次
+ */
+class DateTimeFormatItem : public LogFormatter::FormatItem {
+   public:
+    DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S")
+        : m_format(format), m_id(++s_id) {
+        if (m_format.empty()) {
+            m_format = "%Y-%m-%d %H:%M:%S";
+        }
+    }
+
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        time_t sec = event.getTime();
+        // 线程私有的小缓存，按格式项的id区分，不同的Appender使用不同格式时互不覆盖
+        Cache& cache = t_cache[m_id % kCacheSize];
+        if (cache.id != m_id || cache.sec != sec) {
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            cache.len = strftime(cache.buf, sizeof(cache.buf), m_format.c_str(),
+                                 &tm);
+            cache.id = m_id;
+            cache.sec = sec;
+        }
+        out.append(cache.buf, cache.len);
+    }
+
+   private:
+    struct Cache {
+        uint64_t id = 0;
+        time_t sec = -1;
+        size_t len = 0;
+        char buf[64];
+    };
+    static const size_t kCacheSize = 4;
+    static thread_local Cache t_cache[kCacheSize];
+    static std::atomic<uint64_t> s_id;
+
+    /// strftime格式
+    std::string m_format;
+    /// 全局唯一的id，作为线程缓存的key
+    uint64_t m_id;
+};
+
+thread_local DateTimeFormatItem::Cache
+    DateTimeFormatItem::t_cache[DateTimeFormatItem::kCacheSize];
+std::atomic<uint64_t> DateTimeFormatItem::s_id{0};
+
+class FilenameFormatItem : public LogFormatter::FormatItem {
+   public:
+    FilenameFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append(event.getFile(), strlen(event.getFile()));
+    }
+};
+
+class LineFormatItem : public LogFormatter::FormatItem {
+   public:
+    LineFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.appendInt(event.getLine());
+    }
+};
+
+class NewLineFormatItem : public LogFormatter::FormatItem {
+   public:
+    NewLineFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append('\n');
+    }
+};
+
+class StringFormatItem : public LogFormatter::FormatItem {
+   public:
+    StringFormatItem(const std::string& str) : m_string(str) {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append(m_string);
+    }
+
+   private:
+    std::string m_string;
+};
+
+class TabFormatItem : public LogFormatter::FormatItem {
+   public:
+    TabFormatItem(const std::string& str = "") {}
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event) override {
+        out.append('\t');
+    }
+};
+
+LogFormatter::LogFormatter(const std::string& pattern) : m_pattern(pattern) {
+    init();
+}
+
+void LogFormatter::format(LogBuffer& out, Logger* logger,
+                          LogLevel::Level level, const LogEvent& event) {
+    for (auto& i : m_items) {
+        i->format(out, logger, level, event);
+    }
+}
+
+// %xxx %xxx{xxx} %%
+void LogFormatter::init() {
+    // str, format, type(0: 普通字符串, 1: 格式项)
+    std::vector<std::tuple<std::string, std::string, int>> vec;
+    std::string nstr;
+    for (size_t i = 0; i < m_pattern.size(); ++i) {
+        if (m_pattern[i] != '%') {
+            nstr.append(1, m_pattern[i]);
+            continue;
+        }
+
+        if ((i + 1) < m_pattern.size()) {
+            if (m_pattern[i + 1] == '%') {
+                nstr.append(1, '%');
+                ++i;
+                continue;
+            }
+        }
+
+        size_t n = i + 1;
+        int fmt_status = 0;
+        size_t fmt_begin = 0;
+
+        std::string str;
+        std::string fmt;
+        while (n < m_pattern.size()) {
+            if (!fmt_status && (!isalpha(m_pattern[n]) && m_pattern[n] != '{' &&
+                                m_pattern[n] != '}')) {
+                str = m_pattern.substr(i + 1, n - i - 1);
+                break;
+            }
+            if (fmt_status == 0) {
+                if (m_pattern[n] == '{') {
+                    str = m_pattern.substr(i + 1, n - i - 1);
+                    fmt_status = 1;  // 解析格式
+                    fmt_begin = n;
+                    ++n;
+                    continue;
+                }
+            } else if (fmt_status == 1) {
+                if (m_pattern[n] == '}') {
+                    fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);
+                    fmt_status = 0;
+                    ++n;
+                    break;
+                }
+            }
+            ++n;
+            if (n == m_pattern.size()) {
+                if (str.empty()) {
+                    str = m_pattern.substr(i + 1);
+                }
+            }
+        }
+
+        if (fmt_status == 0) {
+            if (!nstr.empty()) {
+                vec.push_back(std::make_tuple(nstr, std::string(), 0));
+                nstr.clear();
+            }
+            vec.push_back(std::make_tuple(str, fmt, 1));
+            i = n - 1;
+        } else if (fmt_status == 1) {
+            std::cerr << "pattern parse error: " << m_pattern << " - "
+                      << m_pattern.substr(i) << std::endl;
+            m_error = true;
+            vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
+        }
+    }
+
+    if (!nstr.empty()) {
+        vec.push_back(std::make_tuple(nstr, "", 0));
+    }
+    static std::map<std::string,
+                    std::function<FormatItem::ptr(const std::string& str)>>
+        s_format_items = {
+#define XX(str, C)                                                             \
+    {                                                                          \
+#str,                                                                  \
+            [](const std::string& fmt) { return FormatItem::ptr(new C(fmt)); } \
+    }
+
+            XX(m, MessageFormatItem),     // m:消息
+            XX(p, LevelFormatItem),       // p:日志级别
+            XX(r, ElapseFormatItem),      // r:累计毫秒数
+            XX(c, NameFormatItem),        // c:日志名称
+            XX(t, ThreadIdFormatItem),    // t:线程id
+            XX(n, NewLineFormatItem),     // n:换行
+            XX(d, DateTimeFormatItem),    // d:时间
+            XX(f, FilenameFormatItem),    // f:文件名
+            XX(l, LineFormatItem),        // l:行号
+            XX(T, TabFormatItem),         // T:Tab
+            XX(F, FiberIdFormatItem),     // F:协程id
+            XX(N, ThreadNameFormatItem),  // N:线程名称
+#undef XX
+        };
+
+    for (auto& i : vec) {
+        if (std::get<2>(i) == 0) {
+            m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+        } else {
+            auto it = s_format_items.find(std::get<0>(i));
+            if (it == s_format_items.end()) {
+                m_items.push_back(FormatItem::ptr(new StringFormatItem(
+                    "<<error_format %" + std::get<0>(i) + ">>")));
+                m_error = true;
+            } else {
+                m_items.push_back(it->second(std::get<1>(i)));
+            }
+        }
+    }
+}
+
+LogAppender::LogAppender() {
+    // 保证刷写线程先于Appender创建，从而晚于它们析构
+    LogFlusherMgr::GetInstance();
+}
+
+void LogAppender::log(Logger* logger, LogLevel::Level level,
+                      const LogEvent& event) {
+    if (level < m_level) {
+        return;
+    }
+    LogFormatter* formatter = formatterSnapshot();
+    if (!formatter) {
+        return;
+    }
+    if (!t_line) {
+        t_line.reset(new LogBuffer(kMaxLineSize));
+    }
+    t_line->clear();
+    formatter->format(*t_line, logger, level, event);
+    LogFlusherMgr::GetInstance()->append(this, t_line->data(), t_line->size(),
+                                         level >= LogLevel::ERROR);
+}
+
+void LogAppender::logBinary(Logger* logger, LogLevel::Level level,
+                            const char* data, size_t len) {
+    if (level < m_level || len < sizeof(BinLog::Record)) {
+        return;
+    }
+    BinLog::Record record;
+    memcpy(&record, data, sizeof(record));
+    const BinLogFormat* format =
+        BinLogRegistryMgr::GetInstance()->get(record.id);
+    if (!format) {
+        return;
+    }
+    LogEvent event(logger, level, format->file.c_str(), format->line, 0,
+                   record.threadId, record.fiberId,
+                   record.time / 1000000000ull, Thread::GetName());
+    std::string msg;
+    BinLog::Format(format->fmt, format->types, data + sizeof(record),
+                   len - sizeof(record), msg);
+    event.getSS().write(msg.c_str(), msg.size());
+    log(logger, level, event);
+}
+
+void LogAppender::setFormatter(LogFormatter::ptr val) {
+    MutexType::Lock lock(m_mutex);
+    m_hasFormatter = val != nullptr;
+    publishFormatter(std::move(val));
+}
+
+LogFormatter* LogAppender::formatterSnapshot() {
+    SnapshotCache& cache = GetSnapshotCache(m_slot);
+    if (cache.version != m_version.load(std::memory_order_acquire)) {
+        MutexType::Lock lock(m_mutex);
+        cache.value = m_formatter;
+        cache.version = m_version.load(std::memory_order_relaxed);
+    }
+    // 格式器本身可以被多个线程同时使用，缓存里只是按只读指针保存
+    return static_cast<LogFormatter*>(const_cast<void*>(cache.value.get()));
+}
+
+void LogAppender::publishFormatter(LogFormatter::ptr val) {
+    m_formatter = std::move(val);
+    m_version.fetch_add(1, std::memory_order_release);
+}
+
+LogFormatter::ptr LogAppender::getFormatter() {
+    MutexType::Lock lock(m_mutex);
+    return m_formatter;
+}
+
+void LogAppender::WritevAll(int fd, const iovec* iov, int iovcnt) {
+    std::vector<iovec> rest(iov, iov + iovcnt);
+    size_t idx = 0;
+    while (idx < rest.size()) {
+        int cnt = std::min<size_t>(rest.size() - idx, IOV_MAX);
+        ssize_t n = writev(fd, &rest[idx], cnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "log writev fd=" << fd << " error: " << strerror(errno)
+                      << std::endl;
+            return;
+        }
+        // 跳过已经写完的部分，从部分写入的位置继续
+        while (n > 0 && idx < rest.size()) {
+            if ((size_t)n >= rest[idx].iov_len) {
+                n -= rest[idx].iov_len;
+                ++idx;
+            } else {
+                rest[idx].iov_base = (char*)rest[idx].iov_base + n;
+                rest[idx].iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+}
+
+StdoutLogAppender::~StdoutLogAppender() { LogFlusherMgr::GetInstance()->flush(); }
+
+void StdoutLogAppender::write(const iovec* iov, int iovcnt) {
+    WritevAll(STDOUT_FILENO, iov, iovcnt);
+}
+
+/// ReopenAll的调用次数，信号处理函数里只做原子加一
+static std::atomic<uint32_t> s_reopenSeq{0};
+
+FileLogAppender::FileLogAppender(const std::string& filename,
+                                 uint64_t max_size, uint32_t rotate_interval)
+    : m_filename(filename),
+      m_maxSize(max_size),
+      m_rotateInterval(rotate_interval),
+      m_reopenSeq(s_reopenSeq.load(std::memory_order_relaxed)) {
+    Mutex::Lock lock(m_fileMutex);
+    openFile();
+}
+
+FileLogAppender::~FileLogAppender() {
+    LogFlusherMgr::GetInstance()->flush();
+    Mutex::Lock lock(m_fileMutex);
+    closeFile();
+}
+
+void FileLogAppender::write(const iovec* iov, int iovcnt) {
+    Mutex::Lock lock(m_fileMutex);
+    uint32_t seq = s_reopenSeq.load(std::memory_order_relaxed);
+    if (seq != m_reopenSeq) {
+        m_reopenSeq = seq;
+        closeFile();
+        openFile();
+    }
+    if (m_fd < 0) {
+        // 打开失败后每秒最多重试一次
+        if (time(0) == m_openFailTime || !openFile()) {
+            return;
+        }
+    }
+    if (m_rotateTime && time(0) >= m_rotateTime) {
+        rotate();
+    }
+
+    uint64_t max_size = m_maxSize.load(std::memory_order_relaxed);
+    for (int i = 0; i < iovcnt && m_fd >= 0; ++i) {
+        if (max_size && m_size > 0 && m_size + iov[i].iov_len > max_size) {
+            rotate();
+            if (m_fd < 0) {
+                return;
+            }
+        }
+        const char* data = (const char*)iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        while (len > 0) {
+            if (!m_map || m_size >= m_mapOffset + kChunkSize) {
+                if (!remap()) {
+                    return;
+                }
+            }
+            size_t n = std::min<uint64_t>(len, m_mapOffset + kChunkSize - m_size);
+            memcpy(m_map + (m_size - m_mapOffset), data, n);
+            m_size += n;
+            data += n;
+            len -= n;
+        }
+    }
+}
+
+bool FileLogAppender::reopen() {
+    Mutex::Lock lock(m_fileMutex);
+    closeFile();
+    return openFile();
+}
+
+void FileLogAppender::setRotateInterval(uint32_t val) {
+    Mutex::Lock lock(m_fileMutex);
+    m_rotateInterval = val;
+    m_rotateTime = nextRotateTime(time(0));
+}
+
+void FileLogAppender::ReopenAll() {
+    s_reopenSeq.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void OnReopenSignal(int signo) { FileLogAppender::ReopenAll(); }
+
+bool FileLogAppender::InstallReopenSignal(int signo) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnReopenSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(signo, &sa, nullptr) == 0;
+}
+
+/**
+ * @brief 跳过文件末尾预分配的0字节，返回实际写入的长度
+ * @details 进程崩溃时没有机会截掉预分配的部分，末尾最多有一个kChunkSize的0
+ */
+static uint64_t LogicalFileSize(int fd, uint64_t size, uint64_t max_scan) {
+    char buf[64 * 1024];
+    uint64_t end = size;
+    uint64_t limit = size > max_scan ? size - max_scan : 0;
+    while (end > limit) {
+        uint64_t begin = end > limit + sizeof(buf) ? end - sizeof(buf) : limit;
+        ssize_t n = pread(fd, buf, end - begin, begin);
+        if (n != (ssize_t)(end - begin)) {
+            return size;
+        }
+        for (ssize_t i = n - 1; i >= 0; --i) {
+            if (buf[i] != '\0') {
+                return begin + i + 1;
+            }
+        }
+        end = begin;
+    }
+    return end;
+}
+
+bool FileLogAppender::openFile() {
+    int fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        std::cerr << "open log file " << m_filename
+                  << " error: " << strerror(errno) << std::endl;
+        m_openFailTime = time(0);
+        return false;
+    }
+    m_fd = fd;
+    // 预分配部分仍算作容量，关闭时截掉
+    m_size = LogicalFileSize(fd, st.st_size,
+                             kChunkSize + sysconf(_SC_PAGESIZE));
+    m_capacity = st.st_size;
+    m_map = nullptr;
+    m_mapOffset = 0;
+    m_rotateTime = nextRotateTime(time(0));
+    return true;
+}
+
+void FileLogAppender::closeFile() {
+    if (m_map) {
+        munmap(m_map, kChunkSize);
+        m_map = nullptr;
+    }
+    if (m_fd < 0) {
+        return;
+    }
+    if (m_capacity != m_size && ftruncate(m_fd, m_size) != 0) {
+        std::cerr << "ftruncate log file " << m_filename
+                  << " error: " << strerror(errno) << std::endl;
+    }
+    close(m_fd);
+    m_fd = -1;
+}
+
+void FileLogAppender::rotate() {
+    closeFile();
+
+    time_t now = time(0);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), ".%Y%m%d-%H%M%S", &tm);
+    std::string target = m_filename + buf;
+    // 同一秒内多次按大小切分时加序号
+    for (int i = 1; access(target.c_str(), F_OK) == 0; ++i) {
+        target = m_filename + buf + "." + std::to_string(i);
+    }
+    if (rename(m_filename.c_str(), target.c_str()) != 0) {
+        std::cerr << "rename log file " << m_filename << " to " << target
+                  << " error: " << strerror(errno) << std::endl;
+    }
+    openFile();
+}
+
+bool FileLogAppender::remap() {
+    if (m_map) {
+        munmap(m_map, kChunkSize);
+        m_map = nullptr;
+    }
+    static const uint64_t s_page = sysconf(_SC_PAGESIZE);
+    uint64_t offset = m_size / s_page * s_page;
+    if (m_capacity < offset + kChunkSize) {
+        // 预先分配磁盘空间，磁盘满时这里返回错误，而不是写映射内存时收到SIGBUS
+        uint64_t capacity = offset + kChunkSize;
+        if (fallocate(m_fd, 0, m_capacity, capacity - m_capacity) != 0) {
+            if (errno != EOPNOTSUPP ||
+                ftruncate(m_fd, capacity) != 0) {
+                std::cerr << "extend log file " << m_filename
+                          << " error: " << strerror(errno) << std::endl;
+                return false;
+            }
+        }
+        m_capacity = capacity;
+    }
+    void* map = mmap(nullptr, kChunkSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     m_fd, offset);
+    if (map == MAP_FAILED) {
+        std::cerr << "mmap log file " << m_filename
+                  << " error: " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_map = (char*)map;
+    m_mapOffset = offset;
+    return true;
+}
+
+time_t FileLogAppender::nextRotateTime(time_t now) const {
+    uint32_t interval = m_rotateInterval.load(std::memory_order_relaxed);
+    if (!interval) {
+        return 0;
+    }
+    // 按本地时间对齐，按天切分时在零点而不是UTC零点
+    struct tm tm;
+    localtime_r(&now, &tm);
+    time_t local = now + tm.tm_gmtoff;
+    return (local / interval + 1) * interval - tm.tm_gmtoff;
+}
+
+Logger::Logger(const std::string& name)
+    : m_name(name),
+      m_level(LogLevel::DEBUG),
+      m_appenders(std::make_shared<const AppenderList>()) {
+    m_formatter.reset(new LogFormatter);
+}
+
+const Logger::AppenderList& Logger::appenderSnapshot() {
+    SnapshotCache& cache = GetSnapshotCache(m_slot);
+    if (cache.version != m_version.load(std::memory_order_acquire)) {
+        MutexType::ReadLock lock(m_mutex);
+        cache.value = m_appenders;
+        cache.version = m_version.load(std::memory_order_relaxed);
+    }
+    return *static_cast<const AppenderList*>(cache.value.get());
+}
+
+void Logger::publishAppenders(std::shared_ptr<const AppenderList> val) {
+    m_appenders = std::move(val);
+    m_version.fetch_add(1, std::memory_order_release);
+}
+
+void Logger::log(LogLevel::Level level, const LogEvent& event) {
+    if (level < m_level) {
+        return;
+    }
+    const AppenderList& appenders = appenderSnapshot();
+    if (!appenders.empty()) {
+        for (auto& i : appenders) {
+            i->log(this, level, event);
+        }
+    } else if (m_root) {
+        m_root->log(level, event);
+    }
+}
+
+void Logger::logBinary(LogLevel::Level level, const char* data, size_t len) {
+    if (level < m_level) {
+        return;
+    }
+    const AppenderList& appenders = appenderSnapshot();
+    if (!appenders.empty()) {
+        for (auto& i : appenders) {
+            i->logBinary(this, level, data, len);
+        }
+    } else if (m_root) {
+        m_root->logBinary(level, data, len);
+    }
+}
+
+void Logger::debug(const LogEvent& event) { log(LogLevel::DEBUG, event); }
+
+void Logger::info(const LogEvent& event) { log(LogLevel::INFO, event); }
+
+void Logger::warn(const LogEvent& event) { log(LogLevel::WARN, event); }
+
+void Logger::error(const LogEvent& event) { log(LogLevel::ERROR, event); }
+
+void Logger::fatal(const LogEvent& event) { log(LogLevel::FATAL, event); }
+
+void Logger::addAppender(LogAppender::ptr appender) {
+    MutexType::WriteLock lock(m_mutex);
+    {
+        LogAppender::MutexType::Lock ll(appender->m_mutex);
+        if (!appender->m_hasFormatter) {
+            appender->publishFormatter(m_formatter);
+        }
+    }
+    std::shared_ptr<AppenderList> list =
+        std::make_shared<AppenderList>(*m_appenders);
+    list->push_back(appender);
+    publishAppenders(std::move(list));
+}
+
+void Logger::delAppender(LogAppender::ptr appender) {
+    MutexType::WriteLock lock(m_mutex);
+    auto it = std::find(m_appenders->begin(), m_appenders->end(), appender);
+    if (it == m_appenders->end()) {
+        return;
+    }
+    std::shared_ptr<AppenderList> list =
+        std::make_shared<AppenderList>(*m_appenders);
+    list->erase(list->begin() + (it - m_appenders->begin()));
+    publishAppenders(std::move(list));
+}
+
+void Logger::clearAppenders() {
+    MutexType::WriteLock lock(m_mutex);
+    publishAppenders(std::make_shared<const AppenderList>());
+}
+
+void Logger::setFormatter(LogFormatter::ptr val) {
+    MutexType::WriteLock lock(m_mutex);
+    m_formatter = val;
+    for (auto& i : *m_appenders) {
+        LogAppender::MutexType::Lock ll(i->m_mutex);
+        if (!i->m_hasFormatter) {
+            i->publishFormatter(m_formatter);
+        }
+    }
+}
+
+void Logger::setFormatter(const std::string& val) {
+    LogFormatter::ptr new_val(new LogFormatter(val));
+    if (new_val->isError()) {
+        std::cerr << "Logger setFormatter name=" << m_name << " value=" << val
+                  << " invalid formatter" << std::endl;
+        return;
+    }
+    setFormatter(new_val);
+}
+
+LogFormatter::ptr Logger::getFormatter() {
+    MutexType::ReadLock lock(m_mutex);
+    return m_formatter;
+}
+
+/**
+ * @brief 单生产者单消费者的字节环形队列
+ * @details 记录是16字节对齐的(头部, 内容)，尾部放不下一条记录时用一条空记录填满，
+ *          从头开始写，所以每条记录在内存中都是连续的，可以直接作为iovec
+ */
+class LogRing : Noncopyable {
+   public:
+    struct Header {
+        /// 为空表示填充记录
+        LogAppender* appender;
+        /// 内容长度
+        uint32_t len;
+        /// 记录占用的总字节数
+        uint32_t size;
+    };
+
+    LogRing(size_t size)
+        : m_buf(new Header[size / sizeof(Header)]),
+          m_size(size),
+          m_mask(size - 1) {}
+
+    /**
+     * @brief 写入一条记录，空间不足时返回false
+     */
+    bool push(LogAppender* appender, const char* data, size_t len) {
+        size_t max_len = m_size / 4 - sizeof(Header);
+        if (len > max_len) {
+            len = max_len;
+        }
+        size_t need = (sizeof(Header) + len + 15) & ~(size_t)15;
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        size_t pos = tail & m_mask;
+        size_t pad = m_size - pos < need ? m_size - pos : 0;
+        if (m_size - (tail - head) < need + pad) {
+            return false;
+        }
+        if (pad) {
+            Header* h = at(tail);
+            h->appender = nullptr;
+            h->len = 0;
+            h->size = pad;
+            tail += pad;
+        }
+        Header* h = at(tail);
+        h->appender = appender;
+        h->len = len;
+        h->size = need;
+        memcpy(h + 1, data, len);
+        m_tail.store(tail + need, std::memory_order_release);
+        return true;
+    }
+
+    Header* at(uint64_t pos) {
+        return (Header*)((char*)m_buf.get() + (pos & m_mask));
+    }
+
+    size_t capacity() const { return m_size; }
+
+    size_t used() const {
+        return m_tail.load(std::memory_order_relaxed) -
+               m_head.load(std::memory_order_relaxed);
+    }
+
+   public:
+    /// 所属线程是否已经退出
+    std::atomic<bool> closed{false};
+    /// 丢弃的日志数
+    std::atomic<uint64_t> dropped{0};
+    /// 消费者位置
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    /// 生产者位置
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+
+   private:
+    std::unique_ptr<Header[]> m_buf;
+    size_t m_size;
+    size_t m_mask;
+};
+
+struct LogFlusher::Notifier {
+    std::mutex mutex;
+    /// 唤醒刷写线程
+    std::condition_variable cond;
+    /// 刷写线程每完成一轮通知一次
+    std::condition_variable flushed;
+};
+
+/**
+ * @brief 线程退出时标记队列关闭，剩余的日志由刷写线程写完后释放
+ */
+struct ThreadLogRing {
+    std::shared_ptr<LogRing> ring;
+    ~ThreadLogRing() {
+        if (ring) {
+            ring->closed = true;
+        }
+    }
+};
+
+static thread_local ThreadLogRing t_ring;
+
+LogFlusher::LogFlusher() {
+    m_notifier.reset(new Notifier);
+    m_thread.reset(new Thread(std::bind(&LogFlusher::run, this), "log_flusher"));
+}
+
+LogFlusher::~LogFlusher() {
+    m_stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(m_notifier->mutex);
+        m_notifier->cond.notify_one();
+    }
+    m_thread->join();
+}
+
+void LogFlusher::setRingSize(size_t v) {
+    size_t size = 4096;
+    while (size < v) {
+        size <<= 1;
+    }
+    m_ringSize = size;
+}
+
+LogRing* LogFlusher::getThreadRing() {
+    if (!t_ring.ring) {
+        t_ring.ring.reset(new LogRing(m_ringSize));
+        Mutex::Lock lock(m_mutex);
+        m_rings.push_back(t_ring.ring);
+    }
+    return t_ring.ring.get();
+}
+
+void LogFlusher::wakeup() {
+    if (m_sleeping.exchange(false)) {
+        std::lock_guard<std::mutex> lock(m_notifier->mutex);
+        m_notifier->cond.notify_one();
+    }
+}
+
+bool LogFlusher::append(LogAppender* appender, const char* data, size_t len,
+                        bool urgent) {
+    LogRing* ring = getThreadRing();
+    while (!ring->push(appender, data, len)) {
+        if (m_policy == DROP || m_stopping ||
+            Thread::GetThis() == m_thread.get()) {
+            ++ring->dropped;
+            return false;
+        }
+        // 阻塞策略：叫醒刷写线程，等它写完一轮再重试
+        std::unique_lock<std::mutex> lock(m_notifier->mutex);
+        m_sleeping = false;
+        m_notifier->cond.notify_one();
+        m_notifier->flushed.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    if (urgent || ring->used() >= ring->capacity() / 2) {
+        wakeup();
+    }
+    return true;
+}
+
+void LogFlusher::flush() {
+    if (Thread::GetThis() == m_thread.get()) {
+        return;
+    }
+    std::vector<std::pair<std::shared_ptr<LogRing>, uint64_t>> targets;
+    {
+        Mutex::Lock lock(m_mutex);
+        for (auto& i : m_rings) {
+            targets.push_back(
+                std::make_pair(i, i->m_tail.load(std::memory_order_acquire)));
+        }
+    }
+    std::unique_lock<std::mutex> lock(m_notifier->mutex);
+    while (true) {
+        bool done = true;
+        for (auto& i : targets) {
+            if (i.first->m_head.load(std::memory_order_acquire) < i.second) {
+                done = false;
+                break;
+            }
+        }
+        if (done) {
+            break;
+        }
+        m_sleeping = false;
+        m_notifier->cond.notify_one();
+        m_notifier->flushed.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+uint64_t LogFlusher::getDropped() {
+    uint64_t dropped = m_droppedClosed;
+    Mutex::Lock lock(m_mutex);
+    for (auto& i : m_rings) {
+        dropped += i->dropped;
+    }
+    return dropped;
+}
+
+void LogFlusher::run() {
+    while (true) {
+        size_t n = drain();
+        {
+            std::lock_guard<std::mutex> lock(m_notifier->mutex);
+            m_notifier->flushed.notify_all();
+        }
+        if (n) {
+            continue;
+        }
+        if (m_stopping) {
+            break;
+        }
+        std::unique_lock<std::mutex> lock(m_notifier->mutex);
+        if (m_stopping) {
+            continue;
+        }
+        m_sleeping = true;
+        m_notifier->cond.wait_for(lock,
+                                  std::chrono::milliseconds(m_flushInterval));
+        m_sleeping = false;
+    }
+}
+
+size_t LogFlusher::drain() {
+    std::vector<std::shared_ptr<LogRing>> rings;
+    {
+        Mutex::Lock lock(m_mutex);
+        rings = m_rings;
+    }
+
+    // 收集所有队列中已提交的记录，按Appender分组，iovec直接指向队列内存
+    for (auto& i : m_batches) {
+        i.second.clear();
+    }
+    std::vector<uint64_t> tails(rings.size());
+    size_t bytes = 0;
+    for (size_t i = 0; i < rings.size(); ++i) {
+        LogRing* ring = rings[i].get();
+        uint64_t pos = ring->m_head.load(std::memory_order_relaxed);
+        uint64_t tail = ring->m_tail.load(std::memory_order_acquire);
+        tails[i] = tail;
+        while (pos < tail) {
+            LogRing::Header* h = ring->at(pos);
+            if (h->appender) {
+                auto it = std::find_if(
+                    m_batches.begin(), m_batches.end(),
+                    [h](const std::pair<LogAppender*, std::vector<iovec>>& b) {
+                        return b.first == h->appender;
+                    });
+                if (it == m_batches.end()) {
+                    m_batches.push_back(
+                        std::make_pair(h->appender, std::vector<iovec>()));
+                    it = m_batches.end() - 1;
+                }
+                it->second.push_back({h + 1, h->len});
+                bytes += h->len;
+            }
+            pos += h->size;
+        }
+    }
+
+    for (auto& i : m_batches) {
+        if (!i.second.empty()) {
+            i.first->write(i.second.data(), i.second.size());
+        }
+    }
+
+    // 写完之后才归还队列空间
+    for (size_t i = 0; i < rings.size(); ++i) {
+        rings[i]->m_head.store(tails[i], std::memory_order_release);
+    }
+
+    // 释放已退出线程的空队列，Appender可能已经析构，分组也一并清掉
+    Mutex::Lock lock(m_mutex);
+    for (auto it = m_rings.begin(); it != m_rings.end();) {
+        if ((*it)->closed && (*it)->used() == 0) {
+            m_droppedClosed += (*it)->dropped;
+            it = m_rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    lock.unlock();
+    m_batches.erase(std::remove_if(m_batches.begin(), m_batches.end(),
+                                   [](const std::pair<LogAppender*,
+                                                      std::vector<iovec>>& b) {
+                                       return b.second.empty();
+                                   }),
+                    m_batches.end());
+    return bytes;
+}
+
+LoggerManager::LoggerManager() {
+    m_root.reset(new Logger);
+    m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
+    m_loggers[m_root->m_name] = m_root;
+}
+
+Logger::ptr LoggerManager::getLogger(const std::string& name) {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_loggers.find(name);
+    if (it != m_loggers.end()) {
+        return it->second;
+    }
+
+    Logger::ptr logger(new Logger(name));
+    logger->m_root = m_root;
+    m_loggers[name] = logger;
+    return logger;
+}
+
+}  // namespace coro
@@ -3,30 +3,79 @@
  * @brief 日志模块封装
  * @author shawn
  * @date 2024-05-23
+ * @details 日志在调用线程格式化到线程私有的预分配缓冲区，再写入线程私有的SPSC环形队列，
+ *          由后台的LogFlusher线程批量取出并用writev写到各个LogAppender，
+ *          记录日志的路径上没有堆分配，也不会阻塞在磁盘IO上
  */
 #ifndef __CORO_LOG_H__
 #define __CORO_LOG_H__
 
+#include <signal.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <atomic>
 #include <list>
+#include <map>
 #include <memory>
+#include <ostream>
+#include <streambuf>
 #include <string>
 #include <vector>
 
 #include "mutex.h"
 #include "singleton.h"
+#include "snapshot.h"
+#include "thread.h"
+#include "util.h"
 
-#define CORO_LOG_LEVEL(logger, level)                                  \
-    if (logger->getLevel() <= level)                                   \
-    coro::LogEventWrap(                                                \
-        coro::LogEvent::ptr(new coro::LogEvent(                        \
-            logger, level, __FILE__, __LINE__, 0, coro::GetThreadId(), \
-            coro::GetFiberId(), time(0), coro::Thread::GetName())))    \
+/**
+ * @brief 使用流式方式将日志级别level的日志写入到logger
+ */
+#define CORO_LOG_LEVEL(logger, level)                                      \
+    if (logger->getLevel() <= level)                                       \
+    coro::LogEventWrap(logger, level, __FILE__, __LINE__, 0,               \
+                       coro::GetThreadId(), coro::GetFiberId(), time(0),   \
+                       coro::Thread::GetName())                            \
         .getSS()
 
 #define CORO_LOG_DEBUG(logger) CORO_LOG_LEVEL(logger, coro::LogLevel::DEBUG)
 
+#define CORO_LOG_INFO(logger) CORO_LOG_LEVEL(logger, coro::LogLevel::INFO)
+
+#define CORO_LOG_WARN(logger) CORO_LOG_LEVEL(logger, coro::LogLevel::WARN)
+
 #define CORO_LOG_ERROR(logger) CORO_LOG_LEVEL(logger, coro::LogLevel::ERROR)
 
+#define CORO_LOG_FATAL(logger) CORO_LOG_LEVEL(logger, coro::LogLevel::FATAL)
+
+/**
+ * @brief 使用格式化方式将日志级别level的日志写入到logger
+ */
+#define CORO_LOG_FMT_LEVEL(logger, level, fmt, ...)                         \
+    if (logger->getLevel() <= level)                                        \
+    coro::LogEventWrap(logger, level, __FILE__, __LINE__, 0,                \
+                       coro::GetThreadId(), coro::GetFiberId(), time(0),    \
+                       coro::Thread::GetName())                             \
+        .getEvent()                                                         \
+        .format(fmt, __VA_ARGS__)
+
+#define CORO_LOG_FMT_DEBUG(logger, fmt, ...) \
+    CORO_LOG_FMT_LEVEL(logger, coro::LogLevel::DEBUG, fmt, __VA_ARGS__)
+
+#define CORO_LOG_FMT_INFO(logger, fmt, ...) \
+    CORO_LOG_FMT_LEVEL(logger, coro::LogLevel::INFO, fmt, __VA_ARGS__)
+
+#define CORO_LOG_FMT_WARN(logger, fmt, ...) \
+    CORO_LOG_FMT_LEVEL(logger, coro::LogLevel::WARN, fmt, __VA_ARGS__)
+
+#define CORO_LOG_FMT_ERROR(logger, fmt, ...) \
+    CORO_LOG_FMT_LEVEL(logger, coro::LogLevel::ERROR, fmt, __VA_ARGS__)
+
+#define CORO_LOG_FMT_FATAL(logger, fmt, ...) \
+    CORO_LOG_FMT_LEVEL(logger, coro::LogLevel::FATAL, fmt, __VA_ARGS__)
+
 /**
  * @brief 获取name的日志器
  */
@@ -69,69 +118,666 @@ class LogLevel {
     static LogLevel::Level FromString(const std::string& str);
 };
 
+/**
+ * @brief 定长的格式化缓冲区，超出容量的内容被截断
+ */
+class LogBuffer : Noncopyable {
+   public:
+    /**
+     * @brief 构造函数，一次性分配capacity字节
+     */
+    LogBuffer(size_t capacity);
+
+    const char* data() const { return m_data.get(); }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    void clear() { m_size = 0; }
+
+    /**
+     * @brief 追加字符串
+     */
+    void append(const char* str, size_t len);
+    void append(const std::string& str) { append(str.c_str(), str.size()); }
+    void append(char c) {
+        if (m_size < m_capacity) {
+            m_data[m_size++] = c;
+        }
+    }
+
+    /**
+     * @brief 追加十进制整数，不经过printf/ostream
+     */
+    void appendUInt(uint64_t v);
+    void appendInt(int64_t v);
+
+   private:
+    /// 缓冲区
+    std::unique_ptr<char[]> m_data;
+    /// 已使用的字节数
+    size_t m_size = 0;
+    /// 容量
+    size_t m_capacity;
+};
+
+/**
+ * @brief 写入定长内存的输出流
+ * @details std::ostream直接以预分配的内存作为输出区，写满后后续内容被丢弃
+ */
+class LogStream : Noncopyable {
+   public:
+    LogStream(size_t capacity);
+
+    std::ostream& stream() { return m_os; }
+    const char* data() const { return m_data.get(); }
+    size_t size() const { return m_buf.size(); }
+
+    /**
+     * @brief 清空内容和流的错误状态，准备记录下一条日志
+     */
+    void reset();
+
+   private:
+    class Buf : public std::streambuf {
+       public:
+        void reset(char* begin, size_t len) { setp(begin, begin + len); }
+        size_t size() const { return pptr() - pbase(); }
+    };
+
+   private:
+    std::unique_ptr<char[]> m_data;
+    size_t m_capacity;
+    Buf m_buf;
+    std::ostream m_os;
+};
+
 /**
  * @brief 日志事件
+ * @details 在记录日志的栈上构造，正文写入线程私有的LogStream，
+ *          同一线程上嵌套记录日志时(比如operator<<里又记录日志)才临时分配新的LogStream
  */
-class LogEvent {
+class LogEvent : Noncopyable {
    public:
-    typedef std::shared_ptr<LogEvent> ptr;
+    /**
+     * @brief 构造函数
+     * @param[in] logger 日志器
+     * @param[in] level 日志级别
+     * @param[in] file 文件名
+     * @param[in] line 文件行号
+     * @param[in] elapse 程序启动依赖的耗时(毫秒)
+     * @param[in] thread_id 线程id
+     * @param[in] fiber_id 协程id
+     * @param[in] time 日志事件(秒)
+     * @param[in] thread_name 线程名称
+     */
+    LogEvent(Logger* logger, LogLevel::Level level, const char* file,
+             int32_t line, uint32_t elapse, uint32_t thread_id,
+             uint64_t fiber_id, uint64_t time, const std::string& thread_name);
+
+    ~LogEvent();
+
+    const char* getFile() const { return m_file; }
+    int32_t getLine() const { return m_line; }
+    uint32_t getElapse() const { return m_elapse; }
+    uint32_t getThreadId() const { return m_threadId; }
+    uint64_t getFiberId() const { return m_fiberId; }
+    uint64_t getTime() const { return m_time; }
+    const std::string& getThreadName() const { return m_threadName; }
+    Logger* getLogger() const { return m_logger; }
+    LogLevel::Level getLevel() const { return m_level; }
+
+    /**
+     * @brief 日志内容
+     */
+    const char* getContent() const { return m_stream->data(); }
+    size_t getContentSize() const { return m_stream->size(); }
+
+    /**
+     * @brief 日志内容字符串流
+     */
+    std::ostream& getSS() { return m_stream->stream(); }
+
+    /**
+     * @brief 格式化写入日志内容
+     */
+    void format(const char* fmt, ...);
+
+   private:
+    /// 文件名
+    const char* m_file = nullptr;
+    /// 行号
+    int32_t m_line = 0;
+    /// 程序启动开始到现在的毫秒数
+    uint32_t m_elapse = 0;
+    /// 线程ID
+    uint32_t m_threadId = 0;
+    /// 协程ID
+    uint64_t m_fiberId = 0;
+    /// 时间戳
+    uint64_t m_time = 0;
+    /// 线程名称
+    const std::string& m_threadName;
+    /// 日志内容
+    LogStream* m_stream = nullptr;
+    /// m_stream是否是临时分配的
+    bool m_ownStream = false;
+    /// 日志器
+    Logger* m_logger;
+    /// 日志等级
+    LogLevel::Level m_level;
 };
 
+/**
+ * @brief 日志事件包装器，析构时把日志事件写入日志器
+ */
+class LogEventWrap : Noncopyable {
+   public:
+    /**
+     * @brief 构造函数，参数同LogEvent
+     */
+    LogEventWrap(const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+                 const char* file, int32_t line, uint32_t elapse,
+                 uint32_t thread_id, uint64_t fiber_id, uint64_t time,
+                 const std::string& thread_name);
+
+    ~LogEventWrap();
+
+    LogEvent& getEvent() { return m_event; }
+
+    std::ostream& getSS() { return m_event.getSS(); }
+
+   private:
+    LogEvent m_event;
+};
+
+/**
+ * @brief 日志格式器
+ * @details 构造时把模式串编译成FormatItem数组，格式化时依次执行，不再解析模式串
+ */
 class LogFormatter {
    public:
     typedef std::shared_ptr<LogFormatter> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] pattern 格式模板
+     * @details
+     *  %m 消息
+     *  %p 日志级别
+     *  %r 累计毫秒数
+     *  %c 日志名称
+     *  %t 线程id
+     *  %n 换行
+     *  %d 时间，可以带strftime格式，例如%d{%Y-%m-%d %H:%M:%S}
+     *  %f 文件名
+     *  %l 行号
+     *  %T 制表符
+     *  %F 协程id
+     *  %N 线程名称
+     *  %% 百分号
+     *
+     *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
+     */
+    LogFormatter(const std::string& pattern =
+                     "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
+
+    /**
+     * @brief 把日志事件格式化到out的末尾
+     */
+    void format(LogBuffer& out, Logger* logger, LogLevel::Level level,
+                const LogEvent& event);
+
+   public:
+    /**
+     * @brief 日志内容项格式化
+     */
+    class FormatItem {
+       public:
+        typedef std::shared_ptr<FormatItem> ptr;
+
+        virtual ~FormatItem() {}
+
+        /**
+         * @brief 格式化日志到out
+         */
+        virtual void format(LogBuffer& out, Logger* logger,
+                            LogLevel::Level level, const LogEvent& event) = 0;
+    };
+
+    /**
+     * @brief 解析模式串
+     */
+    void init();
+
+    /**
+     * @brief 模式串是否有错误
+     */
+    bool isError() const { return m_error; }
+
+    /**
+     * @brief 返回日志模板
+     */
+    const std::string& getPattern() const { return m_pattern; }
+
+   private:
+    /// 日志格式模板
+    std::string m_pattern;
+    /// 编译后的格式项
+    std::vector<FormatItem::ptr> m_items;
+    /// 是否有错误
+    bool m_error = false;
 };
 
+/**
+ * @brief 日志输出目标
+ * @details log在调用线程格式化并入队，write在LogFlusher线程批量调用，
+ *          子类析构时要先调用LogFlusher::flush，保证队列里不再有指向自己的日志
+ */
 class LogAppender {
     friend class Logger;
 
    public:
     typedef std::shared_ptr<LogAppender> ptr;
-    typedef SpinLock MutexType;
+    typedef Spinlock MutexType;
+
+    LogAppender();
+
+    virtual ~LogAppender() {}
+
+    /**
+     * @brief 格式化日志并放入当前线程的日志队列
+     */
+    virtual void log(Logger* logger, LogLevel::Level level,
+                     const LogEvent& event);
+
+    /**
+     * @brief 记录一条二进制日志
+     * @details 默认把记录解码成文本再按格式器输出，BinLogAppender直接写入原始字节
+     * @param[in] data 记录数据，以BinLog::Record开头
+     * @param[in] len 记录长度
+     */
+    virtual void logBinary(Logger* logger, LogLevel::Level level,
+                           const char* data, size_t len);
+
+    /**
+     * @brief 写出一批已经格式化好的日志，只在LogFlusher线程调用
+     */
+    virtual void write(const iovec* iov, int iovcnt) = 0;
+
+    void setFormatter(LogFormatter::ptr val);
+    LogFormatter::ptr getFormatter();
+
+    LogLevel::Level getLevel() const { return m_level; }
+    void setLevel(LogLevel::Level val) { m_level = val; }
+
+   protected:
+    /**
+     * @brief 处理EINTR和部分写入，超过IOV_MAX时分批写
+     */
+    static void WritevAll(int fd, const iovec* iov, int iovcnt);
+
+    /**
+     * @brief 当前线程缓存的格式器快照，格式器没变时只有一次acquire读
+     * @return 在本线程下一次调用之前有效，没有格式器时为nullptr
+     */
+    LogFormatter* formatterSnapshot();
+
+    /**
+     * @brief 替换格式器并发布新版本，需要持有m_mutex
+     */
+    void publishFormatter(LogFormatter::ptr val);
+
+   protected:
+    /// 日志级别
+    LogLevel::Level m_level = LogLevel::DEBUG;
+    /// 是否有自己的日志格式器
+    bool m_hasFormatter = false;
+    /// 保护m_formatter的修改，写日志时不加锁
+    MutexType m_mutex;
+    /// 日志格式器
+    LogFormatter::ptr m_formatter;
+    /// 线程快照缓存的槽位
+    const uint32_t m_slot = AllocSnapshotSlot();
+    /// 格式器版本号，从1开始
+    std::atomic<uint64_t> m_version{1};
+};
+
+/**
+ * @brief 输出到控制台的Appender
+ */
+class StdoutLogAppender : public LogAppender {
+   public:
+    typedef std::shared_ptr<StdoutLogAppender> ptr;
+
+    ~StdoutLogAppender();
+
+    void write(const iovec* iov, int iovcnt) override;
+};
+
+/**
+ * @brief 输出到文件的Appender
+ * @details 文件按大块(kChunkSize)预先分配并mmap，写日志就是memcpy到页缓存，
+ *          不需要每批一次write系统调用。文件关闭时截断到实际长度，
+ *          写入过程中文件尾部是预分配的零，tail -f会看到这部分空字节。
+ *          进程崩溃后重新打开时跳过尾部的零，从实际内容之后继续写。
+ *          按大小和时间切分都在LogFlusher线程里完成，记录日志的线程不会阻塞在open/rename上。
+ *          切分时当前文件重命名为 filename.年月日-时分秒，再打开新的filename
+ */
+class FileLogAppender : public LogAppender {
+   public:
+    typedef std::shared_ptr<FileLogAppender> ptr;
+
+    /// 每次扩展文件和映射窗口的大小
+    static const size_t kChunkSize = 16 * 1024 * 1024;
+
+    /**
+     * @brief 构造函数
+     * @param[in] filename 文件路径
+     * @param[in] max_size 单个文件的最大字节数，0表示不按大小切分
+     * @param[in] rotate_interval 按时间切分的间隔(秒)，按本地时间对齐，
+     *            比如86400在每天零点切分，0表示不按时间切分
+     */
+    FileLogAppender(const std::string& filename, uint64_t max_size = 0,
+                    uint32_t rotate_interval = 0);
+
+    ~FileLogAppender();
+
+    void write(const iovec* iov, int iovcnt) override;
+
+    /**
+     * @brief 重新打开日志文件，用于日志文件被外部移走之后
+     * @return 成功返回true
+     */
+    bool reopen();
+
+    void setMaxSize(uint64_t val) { m_maxSize = val; }
+    void setRotateInterval(uint32_t val);
+
+    /**
+     * @brief 让所有FileLogAppender在下一次写入前重新打开文件
+     * @details 只修改一个原子变量，可以在信号处理函数里调用
+     */
+    static void ReopenAll();
+
+    /**
+     * @brief 安装信号处理函数，收到信号时调用ReopenAll
+     */
+    static bool InstallReopenSignal(int signo = SIGHUP);
+
+   private:
+    /**
+     * @brief 打开文件，从文件末尾继续写，需要持有m_fileMutex
+     */
+    bool openFile();
+
+    /**
+     * @brief 解除映射并截断到实际长度后关闭，需要持有m_fileMutex
+     */
+    void closeFile();
+
+    /**
+     * @brief 重命名当前文件并打开新文件
+     */
+    void rotate();
+
+    /**
+     * @brief 映射m_size所在的窗口，文件不够长时先扩展一个kChunkSize
+     */
+    bool remap();
+
+    /**
+     * @brief 计算下一次按时间切分的时间点
+     */
+    time_t nextRotateTime(time_t now) const;
+
+   private:
+    /// 文件路径
+    std::string m_filename;
+    /// 单个文件的最大字节数
+    std::atomic<uint64_t> m_maxSize;
+    /// 按时间切分的间隔(秒)
+    std::atomic<uint32_t> m_rotateInterval;
+    /// 下一次按时间切分的时间点
+    time_t m_rotateTime = 0;
+    /// 文件句柄
+    int m_fd = -1;
+    /// 已经写入的长度
+    uint64_t m_size = 0;
+    /// 文件当前的长度(包括预分配的部分)
+    uint64_t m_capacity = 0;
+    /// 映射窗口
+    char* m_map = nullptr;
+    uint64_t m_mapOffset = 0;
+    /// 已经处理过的ReopenAll次数
+    uint32_t m_reopenSeq = 0;
+    /// 上次打开失败的时间，避免每批都重试
+    time_t m_openFailTime = 0;
+    /// 保护文件状态，刷写线程写文件时其他线程可能在reopen
+    Mutex m_fileMutex;
 };
 
 /**
  * @brief 日志器
  */
-class Logger {
+class Logger : public std::enable_shared_from_this<Logger> {
     friend class LoggerManager;
 
    public:
     typedef std::shared_ptr<Logger> ptr;
-    typedef SpinLock MutexType;
+    /// 只保护修改，写日志时读线程缓存的Appender列表快照
+    typedef RWMutex MutexType;
+    typedef std::vector<LogAppender::ptr> AppenderList;
 
     Logger(const std::string& name = "root");
 
-    void log(LogLevel::Level level, LogEvent::ptr event);
+    /**
+     * @brief 写日志，没有Appender时交给主日志器
+     */
+    void log(LogLevel::Level level, const LogEvent& event);
+
+    /**
+     * @brief 写二进制日志，没有Appender时交给主日志器
+     */
+    void logBinary(LogLevel::Level level, const char* data, size_t len);
+
+    void debug(const LogEvent& event);
+    void info(const LogEvent& event);
+    void warn(const LogEvent& event);
+    void error(const LogEvent& event);
+    void fatal(const LogEvent& event);
+
+    /**
+     * @brief 添加日志目标，没有格式器的Appender使用日志器的格式器
+     * @details 增删Appender时复制一份新的列表并发布，
+     *          删除的Appender在每个用过旧列表的线程再次通过本日志器写日志或者退出后才析构
+     */
+    void addAppender(LogAppender::ptr appender);
+    void delAppender(LogAppender::ptr appender);
+    void clearAppenders();
 
-    void debug(LogEvent::ptr event);
+    LogLevel::Level getLevel() const { return m_level; }
+    void setLevel(LogLevel::Level val) { m_level = val; }
+
+    const std::string& getName() const { return m_name; }
+
+    void setFormatter(LogFormatter::ptr val);
+
+    /**
+     * @brief 按模式串设置日志格式器，模式串有错误时不修改
+     */
+    void setFormatter(const std::string& val);
+    LogFormatter::ptr getFormatter();
 
    private:
-    // 日志名称
+    /**
+     * @brief 当前线程缓存的Appender列表快照，列表没变时只有一次acquire读
+     */
+    const AppenderList& appenderSnapshot();
+
+    /**
+     * @brief 发布新的Appender列表，需要持有m_mutex的写锁
+     */
+    void publishAppenders(std::shared_ptr<const AppenderList> val);
+
+   private:
+    /// 日志名称
     std::string m_name;
-    // 日志级别
+    /// 日志级别
     LogLevel::Level m_level;
-    // Mutex
+    /// Mutex
     MutexType m_mutex;
-    // 目标日志集合
-    std::list<LogAppender::ptr> m_appenders;
-    // 日志格式器
+    /// 日志目标集合，只读，修改时整体替换
+    std::shared_ptr<const AppenderList> m_appenders;
+    /// 线程快照缓存的槽位
+    const uint32_t m_slot = AllocSnapshotSlot();
+    /// Appender列表版本号，从1开始
+    std::atomic<uint64_t> m_version{1};
+    /// 日志格式器
     LogFormatter::ptr m_formatter;
-    // 主日志器
+    /// 主日志器
     Logger::ptr m_root;
 };
 
-class StdoutLogAppender {};
+class LogRing;
+
+/**
+ * @brief 后台日志刷写线程
+ * @details 每个写日志的线程有一个SPSC环形队列，记录是(Appender, 长度, 格式化好的内容)，
+ *          刷写线程定期(或者队列过半、有ERROR以上日志时被唤醒)取出所有队列的记录，
+ *          按Appender分组后直接以队列内存作为iovec调用write，写完再归还队列空间
+ */
+class LogFlusher : Noncopyable {
+   public:
+    /**
+     * @brief 队列写满时的策略
+     */
+    enum OverflowPolicy {
+        /// 丢弃新的日志并计数
+        DROP = 0,
+        /// 等待刷写线程腾出空间
+        BLOCK = 1,
+    };
+
+    LogFlusher();
+
+    /**
+     * @brief 析构时写完所有队列中的日志再退出刷写线程
+     */
+    ~LogFlusher();
+
+    /**
+     * @brief 把一条格式化好的日志放入当前线程的队列
+     * @param[in] urgent 是否立即唤醒刷写线程
+     * @return 被丢弃时返回false
+     */
+    bool append(LogAppender* appender, const char* data, size_t len,
+                bool urgent);
+
+    /**
+     * @brief 等待调用之前写入的日志全部交给Appender
+     */
+    void flush();
+
+    void setOverflowPolicy(OverflowPolicy v) { m_policy = v; }
+    OverflowPolicy getOverflowPolicy() const { return m_policy; }
+
+    /**
+     * @brief 设置之后新建的线程队列的大小(字节)，向上取整到2的幂
+     */
+    void setRingSize(size_t v);
+    size_t getRingSize() const { return m_ringSize; }
+
+    /**
+     * @brief 设置刷写线程的最长休眠时间
+     */
+    void setFlushInterval(uint64_t ms) { m_flushInterval = ms; }
+    uint64_t getFlushInterval() const { return m_flushInterval; }
+
+    /**
+     * @brief 因队列满被丢弃的日志数量
+     */
+    uint64_t getDropped();
+
+   private:
+    /**
+     * @brief 当前线程的队列，第一次调用时创建并登记
+     */
+    LogRing* getThreadRing();
+
+    /**
+     * @brief 唤醒休眠中的刷写线程
+     */
+    void wakeup();
+
+    /**
+     * @brief 刷写线程主函数
+     */
+    void run();
+
+    /**
+     * @brief 取出所有队列的日志写到Appender
+     * @return 写出的字节数
+     */
+    size_t drain();
 
-class FileLogAppender {};
+   private:
+    /// 队列写满时的策略
+    std::atomic<OverflowPolicy> m_policy{DROP};
+    /// 新队列的大小
+    std::atomic<size_t> m_ringSize{1 << 20};
+    /// 刷写间隔(毫秒)
+    std::atomic<uint64_t> m_flushInterval{10};
+    /// 已退出线程的队列丢弃的日志数
+    std::atomic<uint64_t> m_droppedClosed{0};
+    /// 刷写线程是否在休眠
+    std::atomic<bool> m_sleeping{false};
+    /// 是否停止
+    std::atomic<bool> m_stopping{false};
+    /// 保护m_rings
+    Mutex m_mutex;
+    /// 所有线程的队列
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+    /// 刷写线程
+    Thread::ptr m_thread;
+    /// 按Appender分组的待写日志，只在刷写线程使用
+    std::vector<std::pair<LogAppender*, std::vector<iovec>>> m_batches;
+
+    struct Notifier;
+    /// 刷写线程的休眠和flush的等待
+    std::unique_ptr<Notifier> m_notifier;
+};
+
+/// 后台日志刷写线程单例
+typedef coro::Singleton<LogFlusher> LogFlusherMgr;
 
 /**
  * @brief 日志器管理类
  */
 class LoggerManager {
    public:
-    typedef SpinLock MutexType;
+    typedef Spinlock MutexType;
+
+    /**
+     * @brief 构造函数，主日志器默认输出到控制台
+     */
     LoggerManager();
+
+    /**
+     * @brief 获取日志器，不存在时创建一个使用主日志器输出的日志器
+     */
+    Logger::ptr getLogger(const std::string& name);
+
+    /**
+     * @brief 返回主日志器
+     */
+    const Logger::ptr& getRoot() const { return m_root; }
+
+   private:
+    /// Mutex
+    MutexType m_mutex;
+    /// 日志器容器
+    std::map<std::string, Logger::ptr> m_loggers;
+    /// 主日志器
+    Logger::ptr m_root;
 };
 
 // 日志器管理类单例模式
@@ -139,4 +785,4 @@ typedef coro::Singleton<LoggerManager> LoggerMgr;
 
 }  // namespace coro
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file log_decoder.cc
+ * @brief 二进制日志解码工具，把BinLogAppender写的段文件还原成文本
+ * @author shawn
+ * @date 2024-07-12
+ * @details 用法: log_decoder [-l level] segment...
+ *          按参数顺序解码每个段文件输出到标准输出，-l只输出不低于该级别的日志
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+
+#include "binlog.h"
+
+static void usage(const char* name) {
+    std::cerr << "usage: " << name << " [-l level] segment..." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    coro::LogLevel::Level level = coro::LogLevel::DEBUG;
+    int i = 1;
+    if (i + 1 < argc && strcmp(argv[i], "-l") == 0) {
+        level = coro::LogLevel::FromString(argv[i + 1]);
+        if (level == coro::LogLevel::UNKNOW) {
+            usage(argv[0]);
+            return 1;
+        }
+        i += 2;
+    }
+    if (i >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int rt = 0;
+    std::string line;
+    for (; i < argc; ++i) {
+        coro::BinLogReader reader;
+        if (!reader.open(argv[i])) {
+            rt = 1;
+            continue;
+        }
+        coro::BinLogReader::Entry entry;
+        while (reader.next(entry)) {
+            if (entry.level < level) {
+                continue;
+            }
+            line.clear();
+            coro::BinLogReader::ToString(entry, line);
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+        if (reader.isCorrupted()) {
+            std::cerr << argv[i] << ": corrupted record, rest of segment skipped"
+                      << std::endl;
+            rt = 1;
+        }
+    }
+    return rt;
+}
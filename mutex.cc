@@ -1,14 +1,18 @@
 /**
  * @file mutex.cc
- * @brief 信号量实现
+ * @brief 信号量，自适应锁实现
  * @version 0.1
  * @date 2024-06-09
  */
 
 #include "mutex.h"
 
+#include <linux/futex.h>
 #include <semaphore.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace coro {
@@ -32,4 +36,45 @@ void Semaphore::notify() {
         throw std::logic_error("sem_post error");
     }
 }
-}  // namespace coro
\ No newline at end of file
+
+// 自旋上限，单次退避的最大pause次数
+static const int32_t kMaxSpin = 1024;
+static const int32_t kMaxBackoff = 64;
+
+void AdaptiveLock::lockSlow() {
+    int32_t spin = m_spin.load(std::memory_order_relaxed);
+    int32_t limit = std::min(kMaxSpin, spin * 2 + 16);
+    int32_t spins = 0;
+    for (int32_t backoff = 1; spins < limit;
+         backoff = std::min(backoff * 2, kMaxBackoff)) {
+        for (int32_t i = 0; i < backoff; ++i) {
+            CpuRelax();
+        }
+        spins += backoff;
+        // 先读再CAS，锁被占用时不抢占缓存行
+        int32_t c = m_state.load(std::memory_order_relaxed);
+        if (c == 0 && m_state.compare_exchange_weak(
+                          c, 1, std::memory_order_acquire,
+                          std::memory_order_relaxed)) {
+            m_spin.store(spin + (spins - spin) / 8, std::memory_order_relaxed);
+            return;
+        }
+    }
+    // 自旋失败时缩小估计，持锁时间长或CPU不够时自旋上限很快回落到最小值
+    m_spin.store(spin - spin / 8, std::memory_order_relaxed);
+
+    // 标记有等待者后睡眠，被唤醒时以状态2持有锁，保证解锁方会继续唤醒其他等待者
+    int32_t c = m_state.exchange(2, std::memory_order_acquire);
+    while (c != 0) {
+        syscall(SYS_futex, reinterpret_cast<int32_t*>(&m_state),
+                FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+        c = m_state.exchange(2, std::memory_order_acquire);
+    }
+}
+
+void AdaptiveLock::wake() {
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(&m_state), FUTEX_WAKE_PRIVATE,
+            1, nullptr, nullptr, 0);
+}
+
+}  // namespace coro
@@ -1,6 +1,6 @@
 /**
  * @file mutex.h
- * @brief 信号量，互斥锁，读写锁，范围锁模板，自旋锁，原子锁
+ * @brief 信号量，互斥锁，读写锁，范围锁模板，自旋锁，原子锁，自适应锁，缓存行对齐的锁
  * @version 0.1
  * @date 2024-06-09
  */
@@ -16,12 +16,42 @@
 #include <future>
 #include <list>
 #include <memory>
+#include <new>
 #include <thread>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #include "noncopyable.h"
 
 namespace coro {
 
+/**
+ * @brief 缓存行大小，两个被不同线程频繁写的变量至少相隔这么远才不会伪共享
+ * @details GCC的hardware_destructive_interference_size随-mtune变化，
+ *          用在头文件里会导致不同编译单元的布局不一致，所以GCC/Clang下固定为64
+ */
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)
+static constexpr size_t kCacheLineSize =
+    std::hardware_destructive_interference_size;
+#else
+static constexpr size_t kCacheLineSize = 64;
+#endif
+
+/**
+ * @brief 自旋等待时提示CPU，降低功耗并让出超线程的执行资源
+ */
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::this_thread::yield();
+#endif
+}
+
 /**
  * @brief 信号量
  */
@@ -402,6 +432,82 @@ class CASLock : Noncopyable {
     volatile std::atomic_flag m_mutex;
 };
 
+/**
+ * @brief 自适应锁，先有限次退避自旋，拿不到再在futex上睡眠
+ * @details 状态0未上锁，1上锁无等待者，2上锁且可能有等待者。
+ *          无竞争时加锁只有一次CAS，解锁只有一次交换，只有状态为2时才futex唤醒。
+ *          自旋上限按最近几次自旋拿到锁所用的次数动态调整，自旋拿不到锁时缩小，
+ *          持锁时间长或线程数超过CPU数时很快转入睡眠，不会空转整个时间片
+ */
+class AdaptiveLock : Noncopyable {
+   public:
+    /// 局部锁
+    typedef ScopedLockImpl<AdaptiveLock> Lock;
+
+    /**
+     * @brief 上锁
+     */
+    void lock() {
+        int32_t c = 0;
+        if (!m_state.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+            lockSlow();
+        }
+    }
+
+    /**
+     * @brief 尝试上锁
+     * @return 是否上锁成功
+     */
+    bool tryLock() {
+        int32_t c = 0;
+        return m_state.compare_exchange_strong(c, 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 解锁
+     */
+    void unlock() {
+        if (m_state.exchange(0, std::memory_order_release) == 2) {
+            wake();
+        }
+    }
+
+   private:
+    /**
+     * @brief 竞争路径：退避自旋，然后睡眠
+     */
+    void lockSlow();
+
+    /**
+     * @brief 唤醒一个等待者
+     */
+    void wake();
+
+   private:
+    /// 锁状态
+    std::atomic<int32_t> m_state{0};
+    /// 自旋次数的滑动估计
+    std::atomic<int32_t> m_spin{0};
+};
+
+/**
+ * @brief 独占整数个缓存行的T，数组或结构体里相邻的对象不会伪共享
+ * @details 用于锁类型：继承了T的lock/unlock和Lock等类型定义
+ */
+template <class T>
+struct alignas(kCacheLineSize) CacheLinePadded : public T {
+    using T::T;
+};
+
+/// 缓存行对齐的锁
+typedef CacheLinePadded<Mutex> PaddedMutex;
+typedef CacheLinePadded<RWMutex> PaddedRWMutex;
+typedef CacheLinePadded<Spinlock> PaddedSpinlock;
+typedef CacheLinePadded<CASLock> PaddedCASLock;
+typedef CacheLinePadded<AdaptiveLock> PaddedAdaptiveLock;
+
 }  // namespace coro
 
 #endif
@@ -0,0 +1,303 @@
+/**
+ * @file range_lock.h
+ * @brief 范围锁，对[begin, end)区间加共享锁或独占锁
+ * @author shawn
+ * @date 2024-07-22
+ * @details 已持有和正在等待的区间都放在按起点排序、记录子树最大终点的区间树(treap)里。
+ *          每个请求只等待比它先到、和它重叠且冲突的请求，先到先得，不会饿死写者。
+ *          内部的自旋锁只在树操作期间持有，等待发生在锁外，不相交的区间互不影响。
+ *          等待方式由模板参数决定：Semaphore阻塞线程，FiberSemaphore挂起协程
+ */
+#ifndef __CORO_RANGE_LOCK_H__
+#define __CORO_RANGE_LOCK_H__
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "fiber_mutex.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace coro {
+
+/**
+ * @brief 范围锁模板实现
+ * @tparam WaitType 等待者使用的信号量，需要wait()/notify()
+ */
+template <class WaitType>
+class RangeLockImpl : Noncopyable {
+   public:
+    /**
+     * @brief 一次加锁请求，lock返回，unlock时交回
+     * @details 在堆上分配，唤醒方不会访问等待者的栈
+     */
+    class Range : Noncopyable {
+        friend class RangeLockImpl;
+
+       public:
+        uint64_t getBegin() const { return m_begin; }
+        uint64_t getEnd() const { return m_end; }
+        bool isExclusive() const { return m_exclusive; }
+
+       private:
+        Range(uint64_t begin, uint64_t end, bool exclusive, uint64_t seq)
+            : m_begin(begin),
+              m_end(end),
+              m_maxEnd(end),
+              m_seq(seq),
+              m_exclusive(exclusive) {}
+
+       private:
+        /// 区间起点
+        uint64_t m_begin;
+        /// 区间终点(不含)
+        uint64_t m_end;
+        /// 子树中最大的终点
+        uint64_t m_maxEnd;
+        /// 到达顺序，同时用来生成treap优先级
+        uint64_t m_seq;
+        /// 是否独占
+        bool m_exclusive;
+        /// 还在阻塞自己的先到请求数
+        uint32_t m_blocking = 0;
+        Range* m_left = nullptr;
+        Range* m_right = nullptr;
+        /// 等待授予
+        WaitType m_wait;
+    };
+
+    /**
+     * @brief 局部范围锁
+     */
+    template <bool Exclusive>
+    class ScopedLock : Noncopyable {
+       public:
+        ScopedLock(RangeLockImpl& lock, uint64_t begin, uint64_t end)
+            : m_lock(lock) {
+            m_range = Exclusive ? m_lock.wrlock(begin, end)
+                                : m_lock.rdlock(begin, end);
+        }
+
+        ~ScopedLock() { unlock(); }
+
+        /**
+         * @brief 提前释放
+         */
+        void unlock() {
+            if (m_range) {
+                m_lock.unlock(m_range);
+                m_range = nullptr;
+            }
+        }
+
+       private:
+        RangeLockImpl& m_lock;
+        Range* m_range;
+    };
+
+    /// 局部共享锁
+    typedef ScopedLock<false> ReadLock;
+    /// 局部独占锁
+    typedef ScopedLock<true> WriteLock;
+
+    ~RangeLockImpl() { assert(!m_root); }
+
+    /**
+     * @brief 对[begin, end)加共享锁
+     */
+    Range* rdlock(uint64_t begin, uint64_t end) {
+        return lock(begin, end, false, true);
+    }
+
+    /**
+     * @brief 对[begin, end)加独占锁
+     */
+    Range* wrlock(uint64_t begin, uint64_t end) {
+        return lock(begin, end, true, true);
+    }
+
+    /**
+     * @brief 尝试加共享锁，有冲突时返回nullptr
+     */
+    Range* tryRdlock(uint64_t begin, uint64_t end) {
+        return lock(begin, end, false, false);
+    }
+
+    /**
+     * @brief 尝试加独占锁，有冲突时返回nullptr
+     */
+    Range* tryWrlock(uint64_t begin, uint64_t end) {
+        return lock(begin, end, true, false);
+    }
+
+    /**
+     * @brief 释放rdlock/wrlock返回的区间，唤醒因它而等待且不再有冲突的请求
+     */
+    void unlock(Range* range) {
+        std::vector<Range*> ready;
+        m_guard.lock();
+        m_root = Erase(m_root, range);
+        // 只有后到的请求才把它计入了阻塞数
+        Visit(m_root, range->m_begin, range->m_end, [&](Range* r) {
+            if (r->m_seq > range->m_seq && Conflict(r, range) &&
+                --r->m_blocking == 0) {
+                ready.push_back(r);
+            }
+        });
+        m_guard.unlock();
+        for (auto& i : ready) {
+            i->m_wait.notify();
+        }
+        delete range;
+    }
+
+   private:
+    Range* lock(uint64_t begin, uint64_t end, bool exclusive, bool wait) {
+        assert(begin < end);
+        Range* range = new Range(begin, end, exclusive, 0);
+        m_guard.lock();
+        range->m_seq = ++m_seq;
+        uint32_t blocking = 0;
+        Visit(m_root, begin, end, [&](Range* r) {
+            if (Conflict(r, range)) {
+                ++blocking;
+            }
+        });
+        if (blocking && !wait) {
+            m_guard.unlock();
+            delete range;
+            return nullptr;
+        }
+        range->m_blocking = blocking;
+        m_root = Insert(m_root, range);
+        m_guard.unlock();
+        if (blocking) {
+            range->m_wait.wait();
+        }
+        return range;
+    }
+
+    static bool Conflict(const Range* a, const Range* b) {
+        return a->m_exclusive || b->m_exclusive;
+    }
+
+    static uint64_t Priority(const Range* r) {
+        return r->m_seq * 0x9E3779B97F4A7C15ull;
+    }
+
+    static bool Less(const Range* a, const Range* b) {
+        return a->m_begin < b->m_begin ||
+               (a->m_begin == b->m_begin && a->m_seq < b->m_seq);
+    }
+
+    static uint64_t MaxEnd(const Range* r) { return r ? r->m_maxEnd : 0; }
+
+    static void Update(Range* r) {
+        r->m_maxEnd =
+            std::max(r->m_end, std::max(MaxEnd(r->m_left), MaxEnd(r->m_right)));
+    }
+
+    static Range* RotateRight(Range* r) {
+        Range* l = r->m_left;
+        r->m_left = l->m_right;
+        l->m_right = r;
+        Update(r);
+        Update(l);
+        return l;
+    }
+
+    static Range* RotateLeft(Range* r) {
+        Range* l = r->m_right;
+        r->m_right = l->m_left;
+        l->m_left = r;
+        Update(r);
+        Update(l);
+        return l;
+    }
+
+    static Range* Insert(Range* root, Range* range) {
+        if (!root) {
+            return range;
+        }
+        if (Less(range, root)) {
+            root->m_left = Insert(root->m_left, range);
+            if (Priority(root->m_left) > Priority(root)) {
+                return RotateRight(root);
+            }
+        } else {
+            root->m_right = Insert(root->m_right, range);
+            if (Priority(root->m_right) > Priority(root)) {
+                return RotateLeft(root);
+            }
+        }
+        Update(root);
+        return root;
+    }
+
+    static Range* Merge(Range* a, Range* b) {
+        if (!a || !b) {
+            return a ? a : b;
+        }
+        if (Priority(a) > Priority(b)) {
+            a->m_right = Merge(a->m_right, b);
+            Update(a);
+            return a;
+        }
+        b->m_left = Merge(a, b->m_left);
+        Update(b);
+        return b;
+    }
+
+    static Range* Erase(Range* root, Range* range) {
+        assert(root);
+        if (root == range) {
+            return Merge(root->m_left, root->m_right);
+        }
+        if (Less(range, root)) {
+            root->m_left = Erase(root->m_left, range);
+        } else {
+            root->m_right = Erase(root->m_right, range);
+        }
+        Update(root);
+        return root;
+    }
+
+    /**
+     * @brief 访问所有和[begin, end)相交的区间
+     */
+    template <class F>
+    static void Visit(Range* r, uint64_t begin, uint64_t end, F&& f) {
+        // 子树里所有区间都在begin之前结束
+        if (!r || r->m_maxEnd <= begin) {
+            return;
+        }
+        Visit(r->m_left, begin, end, f);
+        if (r->m_begin < end) {
+            if (r->m_end > begin) {
+                f(r);
+            }
+            Visit(r->m_right, begin, end, f);
+        }
+    }
+
+   private:
+    /// 保护区间树
+    Spinlock m_guard;
+    /// 区间树的根
+    Range* m_root = nullptr;
+    /// 请求序号
+    uint64_t m_seq = 0;
+};
+
+/// 阻塞线程的范围锁
+typedef RangeLockImpl<Semaphore> RangeLock;
+
+/// 挂起协程的范围锁，不在调度器协程里使用时退化成阻塞线程
+typedef RangeLockImpl<FiberSemaphore> FiberRangeLock;
+
+}  // namespace coro
+
+#endif
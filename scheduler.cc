@@ -6,12 +6,22 @@
  */
 #include "scheduler.h"
 
+#include <algorithm>
 #include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+#include "hook.h"
+
+namespace coro {
 
 static thread_local Scheduler* t_scheduler = nullptr;
 static thread_local Fiber* t_scheduler_fiber = nullptr;
 static thread_local int s_thread_id = 0;
 
+// 每个线程缓存的空闲任务节点数上限，超过后直接释放
+static const size_t kTaskCacheSize = 4096;
+
 // 获取调度器指针
 Scheduler* Scheduler::GetThis() { return t_scheduler; }
 
@@ -24,18 +34,36 @@ int Scheduler::GetThreadId() { return s_thread_id; }
 void Scheduler::SetThreadId(int thread_id) { s_thread_id = thread_id; }
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) {
+    assert(threads > 0);
     m_useCaller = use_caller;
     m_name = name;
+    m_queues.resize(threads);
+    for (auto& i : m_queues) {
+        i.reset(new TaskQueue());
+    }
     if (use_caller) {
         --threads;
+        assert(GetThis() == nullptr);
         t_scheduler = this;
+
+        // caller线程的主协程不参与调度，调度协程单独创建，结束时切回主协程
+        Fiber::GetThis();
+        m_rootFiber.reset(new Fiber(std::bind(&Scheduler::run, this), 0, false));
+        t_scheduler_fiber = m_rootFiber.get();
+        SetThreadId(m_rootThread);
+        m_threadIds.push_back(m_rootThread);
     } else {
         m_rootThread = -1;
     }
     m_threadCount = threads;
 }
 
-Scheduler::~Scheduler() {}
+Scheduler::~Scheduler() {
+    assert(m_stopping);
+    if (GetThis() == this) {
+        t_scheduler = nullptr;
+    }
+}
 
 void Scheduler::start() {
     std::lock_guard<std::mutex> lock(m_mutex);
@@ -47,47 +75,416 @@ void Scheduler::start() {
     assert(m_threads.empty());
     m_threads.resize(m_threadCount);
     for (size_t i = 0; i < m_threadCount; i++) {
+        // caller线程占用0号，工作线程依次编号
+        int id = static_cast<int>(i) + (m_useCaller ? 1 : 0);
+        m_threads[i].reset(new Thread(
+            [this, id]() {
+                SetThreadId(id);
+                run();
+            },
+            m_name + "_" + std::to_string(id)));
+        m_threadIds.push_back(id);
+    }
+}
+
+void Scheduler::stop() {
+    if (stopping()) {
+        return;
+    }
+    m_stopping = true;
+
+    // use_caller的调度器只能由caller线程停止
+    if (m_useCaller) {
+        assert(GetThis() == this);
+    } else {
+        assert(GetThis() != this);
+    }
+
+    for (size_t i = 0; i < m_threadCount; i++) {
+        tickle();
+    }
+    if (m_rootFiber) {
+        tickle();
+    }
+
+    // caller线程在这里开始调度，直到任务全部完成
+    if (m_rootFiber) {
+        m_rootFiber->resume();
+    }
+
+    std::vector<std::shared_ptr<Thread>> thrs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        thrs.swap(m_threads);
+    }
+    for (auto& i : thrs) {
+        i->join();
+    }
+}
+
+bool Scheduler::stopping() {
+    if (!m_stopping || m_activeThreadCount > 0) {
+        return false;
+    }
+    for (auto& i : m_queues) {
+        if (!i->empty()) {
+            return false;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_tasksHead) {
+            return false;
+        }
+    }
+    // 检查队列期间有线程取走了任务，它在取之前已经增加了计数
+    return m_activeThreadCount == 0;
+}
+
+Scheduler::TaskQueue* Scheduler::localQueue() {
+    if (GetThis() != this) {
+        return nullptr;
+    }
+    int id = GetThreadId();
+    if (id < 0 || static_cast<size_t>(id) >= m_queues.size()) {
+        return nullptr;
+    }
+    return m_queues[id].get();
+}
+
+void Scheduler::enqueue(SchedulerTask* task) {
+    TaskQueue* queue = task->thread == -1 ? localQueue() : nullptr;
+    if (queue) {
+        queue->push(task);
+    } else {
+        inject(task);
+    }
+    tickle();
+}
+
+void Scheduler::inject(SchedulerTask* task) {
+    task->next = nullptr;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tasksTail) {
+        m_tasksTail->next = task;
+    } else {
+        m_tasksHead = task;
+    }
+    m_tasksTail = task;
+    ++m_taskCount;
+}
+
+void Scheduler::enqueueBatch(SchedulerTask* head, SchedulerTask* tail,
+                             size_t count) {
+    if (!head) {
+        return;
+    }
+    tail->next = nullptr;
+    TaskQueue* queue = head->thread == -1 ? localQueue() : nullptr;
+    if (queue) {
+        // 分段压入本地队列，每段只发布一次底部位置
+        SchedulerTask* buf[64];
+        size_t n = 0;
+        while (head) {
+            SchedulerTask* next = head->next;
+            head->next = nullptr;
+            // 批量任务里固定线程的共享栈协程不能放进可被窃取的本地队列
+            if (head->thread == -1) {
+                buf[n++] = head;
+            } else {
+                inject(head);
+            }
+            head = next;
+            if (n == 64 || (!head && n)) {
+                queue->push(buf, n);
+                n = 0;
+            }
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_tasksTail) {
+            m_tasksTail->next = head;
+        } else {
+            m_tasksHead = head;
+        }
+        m_tasksTail = tail;
+        m_taskCount += count;
     }
+    tickleBatch(count);
+}
+
+void Scheduler::tickleBatch(size_t count) {
+    // 空闲线程不够时，正在运行的线程做完手上的任务后会自己取
+    size_t idle = m_idleThreadCount.load(std::memory_order_relaxed);
+    size_t n = std::max<size_t>(1, std::min(count, idle));
+    for (size_t i = 0; i < n; ++i) {
+        tickle();
+    }
+}
+
+Scheduler::SchedulerTask* Scheduler::popInjected(bool& tickle_me) {
+    if (m_taskCount == 0) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SchedulerTask* prev = nullptr;
+    SchedulerTask* it = m_tasksHead;
+    while (it) {
+        // 指定了其他线程的任务留给对应线程，并通知它
+        if (it->thread != -1 && it->thread != GetThreadId()) {
+            prev = it;
+            it = it->next;
+            tickle_me = true;
+            continue;
+        }
+
+        // 还在其他线程上运行的协程暂时跳过
+        assert(it->fiber || it->cb);
+        if (it->fiber && it->fiber->getState() == Fiber::RUNNING) {
+            prev = it;
+            it = it->next;
+            continue;
+        }
+        break;
+    }
+    if (!it) {
+        return nullptr;
+    }
+
+    (prev ? prev->next : m_tasksHead) = it->next;
+    if (m_tasksTail == it) {
+        m_tasksTail = prev;
+    }
+    it->next = nullptr;
+    --m_taskCount;
+    // 取出一个任务后还有剩余，通知其他线程
+    tickle_me |= (m_tasksHead != nullptr);
+    return it;
+}
+
+Scheduler::SchedulerTask* Scheduler::stealTask() {
+    static thread_local uint32_t s_seed = GetThreadId() * 2654435761u + 1;
+    size_t n = m_queues.size();
+    int self = GetThreadId();
+    // xorshift随机选择起始位置，避免所有空闲线程同时窃取同一个队列
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    size_t start = s_seed % n;
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = (start + i) % n;
+        if (static_cast<int>(idx) == self) {
+            continue;
+        }
+        SchedulerTask* task = m_queues[idx]->steal();
+        if (task) {
+            ++m_steals;
+            return task;
+        }
+    }
+    return nullptr;
 }
 
 void Scheduler::run() {
-    std::cout << "Scheduler::run() starts in thread: " << GetThreadId()
-              << std::endl;
+    // 调度线程上的阻塞调用都转换成协程切换
+    set_hook_enable(true);
     SetThis();
     if (GetThreadId() != m_rootThread) {
         assert(t_scheduler_fiber == nullptr);
         t_scheduler_fiber = Fiber::GetThis().get();
     }
+
+    Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+    // 线程局部的回调协程，执行完的函数任务会复用它的栈，而不是每次新建协程
+    Fiber::ptr cb_fiber;
+    // 回调协程开始运行时先把任务函数移到自己的栈上，之后任务节点就可以回收，
+    // 中途yield的回调协程也不再引用任务节点
+    TaskFunction* pending = nullptr;
+    std::function<void()> trampoline = [&pending]() {
+        TaskFunction cb(std::move(*pending));
+        pending = nullptr;
+        cb();
+    };
+    TaskQueue* local = m_queues[GetThreadId()].get();
+    uint32_t tick = 0;
+
+    while (true) {
+        bool tickle_me = false;
+        SchedulerTask* task = nullptr;
+        // 取任务之前就算作活跃，否则其他线程的stopping可能在任务取出后、
+        // 计数增加前看到队列为空且没有活跃线程，提前退出
+        ++m_activeThreadCount;
+        // 本地队列LIFO优先，每隔一段时间先检查注入队列，避免外部任务饿死
+        if (++tick % 61 == 0) {
+            task = popInjected(tickle_me);
+        }
+        if (!task) {
+            task = local->pop();
+        }
+        if (!task) {
+            task = popInjected(tickle_me);
+        }
+        if (!task) {
+            task = stealTask();
+        }
+
+        if (tickle_me) {
+            tickle();
+        }
+
+        // 刚把自己加入调度、还没切换出去的协程，放回注入队列等它切换完成
+        if (task && task->fiber && task->fiber->getState() == Fiber::RUNNING) {
+            inject(task);
+            task = nullptr;
+        }
+
+        if (task) {
+            ++m_tasksRun;
+        } else {
+            --m_activeThreadCount;
+        }
+
+        if (task && task->fiber) {
+            if (task->fiber->getState() != Fiber::TERM) {
+                ++m_switches;
+                task->fiber->resume();
+            }
+            --m_activeThreadCount;
+            DeleteTask(task);
+        } else if (task && task->cb) {
+            pending = &task->cb;
+            if (cb_fiber) {
+                cb_fiber->reset(trampoline);
+            } else {
+                cb_fiber.reset(new Fiber(trampoline));
+            }
+            ++m_switches;
+            cb_fiber->resume();
+            assert(pending == nullptr);
+            DeleteTask(task);
+            --m_activeThreadCount;
+            // 只有执行完且没有被别处持有的协程才能复用，
+            // 中途yield的协程已经交给了其他人重新调度
+            if (cb_fiber->getState() != Fiber::TERM ||
+                cb_fiber.use_count() > 1) {
+                cb_fiber.reset();
+            }
+        } else {
+            // 任务队列为空，idle协程结束说明调度器已经停止
+            if (idle_fiber->getState() == Fiber::TERM) {
+                break;
+            }
+            ++m_idleThreadCount;
+            ++m_switches;
+            idle_fiber->resume();
+            --m_idleThreadCount;
+            ++m_idleWakeups;
+        }
+    }
+    // use_caller时调用线程在stop之后继续执行普通代码，不再hook
+    set_hook_enable(false);
+}
+
+// 基类的idle协程只是让出，不需要唤醒
+void Scheduler::tickle() {}
+
+Scheduler::Metrics Scheduler::getMetrics() const {
+    Metrics metrics;
+    metrics.tasksRun = m_tasksRun.value();
+    metrics.steals = m_steals.value();
+    metrics.idleWakeups = m_idleWakeups.value();
+    metrics.switches = m_switches.value();
+    return metrics;
 }
 
-void Scheduler::tickle() { tickler++; }
+void Scheduler::idle() {
+    while (!stopping()) {
+        Fiber::GetThis()->yield();
+    }
+}
+
+void Scheduler::ThrowForeignFiber() {
+    // 在其他线程上换入共享栈协程会覆盖创建线程正在使用的栈
+    throw std::invalid_argument(
+        "shared stack fiber must run on the scheduler thread that created it");
+}
 
 // 发布线程任务
 void Scheduler::scheduleLock(std::shared_ptr<Fiber> fc, int thread_id) {
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        SchedulerTask task;
+    if (!canRun(fc, thread_id)) {
+        ThrowForeignFiber();
+    }
+    SchedulerTask* task = NewTask(thread_id);
+    SetTask(task, std::move(fc));
+    enqueue(task);
+}
+
+// 发布函数任务
+void Scheduler::scheduleLock(TaskFunction fc, int thread_id) {
+    SchedulerTask* task = NewTask(thread_id);
+    task->cb = std::move(fc);
+    enqueue(task);
+}
+
+/**
+ * @brief 线程的空闲任务节点缓存
+ * @details 任务常在一个线程提交、在另一个线程执行，节点放回执行线程的缓存，
+ *          缓存满了直接释放，不会无限增长
+ */
+struct TaskCache {
+    Scheduler::SchedulerTask* head = nullptr;
+    size_t size = 0;
+
+    ~TaskCache();
+};
 
-        task.fiber = fc;
-        task.cb = nullptr;
-        task.thread = thread_id;
+// 节点缓存已经析构，线程退出过程中释放的节点直接delete
+static thread_local bool t_task_cache_dead = false;
 
-        m_tasks.push_back(task);
+TaskCache::~TaskCache() {
+    t_task_cache_dead = true;
+    while (head) {
+        Scheduler::SchedulerTask* next = head->next;
+        delete head;
+        head = next;
     }
-    tickle();
 }
 
-// 发布函数任务
-void Scheduler::scheduleLock(std::function<void()> fc, int thread_id) {
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        SchedulerTask task;
+static TaskCache* GetTaskCache() {
+    if (t_task_cache_dead) {
+        return nullptr;
+    }
+    static thread_local TaskCache t_cache;
+    return &t_cache;
+}
 
-        task.fiber = nullptr;
-        task.cb = fc;
-        task.thread = thread_id;
+Scheduler::SchedulerTask* Scheduler::NewTask(int thread) {
+    TaskCache* cache = GetTaskCache();
+    SchedulerTask* task = nullptr;
+    if (cache && cache->head) {
+        task = cache->head;
+        cache->head = task->next;
+        --cache->size;
+        task->next = nullptr;
+    } else {
+        task = new SchedulerTask();
+    }
+    task->thread = thread;
+    return task;
+}
 
-        m_tasks.push_back(task);
+void Scheduler::DeleteTask(SchedulerTask* task) {
+    task->fiber.reset();
+    task->cb.reset();
+    task->thread = -1;
+    TaskCache* cache = GetTaskCache();
+    if (!cache || cache->size >= kTaskCacheSize) {
+        delete task;
+        return;
     }
-    tickle();
-}
\ No newline at end of file
+    task->next = cache->head;
+    cache->head = task;
+    ++cache->size;
+}
+
+}  // namespace coro
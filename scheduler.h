@@ -9,19 +9,35 @@
 #define __CORO_SCHEDULER_H__
 
 #include <atomic>
-#include <list>
+#include <functional>
+#include <initializer_list>
 #include <mutex>
 #include <string>
 #include <vector>
 
+#include "counter.h"
 #include "fiber.h"
+#include "task.h"
+#include "thread.h"
+#include "work_stealing_queue.h"
 
-class Fiber;
-
-class Thread;
+namespace coro {
 
+/**
+ * @brief 协程调度器
+ * @details N个线程调度M个协程，协程可以在线程之间切换，也可以绑定到指定线程运行。
+ * use_caller为true时，创建调度器的线程也参与调度，它的调度协程在stop()时才开始运行。
+ * 每个调度线程有自己的工作窃取队列，调度线程内提交的任务放入本地队列，
+ * 外部线程提交的任务和绑定了线程的任务放入全局注入队列，空闲的线程从其他线程的队列窃取任务
+ */
 class Scheduler {
    public:
+    /**
+     * @brief 构造函数
+     * @param[in] threads 线程数量
+     * @param[in] use_caller 是否使用当前调用线程参与调度
+     * @param[in] name 调度器名称
+     */
     Scheduler(size_t threads = 1, bool use_caller = true,
               const std::string& name = "Scheduler");
 
@@ -29,96 +45,258 @@ class Scheduler {
 
     const std::string& getName() const { return m_name; }
 
+    /**
+     * @brief 返回当前线程的调度器
+     */
     static Scheduler* GetThis();
     void SetThis();
 
+    /**
+     * @brief 返回当前线程的调度协程
+     */
     static Fiber* GetSchedulerFiber();
 
+    /**
+     * @brief 添加调度任务
+     * @param[in] fc 协程或函数
+     * @param[in] thread_id 指定运行的线程号，-1表示任意线程，共享栈协程默认回到所属线程
+     * @exception std::invalid_argument 共享栈协程不是本调度器的线程创建的，或者指定了其他线程
+     */
     void scheduleLock(std::shared_ptr<Fiber> fc, int thread_id = -1);
-    void scheduleLock(std::function<void()> fc, int thread_id = -1);
+    void scheduleLock(TaskFunction fc, int thread_id = -1);
+
+    /**
+     * @brief 批量添加调度任务，整批只入队一次，按需要唤醒空闲线程
+     * @details 调度线程内提交的未绑定任务一次压入本地队列，其他的在一次加锁中
+     *          接到注入队列尾部。元素是协程或函数，会被移走，空元素被忽略
+     * @param[in] begin 起始迭代器
+     * @param[in] end 结束迭代器
+     * @param[in] thread_id 指定运行的线程号，-1表示任意线程
+     * @exception std::invalid_argument 同scheduleLock，出错元素之前的元素已经提交
+     */
+    template <class InputIterator>
+    void schedule(InputIterator begin, InputIterator end, int thread_id = -1) {
+        SchedulerTask* head = nullptr;
+        SchedulerTask* tail = nullptr;
+        size_t count = 0;
+        for (; begin != end; ++begin) {
+            if (!canRun(*begin, thread_id)) {
+                enqueueBatch(head, tail, count);
+                ThrowForeignFiber();
+            }
+            SchedulerTask* task = NewTask(thread_id);
+            SetTask(task, std::move(*begin));
+            if (!task->fiber && !task->cb) {
+                DeleteTask(task);
+                continue;
+            }
+            (tail ? tail->next : head) = task;
+            tail = task;
+            ++count;
+        }
+        enqueueBatch(head, tail, count);
+    }
+
+    /**
+     * @brief 批量添加函数任务
+     */
+    void schedule(std::initializer_list<std::function<void()>> cbs,
+                  int thread_id = -1) {
+        schedule(cbs.begin(), cbs.end(), thread_id);
+    }
 
+    /**
+     * @brief 返回当前线程在调度器中的线程号
+     */
     static int GetThreadId();
     static void SetThreadId(int thread_id);
 
+    /**
+     * @brief 启动调度器，创建工作线程
+     */
     virtual void start();
+
+    /**
+     * @brief 停止调度器，等所有任务执行完成后返回
+     */
     virtual void stop();
 
+    /**
+     * @brief 通知调度器有新任务
+     */
     virtual void tickle();
 
+    /**
+     * @brief 调度器运行统计，各线程分片计数，读取时汇总
+     */
+    struct Metrics {
+        /// 执行的任务数
+        uint64_t tasksRun = 0;
+        /// 从其他线程窃取成功的任务数
+        uint64_t steals = 0;
+        /// idle协程返回调度循环的次数
+        uint64_t idleWakeups = 0;
+        /// 调度循环切入协程的次数，包括任务协程和idle协程
+        uint64_t switches = 0;
+    };
+
+    /**
+     * @brief 返回运行统计
+     */
+    Metrics getMetrics() const;
+
    protected:
+    /**
+     * @brief 调度协程的主循环
+     */
     virtual void run();
 
+    /**
+     * @brief 没有任务时运行idle协程
+     */
     virtual void idle();
 
-    virtual bool stopping() { return m_stopping; }
+    /**
+     * @brief 返回是否可以停止
+     */
+    virtual bool stopping();
 
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
 
    private:
-    // 调度任务，协程/函数二选一，可指定在哪个线程上调度
+    struct SchedulerTask;
+    typedef WorkStealingQueue<SchedulerTask*> TaskQueue;
+
+    /**
+     * @brief 提交任务，调度线程内提交的未绑定任务放入本地队列，其他放入注入队列
+     */
+    void enqueue(SchedulerTask* task);
+
+    /**
+     * @brief 提交head到tail之间通过next串起来的count个任务
+     */
+    void enqueueBatch(SchedulerTask* head, SchedulerTask* tail, size_t count);
+
+    /**
+     * @brief 新提交了count个任务，唤醒最多count个空闲线程
+     */
+    void tickleBatch(size_t count);
+
+    /**
+     * @brief 放入全局注入队列
+     */
+    void inject(SchedulerTask* task);
+
+    /**
+     * @brief 从注入队列取出一个可以在当前线程执行的任务
+     * @param[out] tickle_me 注入队列中还有其他任务时置为true
+     */
+    SchedulerTask* popInjected(bool& tickle_me);
+
+    /**
+     * @brief 从其他线程的队列窃取一个任务
+     */
+    SchedulerTask* stealTask();
+
+    /**
+     * @brief 返回当前线程在本调度器中的本地队列，不是本调度器的线程返回nullptr
+     */
+    TaskQueue* localQueue();
+
+   private:
+    // 调度任务，协程/函数二选一，可指定在哪个线程上调度。
+    // 只能移动，节点由线程缓存复用，提交和执行一个小任务不需要分配内存
     struct SchedulerTask {
         std::shared_ptr<Fiber> fiber;
-        std::function<void()> cb;
-        int thread;
+        TaskFunction cb;
+        int thread = -1;
+        // 注入队列和节点缓存的链表指针
+        SchedulerTask* next = nullptr;
+    };
 
-        SchedulerTask() {
-            fiber = nullptr;
-            cb = nullptr;
-            thread = -1;
-        }
+    friend struct TaskCache;
 
-        SchedulerTask(std::shared_ptr<Fiber> f, int thr) {
-            fiber = f;
-            thread = thr;
-        }
+    /**
+     * @brief 从当前线程的节点缓存取一个空任务节点
+     */
+    static SchedulerTask* NewTask(int thread);
 
-        SchedulerTask(std::shared_ptr<Fiber>* f, int thr) {
-            fiber.swap(*f);
-            thread = thr;
-        }
+    /**
+     * @brief 清空任务节点并放回当前线程的节点缓存
+     */
+    static void DeleteTask(SchedulerTask* task);
 
-        SchedulerTask(std::function<void()> f, int thr) {
-            cb = f;
-            thread = thr;
-        }
+    /**
+     * @brief 共享栈协程只能在创建它的调度器线程上运行
+     */
+    bool canRun(const std::shared_ptr<Fiber>& fiber, int thread) const {
+        return !fiber || !fiber->isSharedStack() ||
+               (fiber->getScheduler() == this &&
+                (thread == -1 || thread == fiber->getThread()));
+    }
+
+    template <class F>
+    bool canRun(const F&, int) const {
+        return true;
+    }
+
+    /**
+     * @brief canRun不满足时抛出std::invalid_argument
+     */
+    [[noreturn]] static void ThrowForeignFiber();
 
-        void reset() {
-            fiber = nullptr;
-            cb = nullptr;
-            thread = -1;
+    static void SetTask(SchedulerTask* task, std::shared_ptr<Fiber>&& fiber) {
+        if (task->thread == -1 && fiber) {
+            task->thread = fiber->getThread();
         }
-    };
+        task->fiber = std::move(fiber);
+    }
+
+    template <class F>
+    static void SetTask(SchedulerTask* task, F&& cb) {
+        task->cb = TaskFunction(std::forward<F>(cb));
+    }
 
    private:
     // 协程调度器名称
     std::string m_name;
-    // 互斥锁
-    std::mutex m_mutex;
+    // 互斥锁，下面几个被所有调度线程频繁读写的成员各占一个缓存行
+    alignas(kCacheLineSize) std::mutex m_mutex;
     // 线程池
     std::vector<std::shared_ptr<Thread>> m_threads;
-    // 任务队列
-    std::vector<SchedulerTask> m_tasks;
+    // 全局注入队列，外部线程提交的任务和绑定了线程的任务，通过next串成的FIFO链表
+    SchedulerTask* m_tasksHead = nullptr;
+    SchedulerTask* m_tasksTail = nullptr;
+    // 注入队列中的任务数，用于无锁判断注入队列是否为空
+    alignas(kCacheLineSize) std::atomic<size_t> m_taskCount = {0};
+    // 每个调度线程的工作窃取队列，下标为调度器内的线程号
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;
     // 线程池的线程ID数组
     std::vector<int> m_threadIds;
     // 工作线程的数量，不包括use_caller主线程
     size_t m_threadCount = 0;
     // 活跃的线程数
-    std::atomic<size_t> m_activeThreadCount = {0};
+    alignas(kCacheLineSize) std::atomic<size_t> m_activeThreadCount = {0};
     // idle 线程数
-    std::atomic<size_t> m_idleThreadCount = {0};
+    alignas(kCacheLineSize) std::atomic<size_t> m_idleThreadCount = {0};
 
     // 是否使用caller线程执行任务
-    bool m_useCaller;
+    alignas(kCacheLineSize) bool m_useCaller;
     // use_caller为true时，调度器所在线程的调度协程 -> 必须在类内持有
     // 不然创建完就会被释放
     std::shared_ptr<Fiber> m_rootFiber;
     // 调度器所在线程的id
     int m_rootThread = 0;
-    // 用于唤醒在idle协程中的线程
-    std::atomic<int> tickler;
+    // 运行统计
+    ShardedCounter m_tasksRun;
+    ShardedCounter m_steals;
+    ShardedCounter m_idleWakeups;
+    ShardedCounter m_switches;
 
    protected:
-    bool m_stopping = false;
+    std::atomic<bool> m_stopping = {false};
 };
 
-#endif
\ No newline at end of file
+}  // namespace coro
+
+#endif
@@ -4,6 +4,9 @@
  * @author shawn
  * @date 2024-05-18
  */
+#ifndef __CORO_SINGLETON_H__
+#define __CORO_SINGLETON_H__
+
 namespace coro {
 
 /**
@@ -23,4 +26,6 @@ class Singleton {
         return &v;
     }
 };
-}  // namespace coro
\ No newline at end of file
+}  // namespace coro
+
+#endif
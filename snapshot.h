@@ -0,0 +1,51 @@
+/**
+ * @file snapshot.h
+ * @brief 线程缓存的只读快照
+ * @author shawn
+ * @date 2024-07-14
+ * @details 写者在锁内替换共享指针并增加版本号，读者比较自己缓存的版本号，
+ *          一致时直接使用缓存的指针，只有一次acquire读，没有锁和引用计数操作
+ */
+#ifndef __CORO_SNAPSHOT_H__
+#define __CORO_SNAPSHOT_H__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace coro {
+
+/**
+ * @brief 线程缓存的快照
+ */
+struct SnapshotCache {
+    /// 缓存的版本，0表示没有缓存
+    uint64_t version = 0;
+    /// 缓存的值，持有一份引用计数
+    std::shared_ptr<const void> value;
+};
+
+/**
+ * @brief 分配一个全局唯一的快照槽位，每个发布快照的对象一个，不回收
+ */
+inline uint32_t AllocSnapshotSlot() {
+    static std::atomic<uint32_t> s_slot{0};
+    return s_slot.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 返回当前线程在槽位slot上的快照缓存
+ */
+inline SnapshotCache &GetSnapshotCache(uint32_t slot) {
+    static thread_local std::vector<SnapshotCache> t_caches;
+    if (slot >= t_caches.size()) {
+        t_caches.resize(slot + 1);
+    }
+    return t_caches[slot];
+}
+
+}  // namespace coro
+
+#endif
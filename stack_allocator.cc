@@ -0,0 +1,185 @@
+/**
+ * @file stack_allocator.cc
+ * @brief 协程栈内存分配器实现
+ * @author shawn
+ * @date 2024-06-21
+ */
+#include "stack_allocator.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace coro {
+
+namespace {
+
+/**
+ * @brief 同一大小的空闲栈链表
+ */
+struct FreeList {
+    size_t size;
+    std::vector<void*> stacks;
+};
+
+/**
+ * @brief 按栈大小分组的空闲栈，协程栈的大小一般只有一两种，线性查找即可
+ */
+struct FreeLists {
+    std::vector<FreeList> lists;
+
+    FreeList& get(size_t size) {
+        for (auto& i : lists) {
+            if (i.size == size) {
+                return i;
+            }
+        }
+        lists.push_back(FreeList{size, {}});
+        return lists.back();
+    }
+};
+
+size_t PageSize() {
+    static const size_t s_page_size = sysconf(_SC_PAGESIZE);
+    return s_page_size;
+}
+
+size_t RoundUp(size_t size) {
+    size_t page = PageSize();
+    return (size + page - 1) & ~(page - 1);
+}
+
+void* MapStack(size_t size) {
+    size_t page = PageSize();
+    void* base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (base == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    // 栈向低地址增长，保护页放在最低的一页
+    if (mprotect(base, page, PROT_NONE)) {
+        munmap(base, size + page);
+        throw std::bad_alloc();
+    }
+    return static_cast<char*>(base) + page;
+}
+
+void UnmapStack(void* vp, size_t size) {
+    size_t page = PageSize();
+    munmap(static_cast<char*>(vp) - page, size + page);
+}
+
+/**
+ * @brief 全局池，进程退出时不析构，避免和线程局部缓存的析构顺序产生依赖
+ */
+struct GlobalPool {
+    std::mutex mutex;
+    FreeLists free;
+    size_t count = 0;
+};
+
+GlobalPool& GetGlobalPool() {
+    static GlobalPool* s_pool = new GlobalPool;
+    return *s_pool;
+}
+
+// 线程局部缓存是否已经析构，线程退出过程中释放的栈直接munmap
+thread_local bool t_cache_destroyed = false;
+
+/**
+ * @brief 线程局部缓存，线程退出时把栈归还到全局池
+ */
+struct ThreadCache {
+    FreeLists free;
+
+    ~ThreadCache() {
+        t_cache_destroyed = true;
+        for (auto& i : free.lists) {
+            release(i, i.stacks.size());
+        }
+    }
+
+    // 从list尾部转移n个栈到全局池，全局池满了就直接释放
+    void release(FreeList& list, size_t n) {
+        GlobalPool& pool = GetGlobalPool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        FreeList& global = pool.free.get(list.size);
+        while (n-- && !list.stacks.empty()) {
+            void* vp = list.stacks.back();
+            list.stacks.pop_back();
+            if (pool.count < PooledStackAllocator::kGlobalPoolSize) {
+                global.stacks.push_back(vp);
+                ++pool.count;
+            } else {
+                UnmapStack(vp, list.size);
+            }
+        }
+    }
+
+    // 从全局池批量取栈到list
+    void refill(FreeList& list) {
+        GlobalPool& pool = GetGlobalPool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        FreeList& global = pool.free.get(list.size);
+        size_t n = PooledStackAllocator::kBatchSize;
+        while (n-- && !global.stacks.empty()) {
+            list.stacks.push_back(global.stacks.back());
+            global.stacks.pop_back();
+            --pool.count;
+        }
+    }
+};
+
+thread_local ThreadCache t_cache;
+
+}  // namespace
+
+void* PooledStackAllocator::Alloc(size_t size) {
+    size = RoundUp(size);
+    if (t_cache_destroyed) {
+        return MapStack(size);
+    }
+    FreeList& list = t_cache.free.get(size);
+    if (list.stacks.empty()) {
+        t_cache.refill(list);
+    }
+    if (!list.stacks.empty()) {
+        void* vp = list.stacks.back();
+        list.stacks.pop_back();
+        return vp;
+    }
+    return MapStack(size);
+}
+
+void PooledStackAllocator::Dealloc(void* vp, size_t size) {
+    if (!vp) {
+        return;
+    }
+    size = RoundUp(size);
+    if (t_cache_destroyed) {
+        UnmapStack(vp, size);
+        return;
+    }
+    FreeList& list = t_cache.free.get(size);
+    if (list.stacks.size() >= kThreadCacheSize) {
+        t_cache.release(list, kBatchSize);
+    }
+    list.stacks.push_back(vp);
+}
+
+size_t PooledStackAllocator::CachedStacks() {
+    size_t count = 0;
+    if (!t_cache_destroyed) {
+        for (auto& i : t_cache.free.lists) {
+            count += i.stacks.size();
+        }
+    }
+    GlobalPool& pool = GetGlobalPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return count + pool.count;
+}
+
+}  // namespace coro
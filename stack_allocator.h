@@ -0,0 +1,62 @@
+/**
+ * @file stack_allocator.h
+ * @brief 协程栈内存分配器
+ * @author shawn
+ * @date 2024-06-21
+ */
+#ifndef __CORO_STACK_ALLOCATOR_H__
+#define __CORO_STACK_ALLOCATOR_H__
+
+#include <stddef.h>
+#include <stdlib.h>
+
+namespace coro {
+
+/**
+ * @brief malloc栈内存分配器
+ */
+class MallocStackAllocator {
+   public:
+    static void* Alloc(size_t size) { return malloc(size); }
+    static void Dealloc(void* vp, size_t size) { return free(vp); }
+};
+
+/**
+ * @brief mmap栈内存分配器，带保护页和两级缓存
+ * @details 每个栈单独mmap，并在栈底(低地址)放一个PROT_NONE保护页，栈溢出时直接SIGSEGV。
+ *          释放的栈先放入线程局部的空闲链表，满了之后批量归还到全局池，
+ *          全局池也满了才munmap；分配时顺序相反。复用的栈已经缺页过，不会再触发page fault
+ */
+class PooledStackAllocator {
+   public:
+    /**
+     * @brief 分配一个栈
+     * @param[in] size 栈大小，内部按页对齐
+     * @return 可用栈空间的起始地址(不包括保护页)
+     * @exception mmap失败时抛出std::bad_alloc
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief 归还一个栈
+     * @param[in] vp Alloc返回的地址
+     * @param[in] size 分配时传入的栈大小
+     */
+    static void Dealloc(void* vp, size_t size);
+
+    /**
+     * @brief 返回全局池和当前线程缓存里空闲栈的数量
+     */
+    static size_t CachedStacks();
+
+    /// 每个线程缓存的最大栈数
+    static const size_t kThreadCacheSize = 64;
+    /// 线程缓存和全局池之间一次转移的栈数
+    static const size_t kBatchSize = kThreadCacheSize / 2;
+    /// 全局池的最大栈数
+    static const size_t kGlobalPoolSize = 1024;
+};
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file task.h
+ * @brief 只能移动的任务函数，小的可调用对象直接存放在对象内部
+ * @author shawn
+ * @date 2024-07-25
+ * @details std::function要求可拷贝，libstdc++只能内联存放16字节以内的对象，
+ *          捕获了几个指针的lambda就要分配内存。TaskFunction只能移动，
+ *          内联存放kInlineSize字节以内、移动不抛异常的对象，更大的才放到堆上
+ */
+#ifndef __CORO_TASK_H__
+#define __CORO_TASK_H__
+
+#include <cstddef>
+
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace coro {
+
+/**
+ * @brief 无参数无返回值的任务函数
+ */
+class TaskFunction {
+   public:
+    /// 内联存储的大小，能放下std::function和捕获5个指针的lambda
+    static constexpr size_t kInlineSize = 48;
+
+    TaskFunction() noexcept = default;
+
+    TaskFunction(std::nullptr_t) noexcept {}
+
+    /**
+     * @brief 从可调用对象构造，空的std::function和空函数指针得到空任务
+     */
+    template <class F, class D = typename std::decay<F>::type,
+              class = typename std::enable_if<
+                  !std::is_same<D, TaskFunction>::value &&
+                  std::is_invocable_r<void, D&>::value>::type>
+    TaskFunction(F&& f) {
+        if (IsNull(f)) {
+            return;
+        }
+        if constexpr (sizeof(D) <= kInlineSize &&
+                      alignof(D) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<D>::value) {
+            new (m_storage) D(std::forward<F>(f));
+            m_ops = &InlineOps<D>::ops;
+        } else {
+            *reinterpret_cast<D**>(m_storage) = new D(std::forward<F>(f));
+            m_ops = &HeapOps<D>::ops;
+        }
+    }
+
+    TaskFunction(TaskFunction&& other) noexcept { moveFrom(other); }
+
+    TaskFunction& operator=(TaskFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    TaskFunction& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    TaskFunction(const TaskFunction&) = delete;
+    TaskFunction& operator=(const TaskFunction&) = delete;
+
+    ~TaskFunction() { reset(); }
+
+    /**
+     * @brief 是否为空
+     */
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    /**
+     * @brief 调用，任务不能为空
+     */
+    void operator()() { m_ops->invoke(m_storage); }
+
+    /**
+     * @brief 析构保存的可调用对象，变成空任务
+     */
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+   private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        /// 把src的对象移动到dst并析构src的对象
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* storage);
+    };
+
+    template <class D>
+    struct InlineOps {
+        static void Invoke(void* s) { (*static_cast<D*>(s))(); }
+        static void Move(void* dst, void* src) {
+            new (dst) D(std::move(*static_cast<D*>(src)));
+            static_cast<D*>(src)->~D();
+        }
+        static void Destroy(void* s) { static_cast<D*>(s)->~D(); }
+        static constexpr Ops ops = {&Invoke, &Move, &Destroy};
+    };
+
+    template <class D>
+    struct HeapOps {
+        static void Invoke(void* s) { (**static_cast<D**>(s))(); }
+        static void Move(void* dst, void* src) {
+            *static_cast<D**>(dst) = *static_cast<D**>(src);
+        }
+        static void Destroy(void* s) { delete *static_cast<D**>(s); }
+        static constexpr Ops ops = {&Invoke, &Move, &Destroy};
+    };
+
+    template <class F>
+    static bool IsNull(const F&) {
+        return false;
+    }
+
+    template <class F>
+    static bool IsNull(F* const& f) {
+        return f == nullptr;
+    }
+
+    template <class Sig>
+    static bool IsNull(const std::function<Sig>& f) {
+        return !f;
+    }
+
+    void moveFrom(TaskFunction& other) noexcept {
+        if (other.m_ops) {
+            other.m_ops->move(m_storage, other.m_storage);
+            m_ops = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+   private:
+    alignas(std::max_align_t) unsigned char m_storage[kInlineSize];
+    const Ops* m_ops = nullptr;
+};
+
+}  // namespace coro
+
+#endif
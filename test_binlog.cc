@@ -0,0 +1,99 @@
+/**
+ * @file test_binlog.cc
+ * @brief 二进制日志测试
+ * @version 0.1
+ * @date 2024-07-12
+ */
+#include <unistd.h>
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "binlog.h"
+#include "thread.h"
+
+// 多个线程写二进制日志，段文件轮转后逐条解码校验
+void test_segments() {
+    const char* prefix = "/tmp/coro_test_binlog";
+    for (int i = 0; i < 64; ++i) {
+        unlink((std::string(prefix) + "." + std::to_string(i)).c_str());
+    }
+    coro::LogFlusherMgr::GetInstance()->setOverflowPolicy(
+        coro::LogFlusher::BLOCK);
+    coro::Logger::ptr logger = CORO_LOG_NAME("binlog");
+    coro::BinLogAppender::ptr appender(
+        new coro::BinLogAppender(prefix, 1024 * 1024));
+    logger->addAppender(appender);
+
+    const int kThreads = 2;
+    const int kLines = 20000;
+    std::vector<coro::Thread::ptr> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.push_back(coro::Thread::ptr(new coro::Thread(
+            [i, logger]() {
+                std::string name = "thread_" + std::to_string(i);
+                for (int j = 0; j < kLines; ++j) {
+                    CORO_BINLOG_INFO(logger, "%s line %d value %.2f %5s|%x",
+                                     name, j, j / 4.0, "ab", 255u);
+                }
+            },
+            "binlog_" + std::to_string(i))));
+    }
+    for (auto& i : threads) {
+        i->join();
+    }
+    // 文本日志也可以写到二进制Appender
+    CORO_LOG_WARN(logger) << "text " << 42;
+    coro::LogFlusherMgr::GetInstance()->flush();
+    logger->delAppender(appender);
+    std::vector<std::string> segments = appender->getSegments();
+    appender.reset();
+
+    std::cout << "segments: " << segments.size() << std::endl;
+    assert(segments.size() > 1);
+
+    std::vector<int> next(kThreads, 0);
+    int text = 0;
+    for (auto& path : segments) {
+        coro::BinLogReader reader;
+        assert(reader.open(path));
+        coro::BinLogReader::Entry entry;
+        while (reader.next(entry)) {
+            if (entry.level == coro::LogLevel::WARN) {
+                assert(entry.message == "text 42");
+                ++text;
+                continue;
+            }
+            int t = entry.message[7] - '0';
+            std::string expect = "thread_" + std::to_string(t) + " line " +
+                                 std::to_string(next[t]) + " value ";
+            assert(entry.message.compare(0, expect.size(), expect) == 0);
+            assert(entry.message.find("   ab|ff") != std::string::npos);
+            assert(entry.format->file == __FILE__);
+            ++next[t];
+        }
+        assert(!reader.isCorrupted());
+    }
+    for (int i = 0; i < kThreads; ++i) {
+        assert(next[i] == kLines);
+    }
+    assert(text == 1);
+
+    coro::BinLogReader reader;
+    assert(reader.open(segments[0]));
+    coro::BinLogReader::Entry entry;
+    assert(reader.next(entry));
+    std::string line;
+    coro::BinLogReader::ToString(entry, line);
+    std::cout << line;
+}
+
+int main(int argc, char* argv[]) {
+    // 没有二进制Appender时解码成文本输出
+    CORO_BINLOG_INFO(CORO_LOG_ROOT(), "hello %s %d %.1f %p", "binlog", -1, 0.5,
+                     (void*)0x10);
+    test_segments();
+    return 0;
+}
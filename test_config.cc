@@ -0,0 +1,231 @@
+/**
+ * @file test_config.cc
+ * @brief 配置模块测试
+ * @version 0.1
+ * @date 2024-07-18
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "fiber_mutex.h"
+#include "iomanager.h"
+
+static coro::ConfigVar<int>::ptr g_int =
+    coro::Config::Lookup("test.int", 8080, "test int");
+static coro::ConfigVar<std::vector<int>>::ptr g_vec =
+    coro::Config::Lookup("test.vec", std::vector<int>{1, 2}, "test vec");
+
+// 快照在修改后可见，旧快照的持有者不受影响
+void test_snapshot() {
+    int old_value = 0;
+    int new_value = 0;
+    uint64_t id = g_int->addListener([&](const int& o, const int& n) {
+        old_value = o;
+        new_value = n;
+    });
+
+    assert(g_int->getSnapshot() == 8080);
+    uint64_t version = g_int->getVersion();
+    std::shared_ptr<const std::vector<int>> held = g_vec->getSnapshotPtr();
+
+    g_int->setValue(9090);
+    g_vec->setValue({3, 4, 5});
+    assert(old_value == 8080 && new_value == 9090);
+    assert(g_int->getVersion() == version + 1);
+    assert(g_int->getSnapshot() == 9090);
+    assert(g_int->getValue() == 9090);
+    assert(g_vec->getSnapshot().size() == 3);
+    assert(held->size() == 2);
+
+    // 值没变不发布新版本
+    g_int->setValue(9090);
+    assert(g_int->getVersion() == version + 1);
+    g_int->delListener(id);
+}
+
+// 一个线程不断修改，其他线程读到的值必须是某次写入的完整值
+void test_concurrent() {
+    std::atomic<bool> stop{false};
+    std::thread writer([&]() {
+        for (int i = 0; !stop; ++i) {
+            g_vec->setValue(std::vector<int>(i % 64 + 1, i));
+        }
+    });
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([]() {
+            for (int j = 0; j < 200000; ++j) {
+                const std::vector<int>& v = g_vec->getSnapshot();
+                assert(!v.empty());
+                assert(v.front() == v.back());
+            }
+        });
+    }
+    for (auto& i : readers) {
+        i.join();
+    }
+    stop = true;
+    writer.join();
+    std::cout << "concurrent ok, version " << g_vec->getVersion() << std::endl;
+}
+
+// 容器直接从YAML节点转换，和字符串路径结果一致
+void test_node_cast() {
+    YAML::Node root = YAML::Load(
+        "ports: [80, 443]\n"
+        "groups: {a: [1, 2], b: [3]}\n"
+        "names: [x, y, x]\n");
+    coro::ConfigVar<std::map<std::string, std::vector<int>>>::ptr groups =
+        coro::Config::Lookup("test.groups",
+                             std::map<std::string, std::vector<int>>(), "");
+    coro::ConfigVar<std::set<std::string>>::ptr names =
+        coro::Config::Lookup("test.names", std::set<std::string>(), "");
+
+    assert(g_vec->fromNode(root["ports"]));
+    assert(g_vec->getSnapshot() == std::vector<int>({80, 443}));
+    assert(groups->fromNode(root["groups"]));
+    assert(groups->getSnapshot().at("a") == std::vector<int>({1, 2}));
+    assert(names->fromNode(root["names"]));
+    assert(names->getSnapshot().size() == 2);
+    assert(!g_int->fromNode(root["groups"]));
+
+    // 转成字符串再转回来
+    std::string str = groups->toString();
+    groups->setValue({});
+    assert(groups->fromString(str));
+    assert(groups->getSnapshot().at("b") == std::vector<int>({3}));
+    std::cout << "node cast ok: " << str << std::endl;
+}
+
+// 分片注册表：类型不匹配返回nullptr，句柄缓存同一个配置参数
+void test_lookup() {
+    assert(coro::Config::Lookup("test.int", 1) == g_int);
+    assert(coro::Config::Lookup<int>("test.int") == g_int);
+    assert(!coro::Config::Lookup<std::string>("test.int"));
+    assert(!coro::Config::Lookup("test.int", std::string("x")));
+    assert(coro::Config::LookupBase("test.vec") == g_vec);
+
+    bool thrown = false;
+    try {
+        coro::Config::Lookup("Test.Bad-Name", 1);
+    } catch (std::invalid_argument& e) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    coro::ConfigHandle<int> handle("test.int", 2);
+    assert(handle.get() == g_int.get());
+    coro::ConfigHandle<double> created("test.handle", 1.5);
+    assert(created->getValue() == 1.5);
+    assert(coro::Config::Lookup<double>("test.handle").get() == created.get());
+    coro::ConfigHandle<std::string> mismatch("test.int", "x");
+    assert(!mismatch.get());
+    assert(!mismatch.get());
+    thrown = false;
+    try {
+        mismatch->getValue();
+    } catch (std::invalid_argument& e) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    size_t count = 0;
+    coro::Config::Visit([&count](coro::ConfigVarBase::ptr var) { ++count; });
+    std::cout << "lookup ok, " << count << " vars" << std::endl;
+    assert(count >= 5);
+}
+
+static void write_file(const std::string& path, const std::string& content) {
+    // 先写临时文件再rename，和编辑器保存的方式一样
+    std::ofstream ofs(path + ".tmp");
+    ofs << content;
+    ofs.close();
+    rename((path + ".tmp").c_str(), path.c_str());
+}
+
+// 目录加载和监听：只重新解析变化的文件，只有值变了的参数触发回调
+void test_reload() {
+    const std::string dir = "/tmp/coro_test_conf";
+    int rt = system(("rm -rf " + dir + " && mkdir -p " + dir + "/sub").c_str());
+    assert(rt == 0);
+    write_file(dir + "/a.yml", "test:\n  int: 1\n");
+    write_file(dir + "/sub/b.yml", "test:\n  vec: [7]\n");
+
+    coro::Config::LoadFromConfDir(dir);
+    assert(g_int->getValue() == 1);
+    assert(g_vec->getValue() == std::vector<int>({7}));
+
+    // 监听器运行在调度器的任务协程里，而不是线程主协程或调度协程
+    auto in_task_fiber = []() {
+        coro::Fiber::ptr cur = coro::Fiber::GetThis();
+        return cur->isRunInScheduler() &&
+               cur.get() != coro::Scheduler::GetSchedulerFiber();
+    };
+    coro::IOManager iom(1, false, "conf");
+    std::atomic<int> int_changes{0};
+    std::atomic<int> vec_changes{0};
+    std::atomic<bool> in_fiber{true};
+    std::atomic<bool> reloaded{false};
+    g_int->addListener([&](const int&, const int&) {
+        ++int_changes;
+        in_fiber = in_fiber && in_task_fiber();
+    });
+    g_vec->addListener([&](const std::vector<int>&, const std::vector<int>&) {
+        ++vec_changes;
+        in_fiber = in_fiber && in_task_fiber();
+        // 监听器挂起期间同一线程上的其他协程也能加载配置，说明没有持有线程锁
+        coro::FiberSemaphore sem(0);
+        iom.scheduleLock([&]() {
+            coro::Config::LoadFromConfDir(dir);
+            reloaded = true;
+            sem.notify();
+        });
+        sem.wait();
+    });
+
+    assert(coro::Config::WatchConfDir(dir, &iom));
+
+    // a.yml新增无关的key，test.int不变
+    write_file(dir + "/a.yml", "test:\n  int: 1\n  other: x\n");
+    // b.yml修改test.vec
+    write_file(dir + "/sub/b.yml", "test:\n  vec: [8, 9]\n");
+    usleep(200 * 1000);
+    assert(int_changes == 0);
+    assert(vec_changes == 1);
+    assert(g_vec->getValue() == std::vector<int>({8, 9}));
+
+    // 新建的子目录也会被监听
+    rt = system(("mkdir -p " + dir + "/new").c_str());
+    assert(rt == 0);
+    usleep(100 * 1000);
+    write_file(dir + "/new/c.yml", "test:\n  int: 3\n");
+    usleep(200 * 1000);
+    assert(int_changes == 1);
+    assert(g_int->getValue() == 3);
+    assert(in_fiber);
+    assert(reloaded);
+
+    coro::Config::UnwatchConfDir();
+    iom.stop();
+    g_int->clearListener();
+    g_vec->clearListener();
+    std::cout << "reload ok" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    test_snapshot();
+    test_concurrent();
+    test_node_cast();
+    test_lookup();
+    test_reload();
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file test_counter.cc
+ * @brief 分片计数器测试
+ * @version 0.1
+ * @date 2024-07-24
+ */
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "counter.h"
+#include "scheduler.h"
+
+// 多个线程累加，线程退出后值并入汇总值
+void test_sharded() {
+    coro::ShardedCounter counter;
+    std::vector<std::thread> ths;
+    for (int i = 0; i < 8; ++i) {
+        ths.emplace_back([&counter]() {
+            for (int j = 0; j < 100000; ++j) {
+                ++counter;
+            }
+            counter.sub(50000);
+        });
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    assert(counter.value() == 8 * 50000);
+
+    // 计数器析构后编号被新计数器复用，旧的槽不影响新计数器
+    std::unique_ptr<coro::ShardedCounter> old(new coro::ShardedCounter());
+    old->add(7);
+    old.reset();
+    coro::ShardedCounter reused;
+    reused.add(3);
+    assert(reused.value() == 3);
+
+    coro::PerCpuCounter<uint64_t> per_cpu;
+    per_cpu.add(5);
+    ++per_cpu;
+    assert(per_cpu.value() == 6);
+    std::cout << "sharded ok" << std::endl;
+}
+
+void test_fiber_ids() {
+    uint64_t before = coro::Fiber::TotalFibers();
+    std::vector<coro::Fiber::ptr> fibers;
+    for (int i = 0; i < 2000; ++i) {
+        fibers.emplace_back(new coro::Fiber([]() {}));
+    }
+    assert(coro::Fiber::TotalFibers() == before + 2000);
+    // 同一线程的id块内连续递增
+    assert(fibers[1]->getId() == fibers[0]->getId() + 1);
+    fibers.clear();
+    assert(coro::Fiber::TotalFibers() == before);
+}
+
+void test_metrics() {
+    coro::Scheduler::Metrics metrics;
+    {
+        coro::Scheduler sc(2, false, "metrics");
+        sc.start();
+        for (int i = 0; i < 100; ++i) {
+            sc.scheduleLock([]() {});
+        }
+        sc.stop();
+        metrics = sc.getMetrics();
+    }
+    std::cout << "tasks " << metrics.tasksRun << " steals " << metrics.steals
+              << " idle wakeups " << metrics.idleWakeups << " switches "
+              << metrics.switches << std::endl;
+    assert(metrics.tasksRun == 100);
+    assert(metrics.switches >= metrics.tasksRun);
+}
+
+int main(int argc, char* argv[]) {
+    test_sharded();
+    test_fiber_ids();
+    test_metrics();
+    return 0;
+}
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "fiber.h"
+#include "trace.h"
 
 void run_in_fiber2() { std::cout << "run_in_fiber2" << std::endl; }
 
@@ -42,6 +43,10 @@ void test_fiber() {
 
 int main(int argc, char *argv[]) {
     test_fiber();
+#ifdef CORO_ENABLE_TRACE
+    // 每次切换的(时间戳, 线程id, 协程id, 事件)
+    coro::Trace::Dump(std::cout);
+#endif
     std::this_thread::sleep_for(std::chrono::seconds(30));
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+/**
+ * @file test_fiber_mutex.cc
+ * @brief 协程同步原语测试
+ * @version 0.1
+ * @date 2024-07-20
+ */
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+#include "fiber_mutex.h"
+#include "scheduler.h"
+
+// 持有锁时让出执行权，给其他协程制造竞争
+static void yield_in_place() {
+    coro::Scheduler::GetThis()->scheduleLock(coro::Fiber::GetThis());
+    coro::Fiber::GetThis()->yield();
+}
+
+// 单线程调度器里锁被占用时只能挂起协程，阻塞线程会死锁
+void test_mutex(size_t threads) {
+    coro::FiberMutex mutex;
+    int count = 0;
+    int inside = 0;
+    {
+        coro::Scheduler sc(threads, false, "mutex");
+        sc.start();
+        for (int i = 0; i < 50; ++i) {
+            sc.scheduleLock([&]() {
+                for (int j = 0; j < 100; ++j) {
+                    coro::FiberMutex::Lock lock(mutex);
+                    assert(++inside == 1);
+                    int v = count;
+                    if (j % 10 == 0) {
+                        yield_in_place();
+                    }
+                    count = v + 1;
+                    --inside;
+                }
+            });
+        }
+        sc.stop();
+    }
+    std::cout << "mutex threads " << threads << " count " << count
+              << std::endl;
+    assert(count == 5000);
+    assert(mutex.tryLock());
+    mutex.unlock();
+}
+
+void test_rwmutex() {
+    coro::FiberRWMutex mutex;
+    std::atomic<int> readers{0};
+    std::atomic<int> max_readers{0};
+    int value = 0;
+    auto enter_read = [&]() {
+        int n = ++readers;
+        int m = max_readers;
+        while (n > m && !max_readers.compare_exchange_weak(m, n)) {
+        }
+    };
+    // 混合读写，第一批读者全部放行后才开始，写者不会卡住还没拿到读锁的读者
+    auto mixed = [&](coro::Scheduler& sc) {
+        for (int i = 0; i < 20; ++i) {
+            sc.scheduleLock([&, i]() {
+                for (int j = 0; j < 50; ++j) {
+                    if (i % 4 == 0) {
+                        coro::FiberRWMutex::WriteLock lock(mutex);
+                        assert(readers == 0);
+                        int v = value;
+                        yield_in_place();
+                        value = v + 1;
+                    } else {
+                        coro::FiberRWMutex::ReadLock lock(mutex);
+                        enter_read();
+                        yield_in_place();
+                        --readers;
+                    }
+                }
+            });
+        }
+    };
+    {
+        coro::Scheduler sc(2, false, "rwmutex");
+        sc.start();
+        // 一批读者持有读锁在屏障处等待，全部到齐后才放行，保证读者同时持有读锁
+        const int kBatch = 4;
+        coro::FiberSemaphore arrived(0);
+        coro::FiberSemaphore release(0);
+        for (int i = 0; i < kBatch; ++i) {
+            sc.scheduleLock([&]() {
+                coro::FiberRWMutex::ReadLock lock(mutex);
+                enter_read();
+                arrived.notify();
+                release.wait();
+                --readers;
+            });
+        }
+        sc.scheduleLock([&]() {
+            for (int i = 0; i < kBatch; ++i) {
+                arrived.wait();
+            }
+            assert(readers == kBatch);
+            for (int i = 0; i < kBatch; ++i) {
+                release.notify();
+            }
+            mixed(sc);
+        });
+        sc.stop();
+    }
+    std::cout << "rwmutex value " << value << " max readers " << max_readers
+              << std::endl;
+    assert(value == 5 * 50);
+    assert(readers == 0);
+    assert(max_readers > 1);
+}
+
+// 生产者消费者：条件变量和信号量，协程和普通线程混用
+void test_condition() {
+    coro::FiberMutex mutex;
+    coro::FiberConditionVariable cond;
+    coro::FiberSemaphore done;
+    int produced = 0;
+    int consumed = 0;
+    {
+        coro::Scheduler sc(1, false, "cond");
+        sc.start();
+        for (int i = 0; i < 4; ++i) {
+            sc.scheduleLock([&]() {
+                for (int j = 0; j < 100; ++j) {
+                    coro::FiberMutex::Lock lock(mutex);
+                    cond.wait(mutex, [&]() { return produced > consumed; });
+                    ++consumed;
+                }
+                done.notify();
+            });
+        }
+        // 普通线程生产，不在调度器里时退化成阻塞线程
+        std::thread producer([&]() {
+            for (int j = 0; j < 400; ++j) {
+                coro::FiberMutex::Lock lock(mutex);
+                ++produced;
+                cond.notify_one();
+            }
+        });
+        for (int i = 0; i < 4; ++i) {
+            done.wait();
+        }
+        producer.join();
+        sc.stop();
+    }
+    std::cout << "condition consumed " << consumed << std::endl;
+    assert(consumed == 400);
+    assert(!done.tryWait());
+}
+
+int main(int argc, char* argv[]) {
+    test_mutex(1);
+    test_mutex(3);
+    test_rwmutex();
+    test_condition();
+    return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file test_hook.cc
+ * @brief hook模块测试
+ * @version 0.1
+ * @date 2024-06-30
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <iostream>
+
+#include "hook.h"
+#include "iomanager.h"
+#include "util.h"
+
+static std::atomic<int> s_count{0};
+
+// 两个协程在同一个线程里sleep，总耗时取最长的那个而不是相加
+void test_sleep() {
+    uint64_t begin = coro::GetElapsedMS();
+    {
+        coro::IOManager iom(1, false, "sleep");
+        iom.scheduleLock([]() {
+            sleep(1);
+            std::cout << "sleep 1 done" << std::endl;
+            ++s_count;
+        });
+        iom.scheduleLock([]() {
+            usleep(500 * 1000);
+            std::cout << "usleep 500ms done" << std::endl;
+            ++s_count;
+        });
+    }
+    uint64_t used = coro::GetElapsedMS() - begin;
+    std::cout << "test_sleep used " << used << " ms" << std::endl;
+    assert(used < 1500);
+}
+
+// 阻塞语义的accept/connect/read在未就绪时让出协程，SO_RCVTIMEO超时返回ETIMEDOUT
+void test_socket() {
+    coro::IOManager iom(1, false, "socket");
+    iom.scheduleLock([]() {
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+        assert(listen(listen_fd, 16) == 0);
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd, (sockaddr *)&addr, &len);
+
+        // 客户端协程：连接后过100毫秒再发送数据
+        coro::IOManager::GetThis()->scheduleLock([addr]() {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            assert(connect(fd, (const sockaddr *)&addr, sizeof(addr)) == 0);
+            usleep(100 * 1000);
+            assert(send(fd, "hello", 5, 0) == 5);
+            // 等服务端读超时后再关闭
+            usleep(300 * 1000);
+            close(fd);
+        });
+
+        int fd = accept(listen_fd, nullptr, nullptr);
+        assert(fd >= 0);
+        char buf[16] = {0};
+        ssize_t rt = read(fd, buf, sizeof(buf));
+        std::cout << "read " << rt << " bytes: " << buf << std::endl;
+        assert(rt == 5);
+        ++s_count;
+
+        struct timeval tv = {0, 100 * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        uint64_t begin = coro::GetElapsedMS();
+        rt = recv(fd, buf, sizeof(buf), 0);
+        std::cout << "recv " << rt << " errno " << errno << " after "
+                  << coro::GetElapsedMS() - begin << " ms" << std::endl;
+        assert(rt == -1 && errno == ETIMEDOUT);
+        ++s_count;
+
+        close(fd);
+        close(listen_fd);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    test_sleep();
+    test_socket();
+    std::cout << "count: " << s_count << std::endl;
+    assert(s_count == 4);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file test_iomanager.cc
+ * @brief IO协程调度器测试
+ * @version 0.1
+ * @date 2024-06-26
+ */
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+
+#include "iomanager.h"
+#include "util.h"
+
+static int s_fds[2];
+static std::atomic<int> s_count{0};
+
+// 协程注册读事件后yield，数据到达时被重新调度
+void test_fiber_read() {
+    coro::IOManager::GetThis()->addEvent(s_fds[0], coro::IOManager::READ);
+    coro::Fiber::GetThis()->yield();
+
+    char buf[16] = {0};
+    int rt = read(s_fds[0], buf, sizeof(buf));
+    std::cout << "read " << rt << " bytes: " << buf << std::endl;
+    assert(rt == 5);
+    ++s_count;
+}
+
+void test_iomanager() {
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds) == 0);
+
+    coro::IOManager iom(2, false, "test");
+    iom.scheduleLock(test_fiber_read);
+    // 回调形式的写事件
+    iom.addEvent(s_fds[1], coro::IOManager::WRITE, []() {
+        std::cout << "writable" << std::endl;
+        assert(write(s_fds[1], "hello", 5) == 5);
+        ++s_count;
+    });
+    // 取消一个从未触发的读事件，回调会被强制执行一次
+    iom.addEvent(s_fds[1], coro::IOManager::READ, []() { ++s_count; });
+    iom.cancelEvent(s_fds[1], coro::IOManager::READ);
+}
+
+void test_timer() {
+    coro::IOManager iom(2, false, "timer");
+    static coro::Timer::ptr s_timer;
+    static int s_timer_count = 0;
+    uint64_t begin = coro::GetElapsedMS();
+    // 循环定时器，执行3次后取消自己
+    s_timer = iom.addTimer(
+        100,
+        [begin]() {
+            ++s_timer_count;
+            std::cout << "timer " << s_timer_count << " after "
+                      << coro::GetElapsedMS() - begin << " ms" << std::endl;
+            if (s_timer_count == 3) {
+                s_timer->cancel();
+                ++s_count;
+            }
+        },
+        true);
+
+    // 条件已经失效的定时器不执行
+    std::shared_ptr<int> cond(new int(0));
+    iom.addConditionTimer(50, []() { assert(false); }, cond);
+    cond.reset();
+}
+
+// io_uring后端：协程直接提交读写和超时请求，内核不支持时回退到epoll，结果相同
+void test_uring() {
+    coro::IOManager iom(2, false, "uring", coro::IOManager::IO_URING);
+    std::cout << "backend: "
+              << (iom.getBackend() == coro::IOManager::IO_URING ? "io_uring"
+                                                                 : "epoll")
+              << std::endl;
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    iom.scheduleLock([fds]() {
+        char buf[16] = {0};
+        ssize_t rt = coro::IOManager::GetThis()->submitRead(fds[0], buf,
+                                                            sizeof(buf));
+        std::cout << "uring read " << rt << " bytes: " << buf << std::endl;
+        assert(rt == 5);
+        ++s_count;
+    });
+    iom.scheduleLock([fds]() {
+        uint64_t begin = coro::GetElapsedMS();
+        coro::IOManager::GetThis()->submitTimeout(100);
+        assert(coro::GetElapsedMS() - begin >= 100);
+        assert(coro::IOManager::GetThis()->submitWrite(fds[1], "hello", 5) ==
+               5);
+        ++s_count;
+    });
+    // 普通的fd事件在io_uring后端下同样可用
+    iom.addEvent(fds[1], coro::IOManager::WRITE, []() { ++s_count; });
+}
+
+int main(int argc, char *argv[]) {
+    test_iomanager();
+    test_timer();
+    test_uring();
+    std::cout << "count: " << s_count << std::endl;
+    assert(s_count == 7);
+    close(s_fds[0]);
+    close(s_fds[1]);
+    return 0;
+}
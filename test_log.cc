@@ -0,0 +1,239 @@
+/**
+ * @file test_log.cc
+ * @brief 日志模块测试
+ * @version 0.1
+ * @date 2024-07-05
+ */
+#include <dirent.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "thread.h"
+
+static coro::Logger::ptr g_logger = CORO_LOG_NAME("test");
+
+// 多个线程并发写同一个文件，flush之后行数完整且每行没有交错
+void test_file() {
+    const char* path = "/tmp/coro_test_log.txt";
+    unlink(path);
+    coro::FileLogAppender::ptr appender(new coro::FileLogAppender(path));
+    g_logger->addAppender(appender);
+
+    const int kThreads = 4;
+    const int kLines = 10000;
+    std::vector<coro::Thread::ptr> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.push_back(coro::Thread::ptr(new coro::Thread(
+            [i]() {
+                for (int j = 0; j < kLines; ++j) {
+                    CORO_LOG_INFO(g_logger) << "thread " << i << " line " << j;
+                }
+            },
+            "log_" + std::to_string(i))));
+    }
+    for (auto& i : threads) {
+        i->join();
+    }
+    coro::LogFlusherMgr::GetInstance()->flush();
+    g_logger->delAppender(appender);
+    // 析构时截掉预分配的部分
+    appender.reset();
+
+    std::ifstream ifs(path);
+    std::string line;
+    int count = 0;
+    while (std::getline(ifs, line)) {
+        assert(line.find("[INFO]\t[test]") != std::string::npos);
+        ++count;
+    }
+    std::cout << "file lines: " << count << " dropped: "
+              << coro::LogFlusherMgr::GetInstance()->getDropped() << std::endl;
+    assert(count + coro::LogFlusherMgr::GetInstance()->getDropped() ==
+           kThreads * kLines);
+}
+
+// 在单独的线程里写日志，线程退出时释放它缓存的Appender列表快照，
+// 之后删掉的Appender随最后一个引用析构，截掉预分配的部分
+static void log_in_thread(std::function<void()> cb) {
+    coro::Thread thread(cb, "log_test");
+    thread.join();
+}
+
+// 崩溃后文件末尾留有预分配的0，重新打开时从实际内容之后继续写
+void test_crash() {
+    const char* path = "/tmp/coro_test_log_crash.txt";
+    unlink(path);
+    {
+        std::ofstream ofs(path);
+        ofs << "before crash\n";
+        ofs << std::string(1024 * 1024, '\0');
+    }
+    coro::FileLogAppender::ptr appender(new coro::FileLogAppender(path));
+    coro::Logger::ptr logger(new coro::Logger("crash"));
+    logger->addAppender(appender);
+    log_in_thread([logger]() { CORO_LOG_INFO(logger) << "after crash"; });
+    coro::LogFlusherMgr::GetInstance()->flush();
+    logger->delAppender(appender);
+    appender.reset();
+
+    std::ifstream ifs(path);
+    std::string content((std::istreambuf_iterator<char>(ifs)),
+                        std::istreambuf_iterator<char>());
+    assert(content.find('\0') == std::string::npos);
+    assert(content.compare(0, 13, "before crash\n") == 0);
+    assert(content.find("after crash") != std::string::npos);
+}
+
+// 阻塞策略下一条都不丢
+void test_block() {
+    coro::LogFlusherMgr::GetInstance()->setOverflowPolicy(
+        coro::LogFlusher::BLOCK);
+    coro::LogFlusherMgr::GetInstance()->setRingSize(16 * 1024);
+    const char* path = "/tmp/coro_test_log_block.txt";
+    unlink(path);
+    coro::FileLogAppender::ptr appender(new coro::FileLogAppender(path));
+    coro::Logger::ptr logger = CORO_LOG_NAME("block");
+    logger->addAppender(appender);
+
+    // 新线程使用16K的小队列，必然写满
+    coro::Thread thread(
+        [logger]() {
+            for (int i = 0; i < 20000; ++i) {
+                CORO_LOG_FMT_WARN(logger, "block %d", i);
+            }
+        },
+        "log_block");
+    thread.join();
+    coro::LogFlusherMgr::GetInstance()->flush();
+    logger->delAppender(appender);
+    appender.reset();
+
+    std::ifstream ifs(path);
+    std::string line;
+    int count = 0;
+    while (std::getline(ifs, line)) {
+        ++count;
+    }
+    std::cout << "block lines: " << count << std::endl;
+    assert(count == 20000);
+}
+
+// 自定义格式：无效格式被拒绝，有效格式按配置输出
+void test_pattern() {
+    coro::LogFormatter::ptr bad(new coro::LogFormatter("%d{%H:%M:%S %q%n"));
+    assert(bad->isError());
+
+    const char* path = "/tmp/coro_test_log_pattern.txt";
+    unlink(path);
+    coro::Logger::ptr logger = CORO_LOG_NAME("pattern");
+    coro::FileLogAppender::ptr appender(new coro::FileLogAppender(path));
+    appender->setFormatter(
+        coro::LogFormatter::ptr(new coro::LogFormatter("%p|%c|%%|%m%n")));
+    logger->addAppender(appender);
+    log_in_thread([logger]() {
+        for (int i = 0; i < 3; ++i) {
+            CORO_LOG_INFO(logger) << "pattern " << i;
+        }
+    });
+    coro::LogFlusherMgr::GetInstance()->flush();
+    logger->delAppender(appender);
+    appender.reset();
+
+    std::ifstream ifs(path);
+    std::string line;
+    int count = 0;
+    while (std::getline(ifs, line)) {
+        assert(line == "INFO|pattern|%|pattern " + std::to_string(count));
+        ++count;
+    }
+    std::cout << "pattern lines: " << count << std::endl;
+    assert(count == 3);
+}
+
+static int count_lines(const std::string& path, size_t* size = nullptr) {
+    std::ifstream ifs(path);
+    std::string line;
+    int count = 0;
+    while (std::getline(ifs, line)) {
+        assert(line.find('\0') == std::string::npos);
+        ++count;
+    }
+    if (size) {
+        struct stat st;
+        assert(stat(path.c_str(), &st) == 0);
+        *size = st.st_size;
+    }
+    return count;
+}
+
+// 按大小切分，以及收到SIGHUP后重新打开被移走的文件
+void test_rotate() {
+    const std::string dir = "/tmp/coro_test_log_rotate";
+    const std::string path = dir + "/rotate.log";
+    int rt = system(("rm -rf " + dir + " && mkdir -p " + dir).c_str());
+    assert(rt == 0);
+    coro::Logger::ptr logger = CORO_LOG_NAME("rotate");
+    coro::FileLogAppender::ptr appender(
+        new coro::FileLogAppender(path, 64 * 1024));
+    logger->addAppender(appender);
+    log_in_thread([logger]() {
+        for (int i = 0; i < 2000; ++i) {
+            CORO_LOG_INFO(logger) << "rotate " << i;
+        }
+    });
+    coro::LogFlusherMgr::GetInstance()->flush();
+
+    // 模拟logrotate：移走文件后发SIGHUP
+    assert(coro::FileLogAppender::InstallReopenSignal(SIGHUP));
+    assert(rename(path.c_str(), (dir + "/moved.log").c_str()) == 0);
+    raise(SIGHUP);
+    log_in_thread([logger]() {
+        for (int i = 0; i < 10; ++i) {
+            CORO_LOG_INFO(logger) << "after reopen " << i;
+        }
+    });
+    coro::LogFlusherMgr::GetInstance()->flush();
+    logger->delAppender(appender);
+    appender.reset();
+
+    int files = 0;
+    int total = 0;
+    DIR* d = opendir(dir.c_str());
+    assert(d);
+    while (struct dirent* e = readdir(d)) {
+        if (e->d_name[0] == '.') {
+            continue;
+        }
+        size_t size = 0;
+        total += count_lines(dir + "/" + e->d_name, &size);
+        assert(size <= 64 * 1024);
+        ++files;
+    }
+    closedir(d);
+    std::cout << "rotate files: " << files << " lines: " << total << std::endl;
+    assert(files > 3);
+    assert(total == 2010);
+    assert(count_lines(path) == 10);
+}
+
+int main(int argc, char* argv[]) {
+    CORO_LOG_INFO(CORO_LOG_ROOT()) << "hello log";
+    test_file();
+    test_crash();
+    test_pattern();
+    test_rotate();
+    test_block();
+    CORO_LOG_ERROR(CORO_LOG_ROOT()) << "bye";
+    return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file test_mutex.cc
+ * @brief 线程锁测试
+ * @version 0.1
+ * @date 2024-07-21
+ */
+#include <sys/sysinfo.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mutex.h"
+
+// 线程数超过CPU数，持锁时偶尔睡眠，等待者自旋失败后在futex上睡眠，
+// 解锁方必须按状态2把锁交给等待者。持锁期间检查没有其他线程同时进入
+template <class MutexType>
+void test_exclusive(const std::string& name) {
+    int threads = std::max(8, get_nprocs() * 4);
+    const int kLoops = 20000;
+    MutexType mutex;
+    std::atomic<int> holders{0};
+    uint64_t count = 0;
+
+    std::vector<std::thread> ths;
+    for (int i = 0; i < threads; ++i) {
+        ths.emplace_back([&]() {
+            for (int j = 0; j < kLoops; ++j) {
+                typename MutexType::Lock lock(mutex);
+                assert(++holders == 1);
+                ++count;
+                if (j % 1000 == 0) {
+                    usleep(100);
+                }
+                assert(--holders == 0);
+            }
+        });
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    std::cout << name << " threads " << threads << " count " << count
+              << std::endl;
+    assert(count == (uint64_t)threads * kLoops);
+}
+
+int main(int argc, char* argv[]) {
+    test_exclusive<coro::AdaptiveLock>("AdaptiveLock");
+    test_exclusive<coro::PaddedAdaptiveLock>("PaddedAdaptiveLock");
+    return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file test_range_lock.cc
+ * @brief 范围锁测试
+ * @version 0.1
+ * @date 2024-07-22
+ */
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "range_lock.h"
+#include "scheduler.h"
+
+void test_try() {
+    coro::RangeLock lock;
+    coro::RangeLock::Range* a = lock.wrlock(0, 100);
+    coro::RangeLock::Range* b = lock.rdlock(100, 200);
+    coro::RangeLock::Range* c = lock.tryRdlock(150, 300);
+    assert(c);
+    // 相邻不重叠
+    assert(!lock.tryWrlock(99, 101));
+    assert(!lock.tryWrlock(199, 250));
+    assert(!lock.tryRdlock(50, 60));
+    lock.unlock(a);
+    coro::RangeLock::Range* d = lock.tryWrlock(0, 100);
+    assert(d);
+    lock.unlock(d);
+    lock.unlock(b);
+    lock.unlock(c);
+    assert((d = lock.tryWrlock(0, UINT64_MAX)));
+    lock.unlock(d);
+}
+
+// 每个格子记录当前的读者数(正)或写者(-1)，随机区间加锁后检查没有冲突
+static const int kSlots = 256;
+static std::atomic<int> s_slots[kSlots];
+
+template <class LockType>
+static void check_round(LockType& lock, uint32_t& seed, bool exclusive) {
+    seed = seed * 1103515245 + 12345;
+    int begin = (seed >> 8) % kSlots;
+    int len = 1 + (seed >> 20) % 16;
+    int end = std::min(kSlots, begin + len);
+    if (exclusive) {
+        typename LockType::WriteLock guard(lock, begin, end);
+        for (int i = begin; i < end; ++i) {
+            int expected = 0;
+            assert(s_slots[i].compare_exchange_strong(expected, -1));
+        }
+        std::this_thread::yield();
+        for (int i = begin; i < end; ++i) {
+            s_slots[i] = 0;
+        }
+    } else {
+        typename LockType::ReadLock guard(lock, begin, end);
+        for (int i = begin; i < end; ++i) {
+            assert(++s_slots[i] > 0);
+        }
+        std::this_thread::yield();
+        for (int i = begin; i < end; ++i) {
+            --s_slots[i];
+        }
+    }
+}
+
+void test_threads() {
+    coro::RangeLock lock;
+    std::vector<std::thread> ths;
+    for (int i = 0; i < 4; ++i) {
+        ths.emplace_back([&lock, i]() {
+            uint32_t seed = i + 1;
+            for (int j = 0; j < 20000; ++j) {
+                check_round(lock, seed, j % 3 == 0);
+            }
+        });
+    }
+    for (auto& i : ths) {
+        i.join();
+    }
+    std::cout << "threads ok" << std::endl;
+}
+
+// 单线程调度器里等待者只能挂起协程，否则会死锁
+void test_fibers() {
+    coro::FiberRangeLock lock;
+    std::atomic<int> done{0};
+    {
+        coro::Scheduler sc(1, false, "range");
+        sc.start();
+        for (int i = 0; i < 16; ++i) {
+            sc.scheduleLock([&lock, &done, i]() {
+                uint32_t seed = i + 100;
+                for (int j = 0; j < 500; ++j) {
+                    check_round(lock, seed, j % 2 == 0);
+                    // 持锁期间让出
+                    coro::FiberRangeLock::WriteLock guard(lock, i * 16,
+                                                          i * 16 + 32);
+                    coro::Scheduler::GetThis()->scheduleLock(
+                        coro::Fiber::GetThis());
+                    coro::Fiber::GetThis()->yield();
+                }
+                ++done;
+            });
+        }
+        sc.stop();
+    }
+    std::cout << "fibers ok" << std::endl;
+    assert(done == 16);
+}
+
+int main(int argc, char* argv[]) {
+    test_try();
+    test_threads();
+    test_fibers();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file test_scheduler.cc
+ * @brief 协程调度器测试
+ * @version 0.1
+ * @date 2024-06-22
+ */
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+static std::atomic<int> s_count{0};
+
+void test_fiber_task() {
+    std::cout << "test_fiber_task begin, thread: "
+              << coro::Scheduler::GetThreadId() << std::endl;
+    coro::Fiber::GetThis()->yield();
+    ++s_count;
+}
+
+void test_cb_task(int i) {
+    std::cout << "test_cb_task " << i
+              << ", thread: " << coro::Scheduler::GetThreadId() << std::endl;
+    ++s_count;
+}
+
+int main(int argc, char *argv[]) {
+    coro::Scheduler sc(3, true, "test");
+    sc.start();
+
+    // 函数任务，其中一部分绑定到caller线程(0号)
+    for (int i = 0; i < 10; ++i) {
+        sc.scheduleLock(std::bind(test_cb_task, i), i % 2 ? -1 : 0);
+    }
+
+    // 协程任务，把自己重新加入调度后yield，被再次调度时继续执行
+    sc.scheduleLock(coro::Fiber::ptr(new coro::Fiber([&sc]() {
+        sc.scheduleLock(coro::Fiber::GetThis());
+        test_fiber_task();
+    })));
+
+    // 只能移动的函数任务，以及超过内联存储大小、放到堆上的任务
+    std::unique_ptr<int> value(new int(1));
+    sc.scheduleLock([v = std::move(value)]() { s_count += *v; });
+    char big[128] = {1};
+    sc.scheduleLock([big]() { s_count += big[0]; });
+    coro::TaskFunction moved([]() { ++s_count; });
+    coro::TaskFunction other(std::move(moved));
+    assert(!moved && other);
+    sc.scheduleLock(std::move(other));
+
+    // 批量提交：外部线程走注入队列，调度线程内走本地队列
+    std::vector<coro::TaskFunction> batch;
+    for (int i = 0; i < 10; ++i) {
+        batch.emplace_back([]() { ++s_count; });
+    }
+    batch.emplace_back(nullptr);
+    sc.schedule(batch.begin(), batch.end());
+    sc.schedule({[]() { ++s_count; }, []() { ++s_count; }}, 0);
+    sc.scheduleLock([&sc]() {
+        std::vector<coro::Fiber::ptr> fibers;
+        for (int i = 0; i < 100; ++i) {
+            fibers.emplace_back(new coro::Fiber([]() { ++s_count; }));
+        }
+        sc.schedule(fibers.begin(), fibers.end());
+        assert(!fibers[0]);
+    });
+
+    // 共享栈协程不指定线程重新调度时，总是回到创建它的线程
+    sc.scheduleLock([&sc]() {
+        for (int i = 0; i < 8; ++i) {
+            sc.scheduleLock(coro::Fiber::ptr(new coro::Fiber(
+                [&sc]() {
+                    int thread = coro::Scheduler::GetThreadId();
+                    for (int j = 0; j < 20; ++j) {
+                        sc.scheduleLock(coro::Fiber::GetThis());
+                        coro::Fiber::GetThis()->yield();
+                        assert(coro::Scheduler::GetThreadId() == thread);
+                    }
+                    ++s_count;
+                },
+                0, true, true)));
+        }
+    });
+
+    // 普通线程上创建的共享栈协程不属于任何调度线程，提交时被拒绝
+    std::thread([&sc]() {
+        coro::Fiber::ptr fiber(new coro::Fiber([]() {}, 0, true, true));
+        bool thrown = false;
+        try {
+            sc.scheduleLock(fiber);
+        } catch (std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }).join();
+
+    // 挂起在共享栈上的协程在创建线程退出之后、在其他线程上析构
+    std::vector<coro::Fiber::ptr> orphans;
+    std::thread([&orphans]() {
+        coro::Fiber::GetThis();
+        for (int i = 0; i < 8; ++i) {
+            orphans.emplace_back(new coro::Fiber(
+                []() { coro::Fiber::GetThis()->yield(); }, 0, false, true));
+            orphans.back()->resume();
+        }
+    }).join();
+    orphans.clear();
+
+    sc.stop();
+    std::cout << "count: " << s_count << std::endl;
+    assert(s_count == 14 + 10 + 2 + 100 + 8);
+    return 0;
+}
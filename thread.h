@@ -0,0 +1,93 @@
+/**
+ * @file thread.h
+ * @brief 线程封装
+ * @author shawn
+ * @date 2024-06-22
+ */
+#ifndef __CORO_THREAD_H__
+#define __CORO_THREAD_H__
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace coro {
+
+/**
+ * @brief 线程类
+ */
+class Thread : Noncopyable {
+   public:
+    typedef std::shared_ptr<Thread> ptr;
+
+    /**
+     * @brief 构造函数，返回时线程已经开始运行
+     * @param[in] cb 线程执行函数
+     * @param[in] name 线程名称
+     * @exception 线程创建失败时抛出std::logic_error
+     */
+    Thread(std::function<void()> cb, const std::string& name);
+
+    /**
+     * @brief 析构函数，未join的线程会被detach
+     */
+    ~Thread();
+
+    /**
+     * @brief 线程ID
+     */
+    pid_t getId() const { return m_id; }
+
+    /**
+     * @brief 线程名称
+     */
+    const std::string& getName() const { return m_name; }
+
+    /**
+     * @brief 等待线程执行完成
+     */
+    void join();
+
+    /**
+     * @brief 获取当前的线程指针
+     */
+    static Thread* GetThis();
+
+    /**
+     * @brief 获取当前的线程名称
+     */
+    static const std::string& GetName();
+
+    /**
+     * @brief 设置当前线程名称
+     */
+    static void SetName(const std::string& name);
+
+   private:
+    /**
+     * @brief 线程执行函数
+     */
+    static void* run(void* arg);
+
+   private:
+    // 线程id
+    pid_t m_id = -1;
+    // 线程结构
+    pthread_t m_thread = 0;
+    // 线程执行函数
+    std::function<void()> m_cb;
+    // 线程名称
+    std::string m_name;
+    // 信号量，保证构造函数返回时线程已经初始化完成
+    Semaphore m_semaphore;
+};
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ * @file timer.cc
+ * @brief 基于分层时间轮的定时器实现
+ * @author shawn
+ * @date 2024-06-28
+ */
+#include "timer.h"
+
+#include <algorithm>
+
+#include "util.h"
+
+namespace coro {
+
+Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring,
+             TimerManager* manager)
+    : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager) {
+    m_next = GetElapsedMS() + m_ms;
+}
+
+bool Timer::cancel() {
+    TimerManager::MutexType::Lock lock(m_manager->m_mutex);
+    if (m_cb) {
+        m_cb = nullptr;
+        m_manager->unlink(this);
+        return true;
+    }
+    return false;
+}
+
+bool Timer::refresh() {
+    bool at_front = false;
+    {
+        TimerManager::MutexType::Lock lock(m_manager->m_mutex);
+        if (!m_cb || !m_slotPprev) {
+            return false;
+        }
+        // unlink会释放m_self，先持有一份引用
+        Timer::ptr self = shared_from_this();
+        m_manager->unlink(this);
+        m_next = GetElapsedMS() + m_ms;
+        at_front = m_manager->addTimer(self);
+    }
+    if (at_front) {
+        m_manager->onTimerInsertedAtFront();
+    }
+    return true;
+}
+
+bool Timer::reset(uint64_t ms, bool from_now) {
+    if (ms == m_ms && !from_now) {
+        return true;
+    }
+    bool at_front = false;
+    {
+        TimerManager::MutexType::Lock lock(m_manager->m_mutex);
+        if (!m_cb || !m_slotPprev) {
+            return false;
+        }
+        Timer::ptr self = shared_from_this();
+        m_manager->unlink(this);
+        uint64_t start = 0;
+        if (from_now) {
+            start = GetElapsedMS();
+        } else {
+            start = m_next - m_ms;
+        }
+        m_ms = ms;
+        m_next = start + m_ms;
+        at_front = m_manager->addTimer(self);
+    }
+    if (at_front) {
+        m_manager->onTimerInsertedAtFront();
+    }
+    return true;
+}
+
+TimerManager::TimerManager() {
+    m_wheel[0].resize(kRootSize, nullptr);
+    for (int i = 1; i < kLevels; ++i) {
+        m_wheel[i].resize(kLevelSize, nullptr);
+    }
+    m_current = GetElapsedMS();
+}
+
+TimerManager::~TimerManager() {
+    // 打断定时器和自身的引用环
+    for (int i = 0; i < kLevels; ++i) {
+        for (auto& head : m_wheel[i]) {
+            while (head) {
+                unlink(head);
+            }
+        }
+    }
+}
+
+Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb,
+                                  bool recurring) {
+    Timer::ptr timer(new Timer(ms, cb, recurring, this));
+    bool at_front = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        at_front = addTimer(timer);
+    }
+    if (at_front) {
+        onTimerInsertedAtFront();
+    }
+    return timer;
+}
+
+static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
+    std::shared_ptr<void> tmp = weak_cond.lock();
+    if (tmp) {
+        cb();
+    }
+}
+
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms,
+                                           std::function<void()> cb,
+                                           std::weak_ptr<void> weak_cond,
+                                           bool recurring) {
+    return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+}
+
+bool TimerManager::addTimer(Timer::ptr val) {
+    val->m_self = val;
+    link(val.get());
+    ++m_count;
+    // 新定时器早于idle线程当前等待的超时时间，需要提前唤醒，直到下次getNextTimer前只通知一次
+    bool at_front = val->m_next < m_wakeup && !m_tickled;
+    if (at_front) {
+        m_tickled = true;
+    }
+    return at_front;
+}
+
+void TimerManager::link(Timer* timer) {
+    uint64_t expires = std::max(timer->m_next, m_current);
+    uint64_t idx = expires - m_current;
+    Timer** head = nullptr;
+    if (idx < kRootSize) {
+        head = &m_wheel[0][expires & (kRootSize - 1)];
+    } else {
+        // 超过最大范围的定时器放在最高层，进位时会重新计算
+        uint64_t max_idx = (1ull << (kRootBits + (kLevels - 1) * kLevelBits)) - 1;
+        if (idx > max_idx) {
+            expires = m_current + max_idx;
+            idx = max_idx;
+        }
+        int level = 1;
+        while (idx >= (1ull << (kRootBits + level * kLevelBits))) {
+            ++level;
+        }
+        int shift = kRootBits + (level - 1) * kLevelBits;
+        head = &m_wheel[level][(expires >> shift) & (kLevelSize - 1)];
+    }
+    timer->m_slotNext = *head;
+    if (*head) {
+        (*head)->m_slotPprev = &timer->m_slotNext;
+    }
+    timer->m_slotPprev = head;
+    *head = timer;
+}
+
+void TimerManager::unlink(Timer* timer) {
+    if (!timer->m_slotPprev) {
+        return;
+    }
+    *timer->m_slotPprev = timer->m_slotNext;
+    if (timer->m_slotNext) {
+        timer->m_slotNext->m_slotPprev = timer->m_slotPprev;
+    }
+    timer->m_slotNext = nullptr;
+    timer->m_slotPprev = nullptr;
+    --m_count;
+    // 最后释放自身引用，之后不能再访问timer
+    Timer::ptr self;
+    self.swap(timer->m_self);
+}
+
+void TimerManager::cascade(int level, size_t index) {
+    Timer* head = m_wheel[level][index];
+    m_wheel[level][index] = nullptr;
+    while (head) {
+        Timer* next = head->m_slotNext;
+        head->m_slotPprev = nullptr;
+        head->m_slotNext = nullptr;
+        link(head);
+        head = next;
+    }
+}
+
+uint64_t TimerManager::getNextTimer() {
+    MutexType::Lock lock(m_mutex);
+    m_tickled = false;
+    if (m_count == 0) {
+        m_wakeup = ~0ull;
+        return ~0ull;
+    }
+
+    uint64_t now_ms = GetElapsedMS();
+    // 上层的定时器最早在下一次进位时才会落到第0层，所以只需要扫描到进位点，
+    // 进位点之前没有定时器就在进位点唤醒
+    uint64_t next = (m_current | (kRootSize - 1)) + 1;
+    for (uint64_t t = m_current; t < next; ++t) {
+        if (m_wheel[0][t & (kRootSize - 1)]) {
+            next = t;
+            break;
+        }
+    }
+    m_wakeup = next;
+    return now_ms >= next ? 0 : next - now_ms;
+}
+
+void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
+    uint64_t now_ms = GetElapsedMS();
+    std::vector<Timer::ptr> expired;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_count == 0) {
+            // 没有定时器时直接跳到当前时间，不用逐个刻度推进
+            m_current = std::max(m_current, now_ms + 1);
+            return;
+        }
+
+        while (m_current <= now_ms) {
+            size_t index = m_current & (kRootSize - 1);
+            if (index == 0) {
+                // 第0层转完一圈，从上一层取出接下来256毫秒的定时器，必要时逐层进位
+                for (int level = 1; level < kLevels; ++level) {
+                    int shift = kRootBits + (level - 1) * kLevelBits;
+                    size_t idx = (m_current >> shift) & (kLevelSize - 1);
+                    cascade(level, idx);
+                    if (idx != 0) {
+                        break;
+                    }
+                }
+            }
+
+            Timer* head = m_wheel[0][index];
+            while (head) {
+                Timer* next = head->m_slotNext;
+                expired.push_back(head->m_self);
+                unlink(head);
+                head = next;
+            }
+            ++m_current;
+        }
+
+        cbs.reserve(cbs.size() + expired.size());
+        for (auto& timer : expired) {
+            cbs.push_back(timer->m_cb);
+            if (timer->m_recurring) {
+                timer->m_next = now_ms + timer->m_ms;
+                addTimer(timer);
+            } else {
+                timer->m_cb = nullptr;
+            }
+        }
+    }
+}
+
+bool TimerManager::hasTimer() {
+    MutexType::Lock lock(m_mutex);
+    return m_count > 0;
+}
+
+}  // namespace coro
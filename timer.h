@@ -0,0 +1,193 @@
+/**
+ * @file timer.h
+ * @brief 基于分层时间轮的定时器
+ * @author shawn
+ * @date 2024-06-28
+ */
+#ifndef __CORO_TIMER_H__
+#define __CORO_TIMER_H__
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "mutex.h"
+
+namespace coro {
+
+class TimerManager;
+
+/**
+ * @brief 定时器
+ */
+class Timer : public std::enable_shared_from_this<Timer> {
+    friend class TimerManager;
+
+   public:
+    typedef std::shared_ptr<Timer> ptr;
+
+    /**
+     * @brief 取消定时器
+     */
+    bool cancel();
+
+    /**
+     * @brief 刷新定时器的执行时间为从现在开始ms毫秒之后
+     */
+    bool refresh();
+
+    /**
+     * @brief 重置定时器时间
+     * @param[in] ms 定时器执行间隔时间(毫秒)
+     * @param[in] from_now 是否从当前时间开始计算
+     */
+    bool reset(uint64_t ms, bool from_now);
+
+   private:
+    /**
+     * @brief 构造函数
+     * @param[in] ms 定时器执行间隔时间
+     * @param[in] cb 回调函数
+     * @param[in] recurring 是否循环
+     * @param[in] manager 定时器管理器
+     */
+    Timer(uint64_t ms, std::function<void()> cb, bool recurring,
+          TimerManager* manager);
+
+   private:
+    /// 是否循环定时器
+    bool m_recurring = false;
+    /// 执行周期
+    uint64_t m_ms = 0;
+    /// 精确的执行时间
+    uint64_t m_next = 0;
+    /// 回调函数
+    std::function<void()> m_cb;
+    /// 定时器管理器
+    TimerManager* m_manager = nullptr;
+    /// 时间轮槽位链表中的后继
+    Timer* m_slotNext = nullptr;
+    /// 指向前驱的m_slotNext或者槽位头指针，不在时间轮中时为nullptr
+    Timer** m_slotPprev = nullptr;
+    /// 在时间轮中时持有自身，保证回调执行前不被释放
+    Timer::ptr m_self;
+};
+
+/**
+ * @brief 定时器管理器
+ * @details 以毫秒为刻度的5层时间轮，第0层256个槽，其余每层64个槽，最大定时约49天。
+ *          添加和取消都是O(1)：定时器挂在对应槽位的双向链表上；
+ *          时间推进到上一层的某个槽时，把这个槽里的定时器重新分配到下面几层
+ */
+class TimerManager {
+    friend class Timer;
+
+   public:
+    /// 时间轮的添加删除都是写操作，使用互斥锁
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 构造函数
+     */
+    TimerManager();
+
+    /**
+     * @brief 析构函数
+     */
+    virtual ~TimerManager();
+
+    /**
+     * @brief 添加定时器
+     * @param[in] ms 定时器执行间隔时间
+     * @param[in] cb 定时器回调函数
+     * @param[in] recurring 是否循环定时器
+     */
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb,
+                        bool recurring = false);
+
+    /**
+     * @brief 添加条件定时器
+     * @param[in] ms 定时器执行间隔时间
+     * @param[in] cb 定时器回调函数
+     * @param[in] weak_cond 条件，对象已经释放时不执行回调
+     * @param[in] recurring 是否循环
+     */
+    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb,
+                                 std::weak_ptr<void> weak_cond,
+                                 bool recurring = false);
+
+    /**
+     * @brief 到下一次需要检查定时器的毫秒数
+     * @details 可能早于最近一个定时器的到期时间(时间轮需要进位)，但不会晚于它；
+     *          没有定时器时返回~0ull
+     */
+    uint64_t getNextTimer();
+
+    /**
+     * @brief 获取需要执行的定时器的回调函数列表
+     * @param[out] cbs 回调函数数组
+     */
+    void listExpiredCb(std::vector<std::function<void()>>& cbs);
+
+    /**
+     * @brief 是否有定时器
+     */
+    bool hasTimer();
+
+   protected:
+    /**
+     * @brief 当有新的定时器早于当前等待的超时时间时，执行该函数
+     */
+    virtual void onTimerInsertedAtFront() = 0;
+
+   private:
+    /**
+     * @brief 将定时器挂到时间轮上，需要持有锁
+     * @return 是否需要通知onTimerInsertedAtFront
+     */
+    bool addTimer(Timer::ptr val);
+
+    /**
+     * @brief 将定时器挂到对应的槽位，不修改计数
+     */
+    void link(Timer* timer);
+
+    /**
+     * @brief 从时间轮上摘下定时器，需要持有锁
+     */
+    void unlink(Timer* timer);
+
+    /**
+     * @brief 把某一层某个槽里的定时器重新分配到下面的层
+     */
+    void cascade(int level, size_t index);
+
+    /// 第0层槽位数的位数
+    static const int kRootBits = 8;
+    /// 其他层槽位数的位数
+    static const int kLevelBits = 6;
+    /// 时间轮层数
+    static const int kLevels = 5;
+    static const size_t kRootSize = 1 << kRootBits;
+    static const size_t kLevelSize = 1 << kLevelBits;
+
+   private:
+    /// Mutex
+    MutexType m_mutex;
+    /// 每层的槽位，槽位是定时器双向链表的头节点
+    std::vector<Timer*> m_wheel[kLevels];
+    /// 时间轮当前的刻度(毫秒)，早于它的定时器都已经取出
+    uint64_t m_current = 0;
+    /// 时间轮中的定时器数量
+    size_t m_count = 0;
+    /// 最近一次getNextTimer返回的唤醒时间，新定时器早于它时需要通知
+    uint64_t m_wakeup = ~0ull;
+    /// 是否已经通知过onTimerInsertedAtFront
+    bool m_tickled = false;
+};
+
+}  // namespace coro
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file trace.cc
+ * @brief 协程切换跟踪实现
+ * @author shawn
+ * @date 2024-07-03
+ */
+#include "trace.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "mutex.h"
+#include "util.h"
+
+namespace coro {
+
+/**
+ * @brief 所有线程的缓冲区，线程退出后保留，保证导出时能看到完整的历史
+ */
+struct TraceRegistry {
+    Mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+};
+
+static TraceRegistry& GetRegistry() {
+    static TraceRegistry* s_registry = new TraceRegistry;
+    return *s_registry;
+}
+
+void TraceBuffer::snapshot(std::vector<TraceRecord>& out) const {
+    uint64_t pos = m_pos.load(std::memory_order_acquire);
+    uint64_t begin = pos > kSize ? pos - kSize : 0;
+    for (uint64_t i = begin; i < pos; ++i) {
+        out.push_back(m_records[i & (kSize - 1)]);
+    }
+}
+
+thread_local TraceBuffer* Trace::t_buffer = nullptr;
+
+TraceBuffer* Trace::CreateThreadBuffer() {
+    std::shared_ptr<TraceBuffer> buffer(new TraceBuffer(GetThreadId()));
+    TraceRegistry& registry = GetRegistry();
+    Mutex::Lock lock(registry.mutex);
+    registry.buffers.push_back(buffer);
+    t_buffer = buffer.get();
+    return t_buffer;
+}
+
+void Trace::Collect(std::vector<TraceRecord>& out) {
+    TraceRegistry& registry = GetRegistry();
+    Mutex::Lock lock(registry.mutex);
+    for (auto& i : registry.buffers) {
+        i->snapshot(out);
+    }
+    lock.unlock();
+    std::stable_sort(out.begin(), out.end(),
+                     [](const TraceRecord& lhs, const TraceRecord& rhs) {
+                         return lhs.tsc < rhs.tsc;
+                     });
+}
+
+void Trace::Dump(std::ostream& os) {
+    std::vector<TraceRecord> records;
+    Collect(records);
+    for (auto& r : records) {
+        os << r.tsc << "\t" << r.thread_id << "\t" << r.fiber_id << "\t"
+           << ToString(r.event) << "\n";
+    }
+    os.flush();
+}
+
+const char* Trace::ToString(TraceEvent event) {
+    switch (event) {
+        case TraceEvent::RESUME:
+            return "RESUME";
+        case TraceEvent::YIELD:
+            return "YIELD";
+        case TraceEvent::TERM:
+            return "TERM";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+}  // namespace coro
@@ -0,0 +1,175 @@
+/**
+ * @file trace.h
+ * @brief 协程切换跟踪，编译期开关
+ * @author shawn
+ * @date 2024-07-03
+ * @details 默认编译为空操作，定义CORO_ENABLE_TRACE后在每次切换时
+ *          把(协程id, 事件, TSC时间戳)写入线程私有的环形缓冲区，可随时导出
+ */
+#ifndef __CORO_TRACE_H__
+#define __CORO_TRACE_H__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#ifndef CORO_TRACE_BUFFER_SIZE
+/// 每个线程环形缓冲区的记录数，必须是2的幂
+#define CORO_TRACE_BUFFER_SIZE 4096
+#endif
+
+namespace coro {
+
+/**
+ * @brief 跟踪事件
+ */
+enum class TraceEvent : uint32_t {
+    /// 切入协程
+    RESUME = 0,
+    /// 协程让出
+    YIELD = 1,
+    /// 协程执行结束
+    TERM = 2,
+};
+
+/**
+ * @brief 一条跟踪记录
+ */
+struct TraceRecord {
+    /// 时间戳，x86上是TSC，其他平台是单调时钟纳秒
+    uint64_t tsc;
+    /// 协程id
+    uint64_t fiber_id;
+    /// 事件
+    TraceEvent event;
+    /// 线程id
+    int32_t thread_id;
+};
+
+/**
+ * @brief 读取时间戳计数器
+ */
+inline uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief 线程私有的跟踪环形缓冲区
+ * @details 只有所属线程写入，写满后覆盖最旧的记录，写入路径无锁也不分配内存。
+ *          导出可以在任意线程进行，正在被覆盖的最旧几条记录可能不完整
+ */
+class TraceBuffer {
+   public:
+    static const size_t kSize = CORO_TRACE_BUFFER_SIZE;
+    static_assert((kSize & (kSize - 1)) == 0, "trace buffer size must be 2^n");
+
+    /**
+     * @brief 构造函数
+     */
+    TraceBuffer(int32_t thread_id) : m_threadId(thread_id) {}
+
+    /**
+     * @brief 写入一条记录
+     */
+    void record(uint64_t fiber_id, TraceEvent event) {
+        uint64_t pos = m_pos.load(std::memory_order_relaxed);
+        TraceRecord& r = m_records[pos & (kSize - 1)];
+        r.tsc = ReadTsc();
+        r.fiber_id = fiber_id;
+        r.event = event;
+        r.thread_id = m_threadId;
+        m_pos.store(pos + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 按时间顺序取出缓冲区中的记录
+     */
+    void snapshot(std::vector<TraceRecord>& out) const;
+
+    /**
+     * @brief 清空缓冲区，只能在所属线程调用
+     */
+    void clear() { m_pos.store(0, std::memory_order_release); }
+
+   private:
+    /// 线程id
+    int32_t m_threadId;
+    /// 已写入的总记录数
+    std::atomic<uint64_t> m_pos{0};
+    /// 记录
+    TraceRecord m_records[kSize];
+};
+
+/**
+ * @brief 跟踪接口
+ */
+class Trace {
+   public:
+    /**
+     * @brief 当前线程的缓冲区，第一次调用时创建并登记
+     */
+    static TraceBuffer* GetThreadBuffer() {
+        return t_buffer ? t_buffer : CreateThreadBuffer();
+    }
+
+    /**
+     * @brief 在当前线程记录一个事件
+     */
+    static void Record(uint64_t fiber_id, TraceEvent event) {
+        GetThreadBuffer()->record(fiber_id, event);
+    }
+
+    /**
+     * @brief 取出所有线程(包括已退出线程)的记录，按时间戳排序
+     */
+    static void Collect(std::vector<TraceRecord>& out);
+
+    /**
+     * @brief 以文本形式导出所有线程的记录，每行：时间戳 线程id 协程id 事件
+     */
+    static void Dump(std::ostream& os);
+
+    /**
+     * @brief 事件名称
+     */
+    static const char* ToString(TraceEvent event);
+
+   private:
+    /**
+     * @brief 创建当前线程的缓冲区并登记
+     */
+    static TraceBuffer* CreateThreadBuffer();
+
+   private:
+    /// 当前线程的缓冲区
+    static thread_local TraceBuffer* t_buffer;
+};
+
+}  // namespace coro
+
+#ifdef CORO_ENABLE_TRACE
+#define CORO_TRACE(fiber_id, event) \
+    coro::Trace::Record((fiber_id), coro::TraceEvent::event)
+#else
+#define CORO_TRACE(fiber_id, event) ((void)0)
+#endif
+
+#endif
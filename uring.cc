@@ -0,0 +1,161 @@
+/**
+ * @file uring.cc
+ * @brief io_uring封装实现
+ * @author shawn
+ * @date 2024-07-02
+ */
+#include "uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace coro {
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags, const void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+IoUring* IoUring::Create(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = io_uring_setup(entries, &p);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // 带超时的等待依赖IORING_ENTER_EXT_ARG(5.11)，老内核直接回退到epoll
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<IoUring> ring(new IoUring);
+    ring->m_fd = fd;
+    ring->m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        ring->m_sqRingSize = ring->m_cqRingSize =
+            std::max(ring->m_sqRingSize, ring->m_cqRingSize);
+    }
+
+    ring->m_sqRing = mmap(nullptr, ring->m_sqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->m_sqRing == MAP_FAILED) {
+        ring->m_sqRing = nullptr;
+        return nullptr;
+    }
+    if (single_mmap) {
+        ring->m_cqRing = ring->m_sqRing;
+    } else {
+        ring->m_cqRing =
+            mmap(nullptr, ring->m_cqRingSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->m_cqRing == MAP_FAILED) {
+            ring->m_cqRing = nullptr;
+            return nullptr;
+        }
+    }
+    ring->m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->m_sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->m_sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)ring->m_sqRing;
+    ring->m_sqHead = (unsigned*)(sq + p.sq_off.head);
+    ring->m_sqTail = (unsigned*)(sq + p.sq_off.tail);
+    ring->m_sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    ring->m_sqEntries = *(unsigned*)(sq + p.sq_off.ring_entries);
+    ring->m_sqeTail = *ring->m_sqTail;
+    // 提交项和下标一一对应，之后不再修改间接数组
+    unsigned* array = (unsigned*)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < ring->m_sqEntries; ++i) {
+        array[i] = i;
+    }
+
+    char* cq = (char*)ring->m_cqRing;
+    ring->m_cqHead = (unsigned*)(cq + p.cq_off.head);
+    ring->m_cqTail = (unsigned*)(cq + p.cq_off.tail);
+    ring->m_cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    ring->m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    return ring.release();
+}
+
+IoUring::~IoUring() {
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_sqEntries) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqeTail & m_sqMask];
+    ++m_sqeTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned IoUring::flush() {
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    return m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::enter(unsigned to_submit, unsigned wait_nr, uint64_t timeout_ms) {
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms != ~0ull) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = timeout_ms % 1000 * 1000 * 1000;
+            arg.ts = (uint64_t)&ts;
+        }
+    }
+    int rt = 0;
+    do {
+        rt = io_uring_enter(m_fd, to_submit, wait_nr, flags,
+                            wait_nr ? &arg : nullptr, wait_nr ? sizeof(arg) : 0);
+    } while (rt < 0 && errno == EINTR);
+    return rt < 0 ? -errno : rt;
+}
+
+unsigned IoUring::peekCqes(io_uring_cqe* cqes, unsigned count) {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    unsigned n = 0;
+    for (; head != tail && n < count; ++head, ++n) {
+        cqes[n] = m_cqes[head & m_cqMask];
+    }
+    // 拷贝完成后再归还槽位给内核
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+}  // namespace coro
@@ -0,0 +1,100 @@
+/**
+ * @file uring.h
+ * @brief io_uring的轻量封装，直接使用系统调用，不依赖liburing
+ * @author shawn
+ * @date 2024-07-02
+ */
+#ifndef __CORO_URING_H__
+#define __CORO_URING_H__
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "noncopyable.h"
+
+namespace coro {
+
+/**
+ * @brief io_uring提交队列和完成队列
+ * @details 只负责ring的映射和出入队，不做加锁：
+ *          提交端(getSqe/flush)和完成端(peekCqes)需要由调用者各自串行化
+ */
+class IoUring : Noncopyable {
+   public:
+    typedef std::unique_ptr<IoUring> ptr;
+
+    /**
+     * @brief 创建io_uring
+     * @param[in] entries 提交队列长度
+     * @return 内核不支持或者缺少需要的特性(IORING_FEAT_EXT_ARG)时返回nullptr
+     */
+    static IoUring* Create(unsigned entries);
+
+    /**
+     * @brief 析构函数，解除映射并关闭ring
+     */
+    ~IoUring();
+
+    /**
+     * @brief 获取一个空闲的提交项，提交队列满时返回nullptr
+     * @details 取到的提交项在flush之前对内核不可见
+     */
+    io_uring_sqe* getSqe();
+
+    /**
+     * @brief 把已经填好的提交项发布给内核
+     * @return 内核尚未消费的提交项数量
+     */
+    unsigned flush();
+
+    /**
+     * @brief 提交并等待完成事件
+     * @param[in] to_submit 提交的数量，一般是flush的返回值
+     * @param[in] wait_nr 至少等待的完成事件数量，0表示只提交不等待
+     * @param[in] timeout_ms 等待的超时时间，~0ull表示不超时
+     * @return 成功返回提交的数量，失败返回-errno
+     */
+    int enter(unsigned to_submit, unsigned wait_nr, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief 取出已完成的事件
+     * @param[out] cqes 完成事件数组
+     * @param[in] count 数组长度
+     * @return 取出的数量
+     */
+    unsigned peekCqes(io_uring_cqe* cqes, unsigned count);
+
+   private:
+    IoUring() = default;
+
+   private:
+    /// ring的文件句柄
+    int m_fd = -1;
+    /// 提交队列的映射
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    /// 完成队列的映射，单次映射时和m_sqRing相同
+    void* m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    /// 提交项数组的映射
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    /// 本地的提交队列尾部，flush时发布到m_sqTail
+    unsigned m_sqeTail = 0;
+
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+}  // namespace coro
+
+#endif
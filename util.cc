@@ -1,7 +1,33 @@
 #include "util.h"
 
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <sstream>
 
+#include "fiber.h"
+
+namespace coro {
+
+// 每条日志都要取线程id，缓存在线程局部变量里，避免每次都进入内核
+static thread_local pid_t t_thread_id = 0;
+
+pid_t GetThreadId() {
+    if (!t_thread_id) {
+        t_thread_id = syscall(SYS_gettid);
+    }
+    return t_thread_id;
+}
+
+uint64_t GetFiberId() { return Fiber::GetFiberId(); }
+
+uint64_t GetElapsedMS() {
+    struct timespec ts = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 void Backtrace(std::vector<std::string>& bt, int size, int skip) {}
 
 std::string BacktraceToString(int size, int skip, const std::string& prefix) {
@@ -12,4 +38,6 @@ std::string BacktraceToString(int size, int skip, const std::string& prefix) {
         ss << prefix << bt[i] << std::endl;
     }
     return ss.str();
-}
\ No newline at end of file
+}
+
+}  // namespace coro
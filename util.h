@@ -7,15 +7,45 @@
 #ifndef __CORO_UTIL_H__
 #define __CORO_UTIL_H__
 
+#include <cxxabi.h>
+#include <stdint.h>
+#include <sys/types.h>
+
 #include <string>
+#include <typeinfo>
 #include <vector>
 
 namespace coro {
 
+/**
+ * @brief 返回当前线程的ID
+ */
+pid_t GetThreadId();
+
+/**
+ * @brief 返回当前协程的ID
+ */
+uint64_t GetFiberId();
+
+/**
+ * @brief 获取单调时钟的毫秒数，不受系统时间调整影响
+ */
+uint64_t GetElapsedMS();
+
 void Backtrace(std::vector<std::string>& bt, int size = 64, int skip = 1);
 
 std::string BacktraceToString(int size = 64, int skip = 2,
                               const std::string& prefix = "");
+
+/**
+ * @brief 返回类型T的可读名称
+ */
+template <class T>
+const char* TypeToName() {
+    static const char* s_name =
+        abi::__cxa_demangle(typeid(T).name(), nullptr, nullptr, nullptr);
+    return s_name;
+}
 }  // namespace coro
 
 #endif
\ No newline at end of file
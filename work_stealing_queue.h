@@ -0,0 +1,193 @@
+/**
+ * @file work_stealing_queue.h
+ * @brief Chase-Lev无锁工作窃取队列
+ * @author shawn
+ * @date 2024-06-24
+ * @details 参考 Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (PPoPP'13) 的C11实现
+ */
+#ifndef __CORO_WORK_STEALING_QUEUE_H__
+#define __CORO_WORK_STEALING_QUEUE_H__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <type_traits>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace coro {
+
+/**
+ * @brief 单生产者多消费者的工作窃取双端队列
+ * @details 只有所属线程可以调用push/pop，在底部进出(LIFO)，
+ *          其他线程调用steal从顶部取(FIFO)。元素类型必须是指针，队列为空时返回nullptr
+ */
+template <class T>
+class WorkStealingQueue : Noncopyable {
+    static_assert(std::is_pointer<T>::value,
+                  "WorkStealingQueue only stores pointers");
+
+   public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 初始容量，必须是2的幂，满了之后自动翻倍
+     */
+    explicit WorkStealingQueue(int64_t capacity = 256)
+        : m_top(0), m_bottom(0), m_array(new Array(capacity)) {}
+
+    /**
+     * @brief 析构函数，队列中剩余的元素由调用者负责
+     */
+    ~WorkStealingQueue() {
+        for (auto i : m_garbage) {
+            delete i;
+        }
+        delete m_array.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 从底部压入，只能由所属线程调用
+     */
+    void push(T item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 从底部批量压入n个元素，只发布一次底部位置，只能由所属线程调用
+     */
+    void push(const T* items, size_t n) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        Array* a = m_array.load(std::memory_order_relaxed);
+        while (b - t + static_cast<int64_t>(n) > a->capacity) {
+            a = grow(a, b, t);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            a->put(b + i, items[i]);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 从底部弹出，只能由所属线程调用
+     */
+    T pop() {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = m_array.load(std::memory_order_relaxed);
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        T item = nullptr;
+        if (t <= b) {
+            item = a->get(b);
+            if (t == b) {
+                // 只剩最后一个元素，和窃取者竞争
+                if (!m_top.compare_exchange_strong(t, t + 1,
+                                                   std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /**
+     * @brief 从顶部窃取，任意线程都可以调用
+     * @return 队列为空或者竞争失败时返回nullptr
+     */
+    T steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+
+        T item = nullptr;
+        if (t < b) {
+            Array* a = m_array.load(std::memory_order_acquire);
+            item = a->get(t);
+            if (!m_top.compare_exchange_strong(t, t + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed)) {
+                return nullptr;
+            }
+        }
+        return item;
+    }
+
+    /**
+     * @brief 返回队列中元素个数的近似值
+     */
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    /**
+     * @brief 队列是否为空(近似值)
+     */
+    bool empty() const { return size() == 0; }
+
+   private:
+    /**
+     * @brief 环形数组
+     */
+    struct Array {
+        int64_t capacity;
+        int64_t mask;
+        std::atomic<T>* buffer;
+
+        explicit Array(int64_t c)
+            : capacity(c), mask(c - 1), buffer(new std::atomic<T>[c]) {}
+
+        ~Array() { delete[] buffer; }
+
+        T get(int64_t i) const {
+            return buffer[i & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T item) {
+            buffer[i & mask].store(item, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @brief 容量翻倍，旧数组可能还在被窃取者读取，析构时才释放
+     */
+    Array* grow(Array* a, int64_t b, int64_t t) {
+        Array* na = new Array(a->capacity * 2);
+        for (int64_t i = t; i != b; ++i) {
+            na->put(i, a->get(i));
+        }
+        m_garbage.push_back(a);
+        m_array.store(na, std::memory_order_release);
+        return na;
+    }
+
+   private:
+    // 窃取端，和所属线程操作的底部分开在不同的cache line上
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    std::atomic<Array*> m_array;
+    // 扩容后被替换的数组
+    std::vector<Array*> m_garbage;
+};
+
+}  // namespace coro
+
+#endif